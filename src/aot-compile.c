@@ -0,0 +1,321 @@
+#include "aot.h"
+#include "chip8.h"
+#include "control.h"
+#include "quirks.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Ahead of time translator, which turns a CHIP-8 ROM into a C file that runs it natively.
+// See aot.h for how the generated code works and how to run it.
+//
+// The control flow of the ROM is followed from PROGRAM_START through direct jumps, calls (and the
+// instructions they return to) and both sides of skips. Every instruction found that way is
+// translated, and everything else is left to the interpreter at runtime.
+
+typedef struct Translator {
+  uint8_t memory[ADDRESS_COUNT]; // the ROM at PROGRAM_START, the rest is zeroed
+  size_t rom_size;
+  unsigned quirks;
+  bool reachable[ADDRESS_COUNT]; // addresses of the instructions to translate
+} Translator;
+
+void help_menu() {
+  printf("Usage: chip8-aot [...options] [rom-filepath] [output-filepath]\n");
+  printf("Options:\t\tDescription\n");
+  printf("--old-shift\tTranslate for programs which copy VY into VX before doing bit shifts\n");
+  printf("--jump-quirk\tTranslate for programs which use VX instead of V0 in 0xBNNN\n");
+  printf("--old-index\tTranslate for programs which increment I when loading/storing memory\n");
+  printf("--name [name]\tName of the AotProgram to define (default chip8_aot_program)\n");
+}
+
+// Whether an instruction at `address` can be translated, which only works inside of the ROM
+static bool translatable(const Translator *const translator, long address) {
+  return address >= PROGRAM_START && address + 2 <= PROGRAM_START + (long)translator->rom_size;
+}
+
+static uint16_t instruction_at(const Translator *const translator, int address) {
+  return translator->memory[address] << 8 | translator->memory[address + 1];
+}
+
+// Find every instruction reachable from PROGRAM_START without knowing any register values
+static void find_reachable(Translator *const translator) {
+  // every instruction adds at most 2 successors
+  static int worklist[2 * ADDRESS_COUNT + 1];
+  int pending = 0;
+  worklist[pending++] = PROGRAM_START;
+
+  while (pending) {
+    int address = worklist[--pending];
+    if (!translatable(translator, address) || translator->reachable[address]) {
+      continue;
+    }
+    translator->reachable[address] = true;
+
+    uint16_t instruction = instruction_at(translator, address);
+    uint8_t nn = instruction & OP_NN;
+    int successors[2];
+    int count = 0;
+    switch (instruction >> 12) {
+      case OP_SYS:
+        if (instruction != OP_RET) {
+          successors[count++] = address + 2;
+        }
+        break;
+      case OP_JUMP:
+        successors[count++] = instruction & OP_NNN;
+        break;
+      case OP_CALL:
+        successors[count++] = instruction & OP_NNN;
+        successors[count++] = address + 2; // where the call returns to
+        break;
+      case OP_BEQI:
+      case OP_BNEI:
+      case OP_BEQ:
+      case OP_BNE:
+        successors[count++] = address + 2;
+        successors[count++] = address + 4;
+        break;
+      case OP_BKEY:
+        successors[count++] = address + 2;
+        if (nn == BK_P || nn == BK_NP) {
+          successors[count++] = address + 4;
+        }
+        break;
+      case OP_JO:
+        // the target depends on a register, so it's found through the dispatch switch
+        break;
+      default:
+        successors[count++] = address + 2;
+        break;
+    }
+    for (int i = 0; i < count; i++) {
+      worklist[pending++] = successors[i];
+    }
+  }
+}
+
+// Write a jump to the translated instruction at `address`, or to the dispatch switch when the
+// address wasn't translated
+static void emit_goto(FILE *out, const Translator *const translator, int address) {
+  if (address < ADDRESS_COUNT && translator->reachable[address]) {
+    fprintf(out, "  goto L_%03X;\n", address);
+  } else {
+    fprintf(out, "  chip8->pc = 0x%03X;\n  goto dispatch;\n", address);
+  }
+}
+
+// Write the body of an ALU instruction, in the same order as exec_alu
+static void emit_alu(FILE *out, const Translator *const translator, int x, int y, int n) {
+  bool legacy_shift = translator->quirks & QUIRK_LEGACY_SHIFT;
+  switch (n) {
+    case ALU_SET:
+      fprintf(out, "  V[%d] = V[%d];\n", x, y);
+      break;
+    case ALU_OR:
+      fprintf(out, "  V[%d] |= V[%d];\n", x, y);
+      break;
+    case ALU_AND:
+      fprintf(out, "  V[%d] &= V[%d];\n", x, y);
+      break;
+    case ALU_XOR:
+      fprintf(out, "  V[%d] ^= V[%d];\n", x, y);
+      break;
+    case ALU_ADD:
+      fprintf(out, "  result = V[%d] + V[%d];\n  V[%d] = (uint8_t)result;\n"
+          "  V[15] = result > 255;\n", x, y, x);
+      break;
+    case ALU_SUBY:
+      fprintf(out, "  result = V[%d] - V[%d];\n  V[15] = V[%d] <= V[%d];\n"
+          "  V[%d] = (uint8_t)result;\n", x, y, y, x, x);
+      break;
+    case ALU_SRL:
+      if (legacy_shift) {
+        fprintf(out, "  V[%d] = V[%d];\n", x, y);
+      }
+      fprintf(out, "  V[15] = V[%d] & 1;\n  V[%d] = V[%d] >> 1;\n", x, x, x);
+      break;
+    case ALU_SUBX:
+      fprintf(out, "  result = V[%d] - V[%d];\n  V[15] = V[%d] <= V[%d];\n"
+          "  V[%d] = (uint8_t)result;\n", y, x, x, y, x);
+      break;
+    case ALU_SLL:
+      if (legacy_shift) {
+        fprintf(out, "  V[%d] = V[%d];\n", x, y);
+      }
+      fprintf(out, "  V[15] = (V[%d] & 0x80) != 0;\n  V[%d] = V[%d] << 1;\n", x, x, x);
+      break;
+  }
+}
+
+// Write the translation of the instruction at `address`
+static void emit_instruction(FILE *out, const Translator *const translator, int address) {
+  uint16_t instruction = instruction_at(translator, address);
+  uint16_t nnn = instruction & OP_NNN;
+  uint8_t nn = instruction & OP_NN;
+  int x = (instruction & OP_X) >> 8;
+  int y = (instruction & OP_Y) >> 4;
+  int n = instruction & OP_N;
+  int next = address + 2;
+
+  fprintf(out, "L_%03X:\n  AOT_STEP(0x%03X, 0x%04X)\n", address, address, instruction);
+  switch (instruction >> 12) {
+    case OP_SYS:
+      if (instruction == OP_RET) {
+        fprintf(out, "  if (chip8->sp == 0) {\n    chip8->fault = FAULT_STACK_UNDERFLOW;\n"
+            "    goto dispatch;\n  }\n  chip8->pc = chip8->stack[chip8->sp];\n  chip8->sp--;\n"
+            "  goto dispatch;\n");
+        return;
+      }
+      fprintf(out, "  AOT_INTERPRET(0x%04X)\n", instruction);
+      break;
+    case OP_JUMP:
+      emit_goto(out, translator, nnn);
+      return;
+    case OP_CALL:
+      fprintf(out, "  if (chip8->sp >= STACK_SIZE - 1) {\n"
+          "    chip8->fault = FAULT_STACK_OVERFLOW;\n    goto dispatch;\n  }\n"
+          "  chip8->sp++;\n  chip8->stack[chip8->sp] = 0x%03X;\n", next);
+      emit_goto(out, translator, nnn);
+      return;
+    case OP_BEQI:
+    case OP_BNEI:
+    case OP_BEQ:
+    case OP_BNE:
+      if ((instruction >> 12) == OP_BEQI || (instruction >> 12) == OP_BNEI) {
+        fprintf(out, "  if (V[%d] %s 0x%02X) {\n",
+            x, (instruction >> 12) == OP_BEQI ? "==" : "!=", nn);
+      } else {
+        fprintf(out, "  if (V[%d] %s V[%d]) {\n",
+            x, (instruction >> 12) == OP_BEQ ? "==" : "!=", y);
+      }
+      emit_goto(out, translator, address + 4);
+      fprintf(out, "  }\n");
+      break;
+    case OP_LI:
+      fprintf(out, "  V[%d] = 0x%02X;\n", x, nn);
+      break;
+    case OP_ADDI:
+      fprintf(out, "  V[%d] += 0x%02X;\n", x, nn);
+      break;
+    case OP_ALU:
+      emit_alu(out, translator, x, y, n);
+      break;
+    case OP_SET_IDX:
+      fprintf(out, "  chip8->I = 0x%03X;\n", nnn);
+      break;
+    case OP_JO:
+      fprintf(out, "  chip8->pc = 0x%03X + V[%d];\n  goto dispatch;\n",
+          nnn, translator->quirks & QUIRK_JUMP ? x : 0);
+      return;
+    case OP_BKEY:
+      fprintf(out, "  chip8->keys_read |= 1 << (V[%d] & 0xF);\n", x);
+      if (nn == BK_P || nn == BK_NP) {
+        fprintf(out, "  if (%schip8->key[V[%d] & 0xF]) {\n", nn == BK_P ? "" : "!", x);
+        emit_goto(out, translator, address + 4);
+        fprintf(out, "  }\n");
+      }
+      break;
+    case OP_IO:
+      fprintf(out, "  AOT_INTERPRET(0x%04X)\n", instruction);
+      if (nn == IO_GET_KEY) {
+        // waiting for a key moves the program counter back to this instruction
+        fprintf(out, "  goto dispatch;\n");
+        return;
+      }
+      break;
+    default: // clearing the screen, drawing and random numbers aren't worth translating
+      fprintf(out, "  AOT_INTERPRET(0x%04X)\n", instruction);
+      break;
+  }
+  emit_goto(out, translator, next);
+}
+
+// Write the whole translated program
+static void emit_program(FILE *out, const Translator *const translator, const char *name,
+    const char *rom_path) {
+  fprintf(out, "// Translated from %s by chip8-aot, do not edit.\n", rom_path);
+  fprintf(out, "#include \"aot.h\"\n#include \"chip8.h\"\n\n");
+
+  fprintf(out, "static const uint8_t ROM[] = {");
+  for (size_t i = 0; i < translator->rom_size; i++) {
+    fprintf(out, "%s0x%02X,", i % 12 ? " " : "\n  ", translator->memory[PROGRAM_START + i]);
+  }
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "static long run(Chip8 *const chip8, long count) {\n");
+  fprintf(out, "  long executed = 0;\n  short result __attribute__((unused));\n"
+      "  uint8_t *const V = chip8->V;\n\n");
+  fprintf(out, "dispatch:\n");
+  fprintf(out, "  if (executed >= count || chip8->pc >= ADDRESS_COUNT || chip8->fault) {\n"
+      "    return executed;\n  }\n");
+  fprintf(out, "  switch (chip8->pc) {\n");
+  for (int address = 0; address < ADDRESS_COUNT; address++) {
+    if (translator->reachable[address]) {
+      fprintf(out, "    case 0x%03X: goto L_%03X;\n", address, address);
+    }
+  }
+  fprintf(out, "  }\n\n");
+  fprintf(out, "interpret:\n  chip8->exec_variant(chip8, fetch_instruction(chip8));\n"
+      "  executed++;\n  goto dispatch;\n\n");
+
+  for (int address = 0; address < ADDRESS_COUNT; address++) {
+    if (translator->reachable[address]) {
+      emit_instruction(out, translator, address);
+    }
+  }
+  fprintf(out, "}\n\n");
+
+  fprintf(out, "const AotProgram %s = { ROM, sizeof(ROM), 0x%X, run };\n",
+      name, translator->quirks);
+}
+
+int main(int argc, char* argv[]) {
+  static Translator translator;
+  const char *name = "chip8_aot_program";
+  const char *paths[2] = { NULL, NULL };
+  int path_count = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--old-shift", 12) == 0) {
+      translator.quirks |= QUIRK_LEGACY_SHIFT;
+    } else if (strncmp(argv[i], "--jump-quirk", 13) == 0) {
+      translator.quirks |= QUIRK_JUMP;
+    } else if (strncmp(argv[i], "--old-index", 12) == 0) {
+      translator.quirks |= QUIRK_LEGACY_INDEXING;
+    } else if (strncmp(argv[i], "--name", 7) == 0 && i + 1 < argc) {
+      name = argv[++i];
+    } else if (path_count < 2) {
+      paths[path_count++] = argv[i];
+    }
+  }
+  if (path_count < 2) {
+    help_menu();
+    return -1;
+  }
+
+  FILE *rom = fopen(paths[0], "rb");
+  if (rom == NULL) {
+    fprintf(stderr, "Unable to open ROM %s\n", paths[0]);
+    return -1;
+  }
+  translator.rom_size = fread(translator.memory + PROGRAM_START, 1,
+      ADDRESS_COUNT - PROGRAM_START, rom);
+  fclose(rom);
+
+  find_reachable(&translator);
+
+  FILE *out = fopen(paths[1], "w");
+  if (out == NULL) {
+    fprintf(stderr, "Unable to write %s\n", paths[1]);
+    return -1;
+  }
+  emit_program(out, &translator, name, paths[0]);
+  fclose(out);
+
+  int translated = 0;
+  for (int address = 0; address < ADDRESS_COUNT; address++) {
+    translated += translator.reachable[address];
+  }
+  printf("Translated %d instructions from %s\n", translated, paths[0]);
+  return 0;
+}
@@ -0,0 +1,44 @@
+#include "aot.h"
+#include "control.h"
+#include "quirks.h"
+#include <string.h>
+
+int aot_load(Chip8 *const chip8, const AotProgram *const program) {
+  if (program->rom_size > ADDRESS_COUNT - PROGRAM_START) {
+    return -1;
+  }
+#define SET_QUIRK(field, bit) chip8->config.field = (program->quirks & (bit)) != 0;
+  QUIRK_LIST(SET_QUIRK)
+#undef SET_QUIRK
+  chip8->exec_variant = select_instruction_handler(&chip8->config);
+  memcpy(chip8->memory + PROGRAM_START, program->rom, program->rom_size);
+  return 0;
+}
+
+int aot_matches(const Chip8 *const chip8, const AotProgram *const program) {
+  if (quirk_mask(&chip8->config) != program->quirks
+      || program->rom_size > ADDRESS_COUNT - PROGRAM_START
+      || memcmp(chip8->memory + PROGRAM_START, program->rom, program->rom_size) != 0) {
+    return 0;
+  }
+  // a longer program which starts with the same bytes isn't the same program
+  for (int address = PROGRAM_START + program->rom_size; address < ADDRESS_COUNT; address++) {
+    if (chip8->memory[address]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void aot_exec_frame(Chip8 *const chip8, const AotProgram *const program) {
+  // translated code counts instructions at a flat rate, so it can't keep cycle timing
+  if (chip8->config.vip_timing || chip8->config.display_wait) {
+    exec_frame(chip8);
+    return;
+  }
+  long count = frame_budget(chip8) - chip8->frame_cycles;
+  if (count > 0) {
+    chip8->frame_cycles += program->run(chip8, count);
+  }
+  chip8_decrement_timers(chip8);
+}
@@ -0,0 +1,71 @@
+#ifndef AOT
+#define AOT
+
+#include "chip8.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Support for programs translated ahead of time into C by chip8-aot (see aot-compile.c).
+//
+// A translated program is a C file defining an AotProgram, holding the original ROM and a
+// `run` function with a label for every instruction reachable from PROGRAM_START. Direct jumps,
+// calls and skips become gotos between those labels. Anything the translator couldn't follow
+// (BNNN jumps, returns, instructions outside the ROM) goes through a switch on the program
+// counter, and addresses which weren't translated run on the interpreter. Before running each
+// translated instruction, the code checks that memory still holds that instruction, so
+// self-modifying programs fall back to the interpreter for whatever they overwrote.
+//
+// Translated code updates the CHIP-8 exactly like the interpreter does, so the state after every
+// instruction is identical (only the debug logging is left out).
+
+typedef struct AotProgram {
+  const uint8_t *rom; // the program the code was translated from
+  size_t rom_size;
+  unsigned quirks; // the quirk mask the code was translated for (see quirks.h)
+  // Run up to `count` instructions, stopping early if the program counter leaves memory or the
+  // program faults. Returns the number of instructions which were run.
+  long (*run)(Chip8 *const chip8, long count);
+} AotProgram;
+
+// Load a translated program into a CHIP-8 and set its quirks to the ones the program was
+// translated for, returning 0 if successful and -1 if the program doesn't fit in memory
+// `chip8`: the CHIP-8 system to load the program into
+// `program`: the translated program
+int aot_load(Chip8 *const chip8, const AotProgram *const program);
+
+// Check whether a CHIP-8 holds the exact program a translation was made from, with the same
+// quirks, so it can be run with the translation
+// `chip8`: the CHIP-8 system to check
+// `program`: the translated program
+int aot_matches(const Chip8 *const chip8, const AotProgram *const program);
+
+// Run the rest of the current timer frame's instructions with the translated code and then update
+// the timers, the same as `exec_frame` does with the interpreter
+// `chip8`: the CHIP-8 system the program was loaded into (see `aot_load`)
+// `program`: the translated program
+void aot_exec_frame(Chip8 *const chip8, const AotProgram *const program);
+
+// The rest of this file is only used by the generated code.
+
+// Start running the translated instruction `instruction` at `address`, going back to the
+// interpreter if the instruction has been overwritten and stopping if the budget is used up.
+// Like `fetch_instruction`, this moves the program counter to the next instruction.
+#define AOT_STEP(address, instruction) \
+  if (executed >= count) { \
+    chip8->pc = (address); \
+    return executed; \
+  } \
+  if (chip8->memory[(address)] != (instruction) >> 8 \
+      || chip8->memory[(address) + 1] != ((instruction) & 0xFF)) { \
+    chip8->pc = (address); \
+    goto interpret; \
+  } \
+  executed++; \
+  chip8->pc = (address) + 2; \
+  chip8->opcode = (instruction) >> 12; \
+  chip8->display_flag = 0;
+
+// Run an instruction with the interpreter, once AOT_STEP has fetched it
+#define AOT_INTERPRET(instruction) chip8->exec_variant(chip8, (instruction));
+
+#endif
@@ -0,0 +1,92 @@
+#include "capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Converts a capture written by `chip8 --capture` into raw 8-bit grayscale video at 60 frames
+// per second (one frame per timer tick), which can be turned into an animated image or a regular
+// video file with e.g.
+//
+// ffmpeg -f rawvideo -pix_fmt gray -s 640x320 -r 60 -i out.raw out.gif
+
+#define MAX_SCREEN_SIZE (128 * 64)
+
+void help_menu() {
+  printf("Usage: chip8-capture [...options] [capture-filepath] [output-filepath]\n");
+  printf("Options:\t\tDescription\n");
+  printf("--scale [n]\tScale each CHIP-8 pixel up to n x n pixels (default 10)\n");
+}
+
+// Write a single screen to the output file, scaled up by the given amount
+void write_frame(FILE *out, const uint8_t *screen, int width, int height, int scale) {
+  uint8_t row[128 * 64];
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width * scale; x++) {
+      row[x] = screen[y * width + x / scale] ? 255 : 0;
+    }
+    for (int i = 0; i < scale; i++) {
+      fwrite(row, 1, width * scale, out);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  char *input_path = NULL;
+  char *output_path = NULL;
+  int scale = 10;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--scale", 8) == 0 && i + 1 < argc) {
+      scale = atoi(argv[++i]);
+    } else if (input_path == NULL) {
+      input_path = argv[i];
+    } else {
+      output_path = argv[i];
+    }
+  }
+  // limits the size of a scaled row to the row buffer in `write_frame`
+  if (input_path == NULL || output_path == NULL || scale < 1 || scale > 64) {
+    help_menu();
+    return -1;
+  }
+
+  CaptureReader *reader = capture_reader_open(input_path);
+  if (reader == NULL) {
+    fprintf(stderr, "Unable to read capture file %s\n", input_path);
+    return -1;
+  }
+  FILE *out = fopen(output_path, "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Unable to open output file %s\n", output_path);
+    capture_reader_close(reader);
+    return -1;
+  }
+
+  int width;
+  int height;
+  capture_reader_size(reader, &width, &height);
+
+  // each record holds the screen presented at a given tick, so the previous screen gets
+  // repeated for every tick until the next record is presented
+  uint8_t screen[MAX_SCREEN_SIZE] = { 0 };
+  uint8_t next[MAX_SCREEN_SIZE];
+  uint64_t tick_delta;
+  long frames = 0;
+  int result;
+  while ((result = capture_reader_next(reader, next, &tick_delta)) == 1) {
+    for (uint64_t i = 0; i < tick_delta; i++, frames++) {
+      write_frame(out, screen, width, height, scale);
+    }
+    memcpy(screen, next, width * height);
+  }
+  write_frame(out, screen, width, height, scale);
+  frames++;
+
+  if (result == -1) {
+    fprintf(stderr, "Capture file is corrupt, stopping after %ld frames\n", frames);
+  }
+  printf("Wrote %ld frames of %dx%d gray 60 fps raw video\n", frames, width * scale, height * scale);
+
+  fclose(out);
+  capture_reader_close(reader);
+  return result == -1 ? -1 : 0;
+}
@@ -0,0 +1,294 @@
+#include "capture.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// largest possible packed screen, 128x64 (SUPER-CHIP) at 1 bit per pixel
+#define MAX_PACKED_SIZE (128 * 64 / 8)
+// worst case size of an encoded frame: every byte is a literal, plus the run headers
+#define MAX_ENCODED_SIZE (MAX_PACKED_SIZE + 16)
+// records are never written more than a day of frames apart, so a larger gap means the file is
+// corrupt (and a reader repeating the previous screen for all of it would never finish)
+#define MAX_TICK_DELTA (60 * 60 * 60 * 24)
+
+typedef struct QueuedFrame {
+  uint8_t packed[MAX_PACKED_SIZE];
+  uint64_t tick;
+} QueuedFrame;
+
+struct Capture {
+  FILE *file;
+  int packed_size;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t frame_ready;
+  pthread_cond_t slot_free;
+  bool wait_when_full;
+  // ring buffer of frames waiting for the capture thread, `head` is the next one to encode
+  QueuedFrame queue[CAPTURE_QUEUE_SIZE];
+  int head;
+  int count;
+  int closing;
+  long dropped;
+  // state only touched by the capture thread
+  uint8_t previous[MAX_PACKED_SIZE];
+  uint64_t previous_tick;
+};
+
+struct CaptureReader {
+  FILE *file;
+  int width;
+  int height;
+  int packed_size;
+  uint8_t previous[MAX_PACKED_SIZE];
+};
+
+// Write a varint into a buffer, returning the number of bytes written
+static int put_varint(uint8_t *buffer, uint64_t value) {
+  int size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buffer[size++] = value;
+  return size;
+}
+
+// Read a varint from a file, returning 0 if successful
+static int read_varint(FILE *file, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = fgetc(file);
+    if (byte == EOF) {
+      return -1;
+    }
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Run-length encode the XOR of two packed screens, returning the size of the encoded data
+static int encode_delta(const uint8_t *current, const uint8_t *previous, int size, uint8_t *out) {
+  uint8_t delta[MAX_PACKED_SIZE];
+  for (int i = 0; i < size; i++) {
+    delta[i] = current[i] ^ previous[i];
+  }
+
+  int length = 0;
+  int pos = 0;
+  while (pos < size) {
+    int zeros = 0;
+    while (pos + zeros < size && delta[pos + zeros] == 0) {
+      zeros++;
+    }
+    pos += zeros;
+    // a literal run only ends once it reaches at least 2 zero bytes, since a lone zero costs
+    // less as part of the literal than as the start of a new group
+    int literals = 0;
+    while (pos + literals < size && !(delta[pos + literals] == 0
+          && (pos + literals + 1 >= size || delta[pos + literals + 1] == 0))) {
+      literals++;
+    }
+    length += put_varint(out + length, zeros);
+    length += put_varint(out + length, literals);
+    memcpy(out + length, delta + pos, literals);
+    length += literals;
+    pos += literals;
+  }
+  return length;
+}
+
+static void* capture_thread(void *data) {
+  Capture *capture = data;
+  uint8_t header[20]; // room for the two varints before each frame
+
+  pthread_mutex_lock(&capture->lock);
+  while (1) {
+    while (capture->count == 0 && !capture->closing) {
+      pthread_cond_wait(&capture->frame_ready, &capture->lock);
+    }
+    if (capture->count == 0) {
+      break;
+    }
+    // take a local copy so the slot can be reused while this frame is being written
+    QueuedFrame frame = capture->queue[capture->head];
+    capture->head = (capture->head + 1) % CAPTURE_QUEUE_SIZE;
+    capture->count--;
+    pthread_cond_signal(&capture->slot_free);
+    pthread_mutex_unlock(&capture->lock);
+
+    uint8_t payload[MAX_ENCODED_SIZE];
+    int payload_size = encode_delta(frame.packed, capture->previous, capture->packed_size, payload);
+    // a CHIP-8 whose ticks went backwards shows its screen straight away
+    uint64_t delta = frame.tick > capture->previous_tick ? frame.tick - capture->previous_tick : 0;
+    delta = delta < MAX_TICK_DELTA ? delta : MAX_TICK_DELTA;
+    int size = put_varint(header, delta);
+    size += put_varint(header + size, payload_size);
+    fwrite(header, 1, size, capture->file);
+    fwrite(payload, 1, payload_size, capture->file);
+
+    memcpy(capture->previous, frame.packed, capture->packed_size);
+    capture->previous_tick = frame.tick;
+    pthread_mutex_lock(&capture->lock);
+  }
+  pthread_mutex_unlock(&capture->lock);
+  return NULL;
+}
+
+Capture* capture_open(const char *path, int width, int height, bool wait_when_full) {
+  if (width * height / 8 > MAX_PACKED_SIZE) {
+    return NULL;
+  }
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  Capture *capture = calloc(1, sizeof(Capture));
+  capture->file = file;
+  capture->packed_size = width * height / 8;
+  capture->wait_when_full = wait_when_full;
+
+  uint8_t header[CAPTURE_HEADER_SIZE];
+  memcpy(header, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+  header[CAPTURE_MAGIC_SIZE] = CAPTURE_VERSION;
+  header[CAPTURE_MAGIC_SIZE + 1] = width;
+  header[CAPTURE_MAGIC_SIZE + 2] = height;
+  fwrite(header, 1, CAPTURE_HEADER_SIZE, file);
+
+  pthread_mutex_init(&capture->lock, NULL);
+  pthread_cond_init(&capture->frame_ready, NULL);
+  pthread_cond_init(&capture->slot_free, NULL);
+  if (pthread_create(&capture->thread, NULL, capture_thread, capture) != 0) {
+    // every frame would be queued and never written, so there's no capture without the thread
+    pthread_mutex_destroy(&capture->lock);
+    pthread_cond_destroy(&capture->frame_ready);
+    pthread_cond_destroy(&capture->slot_free);
+    fclose(file);
+    remove(path);
+    free(capture);
+    return NULL;
+  }
+  return capture;
+}
+
+void capture_frame(Capture *const capture, const uint8_t *const screen, uint64_t tick) {
+  // pack outside of the lock, it's the only work done on the emulator's thread
+  uint8_t packed[MAX_PACKED_SIZE];
+  for (int byte = 0; byte < capture->packed_size; byte++) {
+    const uint8_t *pixels = screen + byte * 8;
+    uint8_t bits = 0;
+    for (int bit = 0; bit < 8; bit++) {
+      bits = bits << 1 | (pixels[bit] != 0);
+    }
+    packed[byte] = bits;
+  }
+
+  pthread_mutex_lock(&capture->lock);
+  while (capture->wait_when_full && capture->count == CAPTURE_QUEUE_SIZE) {
+    pthread_cond_wait(&capture->slot_free, &capture->lock);
+  }
+  if (capture->count == CAPTURE_QUEUE_SIZE) {
+    capture->dropped++;
+  } else {
+    QueuedFrame *slot = &capture->queue[(capture->head + capture->count) % CAPTURE_QUEUE_SIZE];
+    memcpy(slot->packed, packed, capture->packed_size);
+    slot->tick = tick;
+    capture->count++;
+    pthread_cond_signal(&capture->frame_ready);
+  }
+  pthread_mutex_unlock(&capture->lock);
+}
+
+long capture_close(Capture *capture) {
+  pthread_mutex_lock(&capture->lock);
+  capture->closing = 1;
+  pthread_cond_signal(&capture->frame_ready);
+  pthread_mutex_unlock(&capture->lock);
+  pthread_join(capture->thread, NULL);
+
+  long dropped = capture->dropped;
+  fclose(capture->file);
+  pthread_mutex_destroy(&capture->lock);
+  pthread_cond_destroy(&capture->frame_ready);
+  pthread_cond_destroy(&capture->slot_free);
+  free(capture);
+  return dropped;
+}
+
+CaptureReader* capture_reader_open(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  uint8_t header[CAPTURE_HEADER_SIZE];
+  if (fread(header, 1, CAPTURE_HEADER_SIZE, file) != CAPTURE_HEADER_SIZE
+      || memcmp(header, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0
+      || header[CAPTURE_MAGIC_SIZE] != CAPTURE_VERSION
+      || header[CAPTURE_MAGIC_SIZE + 1] * header[CAPTURE_MAGIC_SIZE + 2] / 8 > MAX_PACKED_SIZE) {
+    fclose(file);
+    return NULL;
+  }
+
+  CaptureReader *reader = calloc(1, sizeof(CaptureReader));
+  reader->file = file;
+  reader->width = header[CAPTURE_MAGIC_SIZE + 1];
+  reader->height = header[CAPTURE_MAGIC_SIZE + 2];
+  reader->packed_size = reader->width * reader->height / 8;
+  return reader;
+}
+
+void capture_reader_size(CaptureReader *const reader, int *width, int *height) {
+  *width = reader->width;
+  *height = reader->height;
+}
+
+int capture_reader_next(CaptureReader *const reader, uint8_t *screen, uint64_t *tick_delta) {
+  uint64_t payload_size;
+  if (read_varint(reader->file, tick_delta)) {
+    return 0;
+  }
+  if (*tick_delta > MAX_TICK_DELTA) {
+    return -1;
+  }
+  if (read_varint(reader->file, &payload_size)) {
+    return -1;
+  }
+
+  uint64_t packed_size = reader->packed_size;
+  uint64_t pos = 0;
+  while (pos < packed_size) {
+    uint64_t zeros;
+    uint64_t literals;
+    // checked one at a time so a huge count can't wrap around past the check
+    if (read_varint(reader->file, &zeros) || read_varint(reader->file, &literals)
+        || zeros > packed_size - pos || literals > packed_size - pos - zeros) {
+      return -1;
+    }
+    pos += zeros;
+    for (uint64_t i = 0; i < literals; i++, pos++) {
+      int byte = fgetc(reader->file);
+      if (byte == EOF) {
+        return -1;
+      }
+      reader->previous[pos] ^= byte;
+    }
+  }
+
+  for (int byte = 0; byte < reader->packed_size; byte++) {
+    for (int bit = 0; bit < 8; bit++) {
+      screen[byte * 8 + bit] = (reader->previous[byte] >> (7 - bit)) & 1;
+    }
+  }
+  return 1;
+}
+
+void capture_reader_close(CaptureReader *reader) {
+  fclose(reader->file);
+  free(reader);
+}
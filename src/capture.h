@@ -0,0 +1,83 @@
+#ifndef CAPTURE
+#define CAPTURE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Capture files store every presented CHIP-8 screen in a compact format:
+//
+// header: the 5 bytes "C8CAP", followed by the version, display width and display height
+//         (1 byte each)
+// frames: one record per presented screen, each made up of
+//   - the number of timer ticks (60 Hz frames) since the previous record, as a varint
+//   - the length of the compressed screen data in bytes, as a varint
+//   - the compressed screen data
+//
+// Screens are packed to 1 bit per pixel (most significant bit first, row by row) and XOR'd with
+// the previously recorded screen, so unchanged pixels become 0 bits. The result is run-length
+// encoded as repeated (zero byte count varint, literal byte count varint, literal bytes) groups
+// until every byte of the packed screen has been covered.
+//
+// Varints are little-endian base 128: 7 bits per byte, with the high bit set on all but the last.
+#define CAPTURE_MAGIC "C8CAP"
+#define CAPTURE_MAGIC_SIZE 5
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE (CAPTURE_MAGIC_SIZE + 3)
+
+// number of screens that can be waiting to be encoded before new frames start getting dropped
+#define CAPTURE_QUEUE_SIZE 256
+
+typedef struct Capture Capture;
+
+// Open a capture file and start the background thread which compresses and writes frames to it,
+// returning NULL if the file could not be opened or the thread could not be started.
+// NOTE: This function uses memory allocation. It is expected that `capture_close` will be called
+// when the program is finished in order to write any remaining frames and free that memory.
+//
+// `path`: the path of the file to write the capture to
+// `width`: the width of the screens being captured
+// `height`: the height of the screens being captured
+// `wait_when_full`: whether `capture_frame` should wait for the capture thread to catch up
+//                   instead of dropping frames, for programs which aren't running in real time
+Capture* capture_open(const char *path, int width, int height, bool wait_when_full);
+
+// Queue a screen to be written to the capture. This only packs the screen into its 1-bit form,
+// all compression and file IO happens on the capture's thread. If the thread has fallen too
+// far behind the frame is dropped instead of blocking, unless the capture was opened with
+// `wait_when_full`.
+//
+// `capture`: the capture to add the frame to
+// `screen`: the screen to record, with 1 byte per pixel (non-zero for on)
+// `tick`: the number of timer ticks the CHIP-8 has run for when the screen was presented
+void capture_frame(Capture *const capture, const uint8_t *const screen, uint64_t tick);
+
+// Finish writing any queued frames, stop the capture thread and close the file.
+// Returns the number of frames that were dropped because the queue was full.
+// `capture`: the capture to close
+long capture_close(Capture *capture);
+
+typedef struct CaptureReader CaptureReader;
+
+// Open a capture file for reading, returning NULL if it can't be opened or isn't a capture file.
+// `path`: the path of the capture file
+CaptureReader* capture_reader_open(const char *path);
+
+// Get the dimensions of the screens stored in a capture
+// `reader`: the capture being read
+// `width`: out parameter for the width of the screens
+// `height`: out parameter for the height of the screens
+void capture_reader_size(CaptureReader *const reader, int *width, int *height);
+
+// Decode the next frame in a capture, returning 1 if a frame was read, 0 at the end of the file
+// and -1 if the file is corrupt, which includes records more than a day of frames apart.
+//
+// `reader`: the capture being read
+// `screen`: out parameter for the decoded screen, with 1 byte per pixel (1 for on, 0 for off)
+// `tick_delta`: out parameter for the number of timer ticks since the previous frame
+int capture_reader_next(CaptureReader *const reader, uint8_t *screen, uint64_t *tick_delta);
+
+// Close a capture file opened for reading
+// `reader`: the reader to close
+void capture_reader_close(CaptureReader *reader);
+
+#endif
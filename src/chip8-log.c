@@ -0,0 +1,24 @@
+#include "chip8-log.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+// longest message the core logs, anything past this is cut off
+#define MAX_LOG_SIZE 256
+
+Chip8LogHandler chip8_log_handler = NULL;
+
+void chip8_set_log_handler(Chip8LogHandler handler) {
+  chip8_log_handler = handler;
+}
+
+void chip8_log(const char *format, ...) {
+  if (chip8_log_handler == NULL) {
+    return;
+  }
+  char message[MAX_LOG_SIZE];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  chip8_log_handler(message);
+}
@@ -0,0 +1,28 @@
+#ifndef CHIP8_LOG_H
+#define CHIP8_LOG_H
+
+// A function which receives the debug messages logged by the interpreter core
+typedef void (*Chip8LogHandler)(const char *message);
+
+// the current log handler, NULL if logging is disabled (the default)
+extern Chip8LogHandler chip8_log_handler;
+
+// Set the function which receives debug messages from the interpreter core, replacing the
+// previous one. The core doesn't depend on any logging library, so frontends can forward
+// these messages wherever they want (e.g. SDL's log).
+// `handler`: the new log handler, or NULL to disable logging
+void chip8_set_log_handler(Chip8LogHandler handler);
+
+// Format a message and pass it to the log handler
+// `format`: a printf-style format string, followed by its arguments
+void chip8_log(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Log a printf-style debug message. The arguments aren't evaluated at all unless a log handler
+// has been set, so logging costs a single branch when it's disabled.
+#define CHIP8_LOG(...) do { \
+    if (chip8_log_handler) { \
+      chip8_log(__VA_ARGS__); \
+    } \
+  } while (0)
+
+#endif
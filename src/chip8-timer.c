@@ -5,7 +5,14 @@ void precise_sleep(long ns) {
     // (SDL2 has ~10ms precision, while nanosleep has around us precision),
     // needs about ~1.3ms precision
     struct timespec sleep_val;
-    sleep_val.tv_sec = 0;
-    sleep_val.tv_nsec = ns; 
+    // tv_nsec has to stay below a second, or nanosleep fails straight away without sleeping
+    sleep_val.tv_sec = ns / 1000000000;
+    sleep_val.tv_nsec = ns % 1000000000;
     nanosleep(&sleep_val, &sleep_val); 
 }
+
+uint64_t current_time_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
@@ -20,7 +20,10 @@
 //
 // return 1 if the timer has been updated, 0 otherwise
 
-// Sleep for the given amount of microseconds
-void precise_sleep(long us);
+// Sleep for the given amount of nanoseconds, which can be a second or more
+void precise_sleep(long ns);
+
+// Get the current time of a monotonic clock in microseconds, for measuring how long things take
+uint64_t current_time_us();
 
 #endif
@@ -1,5 +1,7 @@
 #include "chip8.h"
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 
@@ -10,41 +12,34 @@ Chip8* chip8_init() {
   chip8->config.jump_quirk = 0;
   chip8->config.legacy_shift = 0;
   chip8->config.legacy_indexing = 0;
+  chip8->config.headless = 0;
+  chip8->config.unthrottled = 0;
+  chip8->config.cycle_limit = 0;
+  chip8->config.vip_timing = 0;
+  chip8->config.display_wait = 0;
+  chip8->config.instruction_frequency = 0;
+  chip8->exec_variant = NULL;
 
-  chip8->pc = PROGRAM_START;
-  chip8->I = 0;
-  chip8->sp = 0;
-  chip8->opcode = 0;
-  chip8->display_flag = 0;
-  chip8->sound_flag = 0;
-
-  // Initialize all addresses in memory to 0
-  for (int addr = 0; addr < ADDRESS_COUNT; addr++) {
-    chip8->memory[addr] = 0;
-  }
-  // Initialize all registers to 0
-  for (int reg = 0; reg < REGISTER_COUNT; reg++) {
-    chip8->V[reg] = 0;
-  }
-  // Initialize the stack elements to 0
-  for (int i = 0; i < STACK_SIZE; i++) {
-    chip8->stack[i] = 0;
-  }
-  // Initialize all keys to 0 (unpressed)
-  for (int key = 0; key < KEY_COUNT; key++) {
-    chip8->key[key] = 0;
-  }
+  chip8_reset(chip8);
 
-  // Initialize each pixel in the screen to 0
-  for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-    for (int x = 0; x < DISPLAY_WIDTH; x++) {
-      chip8->screen[y * DISPLAY_WIDTH + x] = 0;
-    }
-  }
+  return chip8;
+}
 
+void chip8_reset(Chip8 *const chip8) {
+  // everything except the config (and the interpreter chosen for it) starts out as 0,
+  // so clear the whole struct at once instead of going field by field
+  ConfigFlags config = chip8->config;
+  InstructionHandler exec_variant = chip8->exec_variant;
+  memset(chip8, 0, sizeof(Chip8));
+  chip8->config = config;
+  chip8->exec_variant = exec_variant;
+
+  chip8->pc = PROGRAM_START;
   load_font(chip8);
+}
 
-  return chip8;
+void chip8_seed(Chip8 *const chip8, uint32_t seed) {
+  chip8->rng = seed;
 }
 
 void chip8_destroy(Chip8 *chip8) {
@@ -54,9 +49,9 @@ void chip8_destroy(Chip8 *chip8) {
 int load_program(struct Chip8 *chip8, char *file) {
   // get the file descriptor of the program to load
   int fd = open(file, O_RDONLY);
-  
-  // NOTE - I saw something suggesting to use fopen
-  // but I think this should also work?
+  if (fd == -1) {
+    return -1;
+  }
 
   // read the program into the fist section of the chip8's memory,
   // going up to the end of memory
@@ -67,42 +62,42 @@ int load_program(struct Chip8 *chip8, char *file) {
   return count;
 }
 
+// each row is a bitmap describing each commented symbol
+// e.g. 0 will look like
+// "11111"
+// "10001"
+// "10001"
+// "10001"
+// "11111"
+// which draws the shape of a 0 (note the second hex digit is completely ignored and always 0)
+static const uint8_t FONT[FONT_HEIGHT * KEY_COUNT] = {
+  0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+  0x20, 0x60, 0x20, 0x20, 0x70, // 1
+  0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+  0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+  0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+  0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+  0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+  0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+  0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+  0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+  0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+  0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+  0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+  0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+  0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+  0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
 void load_font(struct Chip8 *chip8) {
-  // each row is a bitmap describing each commented symbol
-  // e.g. 0 will look like
-  // "11111"
-  // "10001"
-  // "10001"
-  // "10001"
-  // "11111"
-  // which draws the shape of a 0 (note the second hex digit is completely ignored and always 0)
-  char font[] = {
-    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-  };
-  int total_size = FONT_HEIGHT * KEY_COUNT;
-  
   // load the font into memory
-  for (int i = 0; i < total_size; ++i) {
-    chip8->memory[FONT_START + i] = font[i];
-  }
+  memcpy(chip8->memory + FONT_START, FONT, sizeof(FONT));
 }
 
 void chip8_decrement_timers(Chip8 *const chip8) {
+  chip8->ticks++;
+  chip8->frame_cycles = chip8->cycle_carry;
+  chip8->cycle_carry = 0;
   if (chip8->delay_timer > 0) {
     chip8->delay_timer--;
   }
@@ -112,8 +107,58 @@ void chip8_decrement_timers(Chip8 *const chip8) {
   }
 }
 
+// FNV-1a, see http://www.isthe.com/chongo/tech/comp/fnv/
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t fnv_update(uint64_t hash, const void *data, int size) {
+  const uint8_t *bytes = data;
+  for (int i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+void chip8_save_state(const Chip8 *const chip8, Chip8 *const snapshot) {
+  memcpy(snapshot, chip8, sizeof(Chip8));
+}
+
+void chip8_load_state(Chip8 *const chip8, const Chip8 *const snapshot) {
+  memcpy(chip8, snapshot, sizeof(Chip8));
+}
+
+uint64_t chip8_hash_state(const Chip8 *const chip8) {
+  uint64_t hash = FNV_OFFSET;
+  hash = fnv_update(hash, chip8->screen, sizeof(chip8->screen));
+  hash = fnv_update(hash, chip8->V, sizeof(chip8->V));
+  hash = fnv_update(hash, &chip8->I, sizeof(chip8->I));
+  hash = fnv_update(hash, &chip8->pc, sizeof(chip8->pc));
+  hash = fnv_update(hash, &chip8->sp, sizeof(chip8->sp));
+  hash = fnv_update(hash, chip8->stack, sizeof(chip8->stack));
+  hash = fnv_update(hash, &chip8->delay_timer, sizeof(chip8->delay_timer));
+  hash = fnv_update(hash, &chip8->sound_timer, sizeof(chip8->sound_timer));
+  return hash;
+}
+
+const char* chip8_fault_message(uint8_t fault) {
+  switch (fault) {
+    case FAULT_NONE:
+      return "no fault";
+    case FAULT_STACK_OVERFLOW:
+      return "stack overflow (too many nested calls)";
+    case FAULT_STACK_UNDERFLOW:
+      return "stack underflow (return without a call)";
+    case FAULT_BAD_PC:
+      return "program counter went past the end of memory";
+  }
+  return "unknown fault";
+}
+
 unsigned short fetch_instruction(struct Chip8 *const chip8) {
   if (chip8->pc + 1 >= ADDRESS_COUNT) {
+    chip8->fault = FAULT_BAD_PC;
+    // 0xFFFF decodes to an IO instruction that doesn't exist, so executing it does nothing
+    chip8->opcode = 0xF;
     return -1;
   }
   // update the opcode, which is the first 4 bits of the instruction and the next address in memory
@@ -1,12 +1,13 @@
 #ifndef CHIP8
 #define CHIP8
 
-#include <SDL2/SDL_mutex.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 // number of bytes of memory
 #define ADDRESS_COUNT 4096
+// addresses wrap around at the end of memory, like the 12-bit address bus of the original systems
+#define ADDRESS_MASK (ADDRESS_COUNT - 1)
 #define REGISTER_COUNT 16
 #define STACK_SIZE 16
 // number of times per second the timer will update
@@ -22,16 +23,39 @@
 #define PROGRAM_START 0x200
 #define FONT_START 0x050
 
+// Faults that stop a CHIP-8 program from continuing. The instruction which caused the fault
+// does nothing instead of corrupting the CHIP-8's state.
+#define FAULT_NONE 0
+#define FAULT_STACK_OVERFLOW 1 // a call was made with a full stack
+#define FAULT_STACK_UNDERFLOW 2 // a return was made with an empty stack
+#define FAULT_BAD_PC 3 // the program counter went past the end of memory
+// Not a fault: returned instead of one by `chip8_run_frame` and `compact_run_frame` once the
+// program has ended by running off the end of memory. Never stored in `Chip8.fault`.
+#define CHIP8_ENDED 0x100
+
 typedef struct ConfigFlags {
   int debug;
   int legacy_shift;
   int jump_quirk;
   int legacy_indexing;
+  int headless; // run without a window, sound or keyboard input
+  int unthrottled; // run as fast as possible, keeping time by instruction count instead of a clock
+  long cycle_limit; // stop after this many cycles, 0 to run until the program ends
+  int vip_timing; // time instructions by their cost on the COSMAC VIP instead of at a flat rate
+  int display_wait; // DXYN waits for the next 60 Hz display interrupt, like on the COSMAC VIP
+  long instruction_frequency; // instructions per second at the flat rate, 0 for the default
 } ConfigFlags;
 
+struct Chip8;
+
+// A function which executes a single, already fetched instruction on a CHIP-8 system
+typedef void (*InstructionHandler)(struct Chip8 *const chip8, uint16_t instruction);
+
 // Represents the state of a CHIP-8 process (Virtual CPU?) at any given point in time
 typedef struct Chip8 {
   ConfigFlags config;
+  // interpreter specialized for the quirks in `config`, chosen when the program starts
+  InstructionHandler exec_variant;
   uint8_t memory[ADDRESS_COUNT];
   uint8_t screen[DISPLAY_HEIGHT * DISPLAY_WIDTH];
   uint8_t V[REGISTER_COUNT]; // registers
@@ -41,15 +65,38 @@ typedef struct Chip8 {
   uint16_t sp; // stack pointer
   uint8_t delay_timer;
   uint8_t sound_timer;
+  uint64_t ticks; // number of times the timers have been updated (60 Hz frames)
+  // time spent since the timers were last updated, counted in instructions or in machine cycles
+  // with `config.vip_timing` (see `frame_budget`)
+  uint32_t frame_cycles;
+  // machine cycles of the instruction which was still running when the frame ended, which count
+  // towards the next frame instead (only used with `config.vip_timing`)
+  uint32_t cycle_carry;
   bool sound_flag;
   uint8_t opcode;
   uint8_t key[KEY_COUNT];
+  uint16_t keys_read; // bitmask of the keys the program has checked (EX9E, EXA1 and FX0A)
   bool display_flag;
+  uint8_t fault; // the first fault the program ran into, or FAULT_NONE
+  // state of the CHIP-8's own random number generator for CXNN, so the same state and input
+  // always give the same numbers (0 after a reset, see `chip8_seed`)
+  uint32_t rng;
 } Chip8;
 
 // set values in the CHIP-8 system to an initial beginning state
 Chip8* chip8_init();
 
+// Reset an existing CHIP-8 system to its initial state in place, keeping its config.
+// This clears memory, the screen, registers, timers and keys and reloads the font, so the
+// program has to be loaded again afterwards.
+// `chip8`: the CHIP-8 system to reset
+void chip8_reset(Chip8 *const chip8);
+
+// Seed a CHIP-8 system's random number generator, which otherwise starts from 0
+// `chip8`: the CHIP-8 system to seed
+// `seed`: the seed, e.g. the time to get different numbers every run
+void chip8_seed(Chip8 *const chip8, uint32_t seed);
+
 // free all memory taken up by a CHIP-8 system
 // `chip8`: the CHIP-8 system to free
 void chip8_destroy(Chip8* chip8);
@@ -58,7 +105,8 @@ void chip8_destroy(Chip8* chip8);
 // `chip8`: the CHIP-8 system to load the font into
 void load_font(Chip8 *const chip8);
 
-// Load the a program into memory from the given file, returning 0 if successful
+// Load a program into memory from the given file, returning the number of bytes loaded, or -1 if
+// the file couldn't be opened or read
 // `chip8`: the CHIP-8 system to load the program into
 // `file`: the file path of the binary program to load
 int load_program(Chip8 *const chip8, char *const file);
@@ -67,6 +115,26 @@ int load_program(Chip8 *const chip8, char *const file);
 // `chip8`: the CHIP-8 system whose timers should be decremented
 void chip8_decrement_timers(Chip8 *const chip8);
 
+// Get a description of a fault
+// `fault`: one of the FAULT_ constants
+const char* chip8_fault_message(uint8_t fault);
+
+// Save the whole state of a CHIP-8 system so it can be restored later with `chip8_load_state`.
+// A Chip8 doesn't point to any other memory, so this is a single copy with no allocation.
+// `chip8`: the CHIP-8 system to save
+// `snapshot`: out parameter for the saved state
+void chip8_save_state(const Chip8 *const chip8, Chip8 *const snapshot);
+
+// Restore a CHIP-8 system to a state saved by `chip8_save_state`
+// `chip8`: the CHIP-8 system to restore
+// `snapshot`: the saved state
+void chip8_load_state(Chip8 *const chip8, const Chip8 *const snapshot);
+
+// Compute a fast (non-cryptographic) 64-bit hash of the screen, registers, stack and timers,
+// which can be used to check whether two CHIP-8 systems are in the same state
+// `chip8`: the CHIP-8 system to hash
+uint64_t chip8_hash_state(const Chip8 *const chip8);
+
 // Get the next instruction and increment the program_counter by two.
 // Returns the next instruction.
 // `chip8`: the CHIP-8 system to fetch an instruction for
@@ -0,0 +1,387 @@
+#include "compact.h"
+#include "control.h"
+#include "quirks.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE 64
+#define PAGE_SHIFT 8 // log2(COMPACT_PAGE_SIZE)
+
+// Bits of `CompactHot.flags`
+#define COMPACT_SOUND 0x1 // see `Chip8.sound_flag`
+#define COMPACT_DISPLAY 0x2 // see `Chip8.display_flag`
+
+// Everything an instruction touches besides memory and the screen, in a single cache line
+typedef struct CompactHot {
+  uint8_t V[REGISTER_COUNT];
+  uint16_t stack[STACK_SIZE];
+  uint16_t I;
+  uint16_t pc;
+  uint16_t frame_cycles;
+  uint16_t keys; // bitmask of the keys held down (bit N = key N)
+  uint16_t keys_read;
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  uint8_t fault;
+  uint8_t flags; // COMPACT_ bits
+} CompactHot;
+
+_Static_assert(sizeof(CompactHot) <= CACHE_LINE, "the hot state has to fit in a cache line");
+
+// Every image and every version of an instance's own pages gets a generation no other one ever
+// has, so a runner can tell whether the pages it holds are still current even when an address
+// has been freed and reused since (see `CompactRunner.generations`)
+static uint64_t next_generation = 1;
+
+struct CompactImage {
+  uint8_t memory[ADDRESS_COUNT]; // the font and program every instance starts with
+  ConfigFlags config;
+  InstructionHandler handler;
+  long references; // the creator's, plus one for each instance
+  uint64_t generation;
+};
+
+struct CompactChip8 {
+  _Alignas(CACHE_LINE) CompactHot hot;
+  uint64_t screen[DISPLAY_HEIGHT]; // 1 bit per pixel, the most significant bit is the leftmost
+  const uint8_t *pages[COMPACT_PAGE_COUNT]; // into the image, or copies for this instance
+  uint16_t private_pages; // bitmask of the pages copied for this instance (bit N = page N)
+  uint32_t cycle_carry;
+  uint32_t rng;
+  uint64_t ticks;
+  CompactImage *image;
+  uint64_t generation; // changes whenever the contents of the pages copied for it are replaced
+};
+
+struct CompactRunner {
+  Chip8 chip8; // the instance currently running, expanded
+  const uint8_t *loaded[COMPACT_PAGE_COUNT]; // the page each part of `chip8.memory` was copied from
+  // the generation of the image or instance each page was copied from, since a page can be
+  // rewritten in place by `compact_write` or freed and allocated again for another instance
+  uint64_t generations[COMPACT_PAGE_COUNT];
+  uint64_t screen[DISPLAY_HEIGHT]; // `chip8.screen`, packed
+  uint64_t image; // the generation of the image `chip8`'s config came from, 0 for none yet
+};
+
+static uint64_t new_generation(void) {
+  return __atomic_fetch_add(&next_generation, 1, __ATOMIC_RELAXED);
+}
+
+static void release_image(CompactImage *image) {
+  if (__atomic_sub_fetch(&image->references, 1, __ATOMIC_ACQ_REL) == 0) {
+    free(image);
+  }
+}
+
+CompactImage* compact_image_create(const ConfigFlags *const config, const uint8_t *const program,
+    size_t size) {
+  Chip8 chip8 = { .config = *config };
+  if (size > ADDRESS_COUNT - PROGRAM_START || frame_budget(&chip8) > UINT16_MAX) {
+    return NULL;
+  }
+  CompactImage *image = aligned_alloc(CACHE_LINE,
+      (sizeof(CompactImage) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+  if (image == NULL) {
+    return NULL;
+  }
+  chip8_reset(&chip8);
+  memcpy(image->memory, chip8.memory, ADDRESS_COUNT);
+  memcpy(image->memory + PROGRAM_START, program, size);
+  image->config = *config;
+  image->handler = select_instruction_handler(config);
+  image->references = 1;
+  image->generation = new_generation();
+  return image;
+}
+
+void compact_image_release(CompactImage *image) {
+  release_image(image);
+}
+
+CompactChip8* compact_create(CompactImage *const image) {
+  CompactChip8 *compact = aligned_alloc(CACHE_LINE,
+      (sizeof(CompactChip8) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+  if (compact == NULL) {
+    return NULL;
+  }
+  memset(compact, 0, sizeof(CompactChip8));
+  compact->hot.pc = PROGRAM_START;
+  for (int page = 0; page < COMPACT_PAGE_COUNT; page++) {
+    compact->pages[page] = image->memory + page * COMPACT_PAGE_SIZE;
+  }
+  __atomic_add_fetch(&image->references, 1, __ATOMIC_RELAXED);
+  compact->image = image;
+  compact->generation = new_generation();
+  return compact;
+}
+
+void compact_destroy(CompactChip8 *compact) {
+  for (uint16_t pages = compact->private_pages; pages; pages &= pages - 1) {
+    free((void*)compact->pages[__builtin_ctz(pages)]);
+  }
+  release_image(compact->image);
+  free(compact);
+}
+
+// Multiplying 8 bits by this spreads them out into 8 bytes, and the other way around
+#define SPREAD_BITS 0x8040201008040201ULL
+#define LOW_BITS 0x0101010101010101ULL
+
+// Read 8 pixels of a screen, with the leftmost pixel in the lowest byte
+static uint64_t load_pixels(const uint8_t *const pixels) {
+  uint64_t bytes;
+  memcpy(&bytes, pixels, sizeof(bytes));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  bytes = __builtin_bswap64(bytes);
+#endif
+  return bytes;
+}
+
+// Write 8 pixels of a screen, with the leftmost pixel in the lowest byte
+static void store_pixels(uint8_t *const pixels, uint64_t bytes) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  bytes = __builtin_bswap64(bytes);
+#endif
+  memcpy(pixels, &bytes, sizeof(bytes));
+}
+
+// Pack a screen with a byte per pixel into a bit per pixel, 8 pixels at a time
+static void pack_screen(const uint8_t *const screen, uint64_t packed[DISPLAY_HEIGHT]) {
+  for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+    uint64_t row = 0;
+    for (int x = 0; x < DISPLAY_WIDTH; x += 8) {
+      uint64_t bytes = load_pixels(&screen[y * DISPLAY_WIDTH + x]);
+      // turn each byte which isn't 0 into a 1, by carrying the lower 7 bits into the highest
+      bytes = ((((bytes & LOW_BITS * 0x7F) + LOW_BITS * 0x7F) | bytes) >> 7) & LOW_BITS;
+      row = row << 8 | bytes * SPREAD_BITS >> 56;
+    }
+    packed[y] = row;
+  }
+}
+
+// Unpack a screen with a bit per pixel into a byte per pixel, 8 pixels at a time
+static void unpack_screen(const uint64_t packed[DISPLAY_HEIGHT], uint8_t *const screen) {
+  for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+    for (int x = 0; x < DISPLAY_WIDTH; x += 8) {
+      uint64_t bits = (packed[y] >> (DISPLAY_WIDTH - 8 - x)) & 0xFF;
+      store_pixels(&screen[y * DISPLAY_WIDTH + x], (bits * SPREAD_BITS >> 7) & LOW_BITS);
+    }
+  }
+}
+
+// Copy everything but memory and the screen out of an instance
+static void read_registers(const CompactChip8 *const compact, Chip8 *const chip8) {
+  const CompactHot *hot = &compact->hot;
+  memcpy(chip8->V, hot->V, sizeof(hot->V));
+  memcpy(chip8->stack, hot->stack, sizeof(hot->stack));
+  chip8->I = hot->I;
+  chip8->pc = hot->pc;
+  chip8->sp = hot->sp;
+  chip8->delay_timer = hot->delay_timer;
+  chip8->sound_timer = hot->sound_timer;
+  chip8->frame_cycles = hot->frame_cycles;
+  chip8->keys_read = hot->keys_read;
+  chip8->fault = hot->fault;
+  chip8->sound_flag = (hot->flags & COMPACT_SOUND) != 0;
+  chip8->display_flag = (hot->flags & COMPACT_DISPLAY) != 0;
+  for (int key = 0; key < KEY_COUNT; key++) {
+    chip8->key[key] = (hot->keys >> key) & 1;
+  }
+  chip8->ticks = compact->ticks;
+  chip8->cycle_carry = compact->cycle_carry;
+  chip8->rng = compact->rng;
+}
+
+// Copy everything but memory and the screen into an instance
+static void write_registers(CompactChip8 *const compact, const Chip8 *const chip8) {
+  CompactHot *hot = &compact->hot;
+  memcpy(hot->V, chip8->V, sizeof(hot->V));
+  memcpy(hot->stack, chip8->stack, sizeof(hot->stack));
+  hot->I = chip8->I;
+  hot->pc = chip8->pc;
+  hot->sp = chip8->sp;
+  hot->delay_timer = chip8->delay_timer;
+  hot->sound_timer = chip8->sound_timer;
+  hot->frame_cycles = chip8->frame_cycles;
+  hot->keys_read = chip8->keys_read;
+  hot->fault = chip8->fault;
+  hot->flags = (chip8->sound_flag ? COMPACT_SOUND : 0)
+    | (chip8->display_flag ? COMPACT_DISPLAY : 0);
+  hot->keys = 0;
+  for (int key = 0; key < KEY_COUNT; key++) {
+    hot->keys |= (chip8->key[key] != 0) << key;
+  }
+  compact->ticks = chip8->ticks;
+  compact->cycle_carry = chip8->cycle_carry;
+  compact->rng = chip8->rng;
+}
+
+// Replace the pages in `written` with copies holding the contents of `memory`, copying any
+// which are still shared first. Returns -1 without changing anything if a copy can't be allocated.
+static int write_pages(CompactChip8 *const compact, const uint8_t *const memory, uint16_t written) {
+  uint8_t *copies[COMPACT_PAGE_COUNT] = { NULL };
+  uint16_t shared = written & ~compact->private_pages;
+  for (uint16_t pages = shared; pages; pages &= pages - 1) {
+    int page = __builtin_ctz(pages);
+    copies[page] = aligned_alloc(CACHE_LINE, COMPACT_PAGE_SIZE);
+    if (copies[page] == NULL) {
+      for (int i = 0; i < COMPACT_PAGE_COUNT; i++) {
+        free(copies[i]);
+      }
+      return -1;
+    }
+  }
+  for (uint16_t pages = shared; pages; pages &= pages - 1) {
+    int page = __builtin_ctz(pages);
+    compact->pages[page] = copies[page];
+  }
+  compact->private_pages |= shared;
+  for (uint16_t pages = written; pages; pages &= pages - 1) {
+    int page = __builtin_ctz(pages);
+    memcpy((uint8_t*)compact->pages[page], memory + page * COMPACT_PAGE_SIZE, COMPACT_PAGE_SIZE);
+  }
+  return 0;
+}
+
+void compact_read(const CompactChip8 *const compact, Chip8 *const state) {
+  memset(state, 0, sizeof(Chip8));
+  state->config = compact->image->config;
+  state->exec_variant = compact->image->handler;
+  for (int page = 0; page < COMPACT_PAGE_COUNT; page++) {
+    memcpy(state->memory + page * COMPACT_PAGE_SIZE, compact->pages[page], COMPACT_PAGE_SIZE);
+  }
+  unpack_screen(compact->screen, state->screen);
+  read_registers(compact, state);
+}
+
+int compact_write(CompactChip8 *const compact, const Chip8 *const state) {
+  uint16_t written = 0;
+  for (int page = 0; page < COMPACT_PAGE_COUNT; page++) {
+    if (memcmp(compact->pages[page], state->memory + page * COMPACT_PAGE_SIZE,
+          COMPACT_PAGE_SIZE) != 0) {
+      written |= 1 << page;
+    }
+  }
+  if (write_pages(compact, state->memory, written) == -1) {
+    return -1;
+  }
+  // pages the instance already had were overwritten in place, which a runner can't see by their
+  // addresses alone
+  if (written & compact->private_pages) {
+    compact->generation = new_generation();
+  }
+  pack_screen(state->screen, compact->screen);
+  write_registers(compact, state);
+  return 0;
+}
+
+size_t compact_size(const CompactChip8 *const compact) {
+  return (sizeof(CompactChip8) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE
+    + __builtin_popcount(compact->private_pages) * COMPACT_PAGE_SIZE;
+}
+
+CompactRunner* compact_runner_create(void) {
+  // no pages have been loaded yet, and the blank screen matches its packed copy
+  return calloc(1, sizeof(CompactRunner));
+}
+
+void compact_runner_destroy(CompactRunner *runner) {
+  free(runner);
+}
+
+// Get the pages of memory an instruction is about to write to, as a bitmask (bit N = page N)
+static uint16_t written_pages(const Chip8 *const chip8, uint16_t instruction) {
+  if ((instruction >> 12) != OP_IO) {
+    return 0;
+  }
+  int count;
+  switch (instruction & OP_NN) {
+    case IO_BIN_DEC:
+      count = 3;
+      break;
+    case IO_SMEM:
+      count = ((instruction & OP_X) >> 8) + 1;
+      break;
+    default:
+      return 0;
+  }
+  // the writes are shorter than a page, so they can only cross into one more (which is the first
+  // page when they wrap around the end of memory)
+  uint16_t first = chip8->I & ADDRESS_MASK;
+  uint16_t last = (chip8->I + count - 1) & ADDRESS_MASK;
+  return 1 << (first >> PAGE_SHIFT) | 1 << (last >> PAGE_SHIFT);
+}
+
+int compact_run_frame(CompactRunner *const runner, CompactChip8 *const compact,
+    const uint8_t *const keys) {
+  Chip8 *chip8 = &runner->chip8;
+  if (runner->image != compact->image->generation) {
+    chip8->config = compact->image->config;
+    chip8->exec_variant = compact->image->handler;
+    runner->image = compact->image->generation;
+  }
+  // instances of the same program mostly share the pages the runner already holds
+  for (int page = 0; page < COMPACT_PAGE_COUNT; page++) {
+    uint64_t generation = compact->private_pages & 1 << page
+      ? compact->generation : compact->image->generation;
+    if (runner->loaded[page] != compact->pages[page] || runner->generations[page] != generation) {
+      memcpy(chip8->memory + page * COMPACT_PAGE_SIZE, compact->pages[page], COMPACT_PAGE_SIZE);
+      runner->loaded[page] = compact->pages[page];
+      runner->generations[page] = generation;
+    }
+  }
+  if (memcmp(runner->screen, compact->screen, sizeof(runner->screen)) != 0) {
+    memcpy(runner->screen, compact->screen, sizeof(runner->screen));
+    unpack_screen(runner->screen, chip8->screen);
+  }
+  read_registers(compact, chip8);
+  for (int key = 0; key < KEY_COUNT; key++) {
+    chip8->key[key] = keys && keys[key];
+  }
+
+  // the same as `exec_frame`, keeping track of what changed
+  long count = frame_budget(chip8);
+  uint16_t written = 0;
+  bool drawn = false;
+  while (chip8->frame_cycles < count && chip8->pc < ADDRESS_COUNT && !chip8->fault) {
+    uint16_t instruction = fetch_instruction(chip8);
+    written |= written_pages(chip8, instruction);
+    drawn |= (instruction >> 12) == OP_DISPLAY || instruction == OP_CLR_SCRN;
+    chip8->exec_variant(chip8, instruction);
+    account_instruction(chip8, instruction);
+  }
+  chip8_decrement_timers(chip8);
+  if (drawn) {
+    pack_screen(chip8->screen, runner->screen);
+  }
+
+  if (write_pages(compact, chip8->memory, written) == -1) {
+    // the runner's copy of these pages no longer matches any instance
+    for (uint16_t pages = written; pages; pages &= pages - 1) {
+      runner->loaded[__builtin_ctz(pages)] = NULL;
+    }
+    return -1;
+  }
+  for (uint16_t pages = written; pages; pages &= pages - 1) {
+    int page = __builtin_ctz(pages);
+    runner->loaded[page] = compact->pages[page];
+  }
+  // the same as in `compact_write`: other runners can still hold the pages overwritten in place.
+  // This runner holds every page of the instance, so all of them move on to the new generation.
+  if (written & compact->private_pages) {
+    compact->generation = new_generation();
+    for (uint16_t pages = compact->private_pages; pages; pages &= pages - 1) {
+      runner->generations[__builtin_ctz(pages)] = compact->generation;
+    }
+  }
+  if (drawn) {
+    memcpy(compact->screen, runner->screen, sizeof(runner->screen));
+  }
+  write_registers(compact, chip8);
+  if (chip8->fault == FAULT_NONE && chip8->pc >= ADDRESS_COUNT) {
+    return CHIP8_ENDED;
+  }
+  return chip8->fault;
+}
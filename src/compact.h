@@ -0,0 +1,93 @@
+#ifndef COMPACT
+#define COMPACT
+
+#include "chip8.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact CHIP-8 instances, for keeping tens of thousands of copies of the same program in
+// memory at once. A Chip8 holds all 4 KB of memory and a byte per pixel of the screen itself,
+// even though almost all of that memory is the font and the program, which every copy shares.
+//
+// A compact instance splits memory into 256-byte pages, which all start out pointing into a
+// shared image of the font and program. Pages are only copied for an instance the first time it
+// writes to them (with FX33 or FX55), so most instances never copy any. The screen is stored at a
+// bit per pixel, and everything an instruction touches besides memory (registers, the stack, I,
+// pc and the timers) fits in a single 64-byte cache line, with the rest kept after it.
+//
+// Instances run on a CompactRunner, which expands one into a regular Chip8 for a frame and packs
+// it back afterwards, so they end up in exactly the same state as a Chip8 running `exec_frame`.
+// Pages the runner already holds aren't copied again, so running many instances which share
+// their pages one after another mostly touches their hot state and screen.
+#define COMPACT_PAGE_SIZE 256
+#define COMPACT_PAGE_COUNT (ADDRESS_COUNT / COMPACT_PAGE_SIZE)
+
+// The font and program shared by a group of instances, along with the config they run with
+typedef struct CompactImage CompactImage;
+typedef struct CompactChip8 CompactChip8;
+typedef struct CompactRunner CompactRunner;
+
+// Create an image of a program for instances to share, returning NULL if the program doesn't
+// fit in memory or the config's frames are too long to count in 16 bits (over 65535
+// instructions or machine cycles).
+// NOTE: This function uses memory allocation. The image is freed once `compact_image_release`
+// has been called and every instance using it has been destroyed.
+//
+// `config`: the quirks and timing every instance of the program runs with
+// `program`: the program to load at PROGRAM_START
+// `size`: the size of the program in bytes
+CompactImage* compact_image_create(const ConfigFlags *const config, const uint8_t *const program,
+    size_t size);
+
+// Give up the reference to an image returned by `compact_image_create`
+// `image`: the image to release
+void compact_image_release(CompactImage *image);
+
+// Create an instance of an image's program in its initial state, returning NULL if it can't be
+// allocated. Each instance keeps its image alive until it is destroyed.
+// NOTE: This function uses memory allocation. It is expected that `compact_destroy` will be
+// called when the instance is no longer needed in order to free that memory.
+// `image`: the image to share
+CompactChip8* compact_create(CompactImage *const image);
+
+// Free an instance, along with any pages it copied
+// `compact`: the instance to free
+void compact_destroy(CompactChip8 *compact);
+
+// Copy the full state of an instance into a Chip8, e.g. to hash or display it
+// `compact`: the instance to read
+// `state`: out parameter for the state of the instance
+void compact_read(const CompactChip8 *const compact, Chip8 *const state);
+
+// Replace the state of an instance, returning -1 if a page couldn't be allocated. Pages which
+// differ from the ones the instance has are copied, and its config stays the image's.
+// `compact`: the instance to write
+// `state`: the new state of the instance
+int compact_write(CompactChip8 *const compact, const Chip8 *const state);
+
+// Get the number of bytes of memory used by an instance itself, counting the pages it copied but
+// not its image
+// `compact`: the instance to measure
+size_t compact_size(const CompactChip8 *const compact);
+
+// Create a runner, which holds the full Chip8 instances are expanded into while they run. Each
+// thread running instances needs its own.
+// NOTE: This function uses memory allocation. It is expected that `compact_runner_destroy` will
+// be called when the runner is no longer needed in order to free that memory.
+CompactRunner* compact_runner_create(void);
+
+// Free a runner
+// `runner`: the runner to free
+void compact_runner_destroy(CompactRunner *runner);
+
+// Run a single 60 Hz frame of an instance, the same as `chip8_run_frame`. Returns the instance's
+// fault, CHIP8_ENDED if it ran off the end of memory without one, FAULT_NONE if it is still
+// running normally, or -1 if a page it wrote to couldn't be copied, which leaves the instance as
+// it was before the frame.
+// `runner`: the runner to run the instance on
+// `compact`: the instance to run
+// `keys`: KEY_COUNT key states (non-zero for pressed), or NULL if no keys are pressed
+int compact_run_frame(CompactRunner *const runner, CompactChip8 *const compact,
+    const uint8_t *const keys);
+
+#endif
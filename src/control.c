@@ -1,46 +1,44 @@
 #include "control.h"
-#include "chip8-timer.h"
+#include "chip8-log.h"
 #include "chip8.h"
-#include "stdio.h"
-#include "view.h"
-#include <SDL2/SDL_events.h>
-#include <SDL2/SDL_log.h>
-#include <SDL2/SDL_scancode.h>
-#include <SDL2/SDL_timer.h>
-#include <time.h>
+#include "quirks.h"
+#include <stdlib.h>
 
-const int CATEGORY = SDL_LOG_CATEGORY_APPLICATION;
+// The `*_quirks` functions below are the actual implementation of each instruction. They take the
+// enabled quirks as a bitmask (see quirks.h) and are always inlined, so every variant generated
+// at the bottom of this file gets its own copy where each quirk check is a compile-time constant.
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
 
-void exec_alu(Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
+ALWAYS_INLINE void exec_alu_quirks(Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n,
+    const unsigned quirks) {
   short result;
-  char* log_msg = NULL;
   switch (n) {
     case ALU_SET:
-      SDL_LogDebug(CATEGORY, "V[%d] (%d) = V[%d] (%d)", x, chip8->V[x], y, chip8->V[y]);
+      CHIP8_LOG("V[%d] (%d) = V[%d] (%d)", x, chip8->V[x], y, chip8->V[y]);
       chip8->V[x] = chip8->V[y];
       break;
 
     case ALU_OR:
-      SDL_LogDebug(CATEGORY, "V[%d] = %d | %d = %d", 
+      CHIP8_LOG("V[%d] = %d | %d = %d", 
           x, chip8->V[x], chip8->V[y], chip8->V[x] | chip8->V[y]);
       chip8->V[x] = chip8->V[x] | chip8->V[y];
       break;
 
     case ALU_AND:
-      SDL_LogDebug(CATEGORY, "V[%d] = %d & %d = %d", 
+      CHIP8_LOG("V[%d] = %d & %d = %d", 
           x, chip8->V[x], chip8->V[y], chip8->V[x] & chip8->V[y]);
       chip8->V[x] = chip8->V[x] & chip8->V[y];
       break;
 
     case ALU_XOR:
-      SDL_LogDebug(CATEGORY, "V[%d] = %d ^ %d = %d", 
+      CHIP8_LOG("V[%d] = %d ^ %d = %d", 
           x, chip8->V[x], chip8->V[y], chip8->V[x] ^ chip8->V[y]);
       chip8->V[x] = chip8->V[x] ^ chip8->V[y];
       break;
 
     case ALU_ADD:
       result = chip8->V[x] + chip8->V[y];
-      SDL_LogDebug(CATEGORY, "V[%d] = %d + %d = %d, ovf = %d", 
+      CHIP8_LOG("V[%d] = %d + %d = %d, ovf = %d", 
           x, chip8->V[x], chip8->V[y], (uint8_t)result, result > 255);
       chip8->V[x] = (uint8_t)result;
       chip8->V[0xF] = result > 255;
@@ -49,7 +47,7 @@ void exec_alu(Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
     // SUB (VX - VY)
     case ALU_SUBY:
       result = chip8->V[x] - chip8->V[y];
-      SDL_LogDebug(CATEGORY, "V[%d] = %d - %d = %d, ovf = %d", 
+      CHIP8_LOG("V[%d] = %d - %d = %d, ovf = %d", 
           x, chip8->V[x], chip8->V[y], (uint8_t)result, (uint8_t)result > chip8->V[x]); 
       // The overflow flag for subtraction is actually the opposite of what you expect
       chip8->V[0xF] = chip8->V[y] <= chip8->V[x];
@@ -57,10 +55,10 @@ void exec_alu(Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
       break;
 
     case ALU_SRL:
-      if (chip8->config.legacy_shift) {
+      if (quirks & QUIRK_LEGACY_SHIFT) {
         chip8->V[x] = chip8->V[y];
       }
-      SDL_LogDebug(CATEGORY, "V[%d] = %d >> 1, ovf = %d", x, chip8->V[x], chip8->V[x] & 1);
+      CHIP8_LOG("V[%d] = %d >> 1, ovf = %d", x, chip8->V[x], chip8->V[x] & 1);
       // shift VX right by 1, storing the shifted bit into VF
       chip8->V[0xF] = chip8->V[x] & 1; // isolate the last bit
       chip8->V[x] = chip8->V[x] >> 1;
@@ -69,7 +67,7 @@ void exec_alu(Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
     // SUB (VY - VX)
     case ALU_SUBX:
       result = chip8->V[y] - chip8->V[x];
-      SDL_LogDebug(CATEGORY, "V[%d] = %d - %d = %d, ovf = %d", 
+      CHIP8_LOG("V[%d] = %d - %d = %d, ovf = %d", 
           x, chip8->V[y], chip8->V[x], (uint8_t)result, result > 255);
       // The overflow flag for subtraction is actually the opposite of what you expect
       chip8->V[0xF] = chip8->V[x] <= chip8->V[y];
@@ -77,11 +75,11 @@ void exec_alu(Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
       break;
 
     case ALU_SLL:
-      if (chip8->config.legacy_shift) {
+      if (quirks & QUIRK_LEGACY_SHIFT) {
         chip8->V[x] = chip8->V[y];
       }
 
-      SDL_LogDebug(CATEGORY, "V[%d] = %d << 1 = %d, ovf = %d",
+      CHIP8_LOG("V[%d] = %d << 1 = %d, ovf = %d",
           x, chip8->V[x], (uint8_t)(chip8->V[x] << 1), (chip8->V[x] & 0x80) != 0);
       // shift VX left by 1, storing the shifted bit into VF
       chip8->V[0xF] = (chip8->V[x] & 0x80) != 0; // isolate the first bit
@@ -97,7 +95,7 @@ void exec_display(struct Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
   chip8->V[0xF] = 0; // reset flag register
 
   for (int row = 0; row < n && y_pos + row < DISPLAY_HEIGHT; row++) {
-    uint8_t draw_byte = chip8->memory[chip8->I + row];
+    uint8_t draw_byte = chip8->memory[(chip8->I + row) & ADDRESS_MASK];
     // 8 is hardcoded because bytes are used, so at most 8 pixels can be set.
     uint8_t target_bit =  0x80;
     for (int col = 0; col < 8 && x_pos + col < DISPLAY_WIDTH; col++) {
@@ -105,13 +103,13 @@ void exec_display(struct Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
       uint8_t flip_bit = (draw_byte & target_bit);
 
       // If a bit gets turned off by the draw byte, the flag register gets set to 1
-      chip8->V[0xF] = chip8->V[0xF] || (flip_bit) && *pixel;
+      chip8->V[0xF] = chip8->V[0xF] || (flip_bit && *pixel);
       *pixel = flip_bit ? !*pixel : *pixel; 
       target_bit = target_bit >> 1;
     }
   }
 
-  SDL_LogDebug(CATEGORY, 
+  CHIP8_LOG(
       "Display called: V[%d] = %d, V[%d] = %d, n = %d, V[0xF] = %d after instruction",
       x, chip8->V[x], y, chip8->V[y], n, chip8->V[0xF]);
 }
@@ -120,6 +118,7 @@ void exec_display(struct Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
 // to the first pressed key. NOTE - idk if this is a correct implementation?
 char get_pressed_key(struct Chip8 *const chip8, char* key) {
   char found = 0;
+  chip8->keys_read = 0xFFFF;
   for (uint8_t curr_key = 0; curr_key < KEY_COUNT; curr_key++) {
     if (chip8->key[curr_key]) {
       found = 1;
@@ -130,26 +129,27 @@ char get_pressed_key(struct Chip8 *const chip8, char* key) {
   return found;
 }
 
-void exec_io(struct Chip8 *const chip8, uint8_t x, uint8_t nn) {
+ALWAYS_INLINE void exec_io_quirks(struct Chip8 *const chip8, uint8_t x, uint8_t nn,
+    const unsigned quirks) {
   char result;
   switch (nn) {
     case IO_LDTIME:
-      SDL_LogDebug(CATEGORY, "set register %d to timer value %d", x, chip8->delay_timer);
+      CHIP8_LOG("set register %d to timer value %d", x, chip8->delay_timer);
       chip8->V[x] = chip8->delay_timer;
       break;
 
     case IO_SDTIME:
-      SDL_LogDebug(CATEGORY, "set delay timer to value V[%d]: %d", x, chip8->V[x]);
+      CHIP8_LOG("set delay timer to value V[%d]: %d", x, chip8->V[x]);
       chip8->delay_timer = chip8->V[x];
       break;
     
     case IO_SSTIME:
-      SDL_LogDebug(CATEGORY, "set sound timer to value V[%d]: %d", x, chip8->V[x]);
+      CHIP8_LOG("set sound timer to value V[%d]: %d", x, chip8->V[x]);
       chip8->sound_timer = chip8->V[x];
       break;
     
     case IO_ADD_IDX:
-      SDL_LogDebug(CATEGORY, "I changed from %d - added %d, resulting in %d",
+      CHIP8_LOG("I changed from %d - added %d, resulting in %d",
           chip8->I, chip8->V[x], (chip8->I + chip8->V[x]) & 0x0FFF);
       chip8->I += chip8->V[x];
       // I should only take up 12 bits, anything else is treated as an overflow
@@ -159,10 +159,10 @@ void exec_io(struct Chip8 *const chip8, uint8_t x, uint8_t nn) {
 
     case IO_GET_KEY:
       if (!get_pressed_key(chip8, &result)) {
-        SDL_LogDebug(CATEGORY, "no input pressed, instruction pointer decremented");
-        chip8->sp -= 2;
+        CHIP8_LOG("no input pressed, instruction pointer decremented");
+        chip8->pc -= 2;
       } else {
-        SDL_LogDebug(CATEGORY, "received pressed key %x", result);
+        CHIP8_LOG("received pressed key %x", result);
         // technically converts from char to uint8, but the keys go
         // from 0-16 so this isn't really an issue
         chip8->V[x] = result;
@@ -171,53 +171,60 @@ void exec_io(struct Chip8 *const chip8, uint8_t x, uint8_t nn) {
 
     case IO_CHAR:
       // calculate font location of the specific character X in memory
-      SDL_LogDebug(CATEGORY, "Changing index from %d to %d based on font character %x",
+      CHIP8_LOG("Changing index from %d to %d based on font character %x",
           chip8->I, FONT_START + chip8->V[x] * FONT_HEIGHT, chip8->V[x]);
       chip8->I = FONT_START + chip8->V[x] * FONT_HEIGHT; 
       break;
 
     case IO_BIN_DEC:
-      SDL_LogDebug(CATEGORY, "Setting memory locations %d, %d, %d to %d, %d, %d based on number %d",
+      CHIP8_LOG("Setting memory locations %d, %d, %d to %d, %d, %d based on number %d",
           chip8->I, chip8->I + 1, chip8->I + 2, 
           chip8->V[x] / 100, (chip8->V[x] / 10) % 10, chip8->V[x] % 10, chip8->V[x]);
 
       // extract 3 decimal digits from a number and store them in memory
-      chip8->memory[chip8->I] = chip8->V[x] / 100; // hundreds place
-      chip8->memory[chip8->I + 1] = (chip8->V[x] / 10) % 10; // tens place
-      chip8->memory[chip8->I + 2] = chip8->V[x] % 10; // ones place
+      chip8->memory[chip8->I & ADDRESS_MASK] = chip8->V[x] / 100; // hundreds place
+      chip8->memory[(chip8->I + 1) & ADDRESS_MASK] = (chip8->V[x] / 10) % 10; // tens place
+      chip8->memory[(chip8->I + 2) & ADDRESS_MASK] = chip8->V[x] % 10; // ones place
       break;
 
     case IO_SMEM:
       // Load all registers up to VX into memory starting at I
       for (int i = 0; i <= x; i++) {
-        SDL_LogDebug(CATEGORY, "Filling memory location %d with value V[%d]: %d",
+        CHIP8_LOG("Filling memory location %d with value V[%d]: %d",
             chip8->I + i, i, chip8->V[i]);
 
-        chip8->memory[chip8->I + i] = chip8->V[i];
+        chip8->memory[(chip8->I + i) & ADDRESS_MASK] = chip8->V[i];
       }
 
       // On the original CHIP-8 systems, I gets incremented for each value it loads in
-      if (chip8->config.legacy_indexing) {
+      if (quirks & QUIRK_LEGACY_INDEXING) {
         chip8->I += x;
-        SDL_LogDebug(CATEGORY, 
+        CHIP8_LOG(
             "legacy indexing flag present, incrementing index by %d (new val = %d)", x, chip8->I);
       }
       break;
 
     case IO_LMEM:
       for (int i = 0; i <= x; i++) {
-        SDL_LogDebug(CATEGORY, "Loading register V[%d] from memory location %d with value %d",
-            i, chip8->I + i, chip8->memory[chip8->I + i]);
-        chip8->V[i] = chip8->memory[chip8->I + i];
+        CHIP8_LOG("Loading register V[%d] from memory location %d with value %d",
+            i, chip8->I + i, chip8->memory[(chip8->I + i) & ADDRESS_MASK]);
+        chip8->V[i] = chip8->memory[(chip8->I + i) & ADDRESS_MASK];
       }
       break;
   }
 }
 
+// Get the next random byte from a CHIP-8's own generator, a 32-bit linear congruential generator
+// (the constants from Numerical Recipes). Its low bits repeat quickly, so the highest byte is used.
+static uint8_t next_random(Chip8 *const chip8) {
+  chip8->rng = chip8->rng * 1664525u + 1013904223u;
+  return chip8->rng >> 24;
+}
+
 // Reset all pixels on a CHIP-8's screen to be blank
 void clear_screen(struct Chip8 *const chip8) {
   
-  SDL_LogDebug(CATEGORY, "clearing screen");
+  CHIP8_LOG("clearing screen");
 
   for (int y = 0; y < DISPLAY_HEIGHT; y++) {
     for (int x = 0; x < DISPLAY_WIDTH; x++) {
@@ -226,7 +233,8 @@ void clear_screen(struct Chip8 *const chip8) {
   }
 }
 
-void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
+ALWAYS_INLINE void exec_instruction_quirks(Chip8 *const chip8, uint16_t instruction,
+    const unsigned quirks) {
   // OP (4 bits), x (4 bits), y (4 bits), n (4 bits)
   uint16_t nnn = instruction & OP_NNN;
   uint8_t nn = instruction & OP_NN;
@@ -236,6 +244,7 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
   chip8->display_flag = 0;
   char* branch_msg;
   char* ext_msg;
+  uint8_t pressed;
 
   switch (chip8->opcode) {
     case OP_SYS:
@@ -243,8 +252,13 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
         chip8->display_flag = 1;
         clear_screen(chip8);
       } else if (instruction == OP_RET) {
+        if (chip8->sp == 0) {
+          CHIP8_LOG("Return reached with an empty stack, ignoring it");
+          chip8->fault = FAULT_STACK_UNDERFLOW;
+          break;
+        }
         // NOTE - I don't think it's necessary to overwrite the stack value?
-        SDL_LogDebug(CATEGORY, "Return reached, setting pc to %d and decrementing sp to %d", 
+        CHIP8_LOG("Return reached, setting pc to %d and decrementing sp to %d", 
             chip8->stack[chip8->sp], chip8->sp - 1);
 
         chip8->pc = chip8->stack[chip8->sp];
@@ -253,12 +267,18 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
       break;
 
     case OP_JUMP:
-      SDL_LogDebug(CATEGORY, "Jump reached, setting pc to %d", nnn);
+      CHIP8_LOG("Jump reached, setting pc to %d", nnn);
       chip8->pc = nnn; 
       break;
 
     case OP_CALL:
-      SDL_LogDebug(CATEGORY, "Call reached, adding pc (%d) to the stack and setting pc to %d",
+      // stack[0] is never used, so the stack is full once sp reaches the last element
+      if (chip8->sp >= STACK_SIZE - 1) {
+        CHIP8_LOG("Call reached with a full stack, ignoring it");
+        chip8->fault = FAULT_STACK_OVERFLOW;
+        break;
+      }
+      CHIP8_LOG("Call reached, adding pc (%d) to the stack and setting pc to %d",
           chip8->pc, nnn);
       chip8->sp++;
       chip8->stack[chip8->sp] = chip8->pc;
@@ -273,7 +293,7 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
         chip8->pc += 2;
       }
       
-      SDL_LogDebug(CATEGORY, "BEQI - Comparing %d with %d: %s, pc: %d",
+      CHIP8_LOG("BEQI - Comparing %d with %d: %s, pc: %d",
           chip8->V[x], nn, branch_msg, chip8->pc);
       break;
 
@@ -284,7 +304,7 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
         branch_msg = "sides not equal, branching";
         chip8->pc += 2;
       }
-      SDL_LogDebug(CATEGORY, "BNEI - Comparing %d with %d: %s, pc: %d",
+      CHIP8_LOG("BNEI - Comparing %d with %d: %s, pc: %d",
           chip8->V[x], nn, branch_msg, chip8->pc);
       break;
     
@@ -295,7 +315,7 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
         branch_msg = "sides equal, branching";
         chip8->pc += 2;
       }
-      SDL_LogDebug(CATEGORY, "BEQ - Comparing %d with %d: %s, pc: %d",
+      CHIP8_LOG("BEQ - Comparing %d with %d: %s, pc: %d",
           chip8->V[x], chip8->V[y], branch_msg, chip8->pc);
       break;
     
@@ -306,37 +326,37 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
         branch_msg = "sides not equal, branching";
         chip8->pc += 2;
       }
-      SDL_LogDebug(CATEGORY, "BNE - Comparing %d with %d: %s, pc: %d",
+      CHIP8_LOG("BNE - Comparing %d with %d: %s, pc: %d",
           chip8->V[x], chip8->V[y], branch_msg, chip8->pc);
       break;
     
     case OP_LI:
-      SDL_LogDebug(CATEGORY, "LI - Setting V[%d] to immediate value %d", x, nn);
+      CHIP8_LOG("LI - Setting V[%d] to immediate value %d", x, nn);
       chip8->V[x] = nn;
       break;
     
     case OP_ADDI:
-      SDL_LogDebug(CATEGORY, "ADDI - V[%d] = %d + %d (%d)", x, chip8->V[x], nn, chip8->V[x] + nn);
+      CHIP8_LOG("ADDI - V[%d] = %d + %d (%d)", x, chip8->V[x], nn, chip8->V[x] + nn);
       chip8->V[x] += nn; 
       break;
 
     case OP_ALU:
-      exec_alu(chip8, x, y, n);
+      exec_alu_quirks(chip8, x, y, n, quirks);
       break;
 
     case OP_SET_IDX:
-      SDL_LogDebug(CATEGORY, "setting I register (%d) to %d", chip8->I, nnn);
+      CHIP8_LOG("setting I register (%d) to %d", chip8->I, nnn);
       chip8->I = nnn;
       break;
 
     case OP_JO:
       // A side effect introduced in CHIP-48 and SUPER-CHIP systems that was likely a bug
-      if (chip8->config.jump_quirk) {
-        SDL_LogDebug(CATEGORY, "Jump w/ Offset (w/ quirk) - setting pc to %d + V[%d] (%d) = %d",
+      if (quirks & QUIRK_JUMP) {
+        CHIP8_LOG("Jump w/ Offset (w/ quirk) - setting pc to %d + V[%d] (%d) = %d",
             nnn, x, chip8->V[x], nnn + chip8->V[x]);
         chip8->pc = nnn + chip8->V[x];
       } else {
-        SDL_LogDebug(CATEGORY, "Jump w/ Offset - setting pc to %d + %d (%d)",
+        CHIP8_LOG("Jump w/ Offset - setting pc to %d + %d (%d)",
             nnn, chip8->V[0], nnn + chip8->V[0]);
         chip8->pc = nnn + chip8->V[0];
       }
@@ -346,8 +366,8 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
       
       // generate a random number, do a binary AND with NN, and load it into VX
       // NOTE - this is bad but I don't want to make a new variable
-      n = rand();
-      SDL_LogDebug(CATEGORY, "RAND - setting V[%d] to %d (rand) & %d", x, n, nn);
+      n = next_random(chip8);
+      CHIP8_LOG("RAND - setting V[%d] to %d (rand) & %d", x, n, nn);
       chip8->V[x]= nn & n;
       break;
     
@@ -359,7 +379,10 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
     case OP_BKEY:
       branch_msg = "condition not met, not branching";
       // Skip 1 instruction if either "skip if pressed" or "skip if not pressed" are being used
-      if ((nn == BK_P && chip8->key[chip8->V[x]]) || (nn == BK_NP && !chip8->key[chip8->V[x]])) {
+      // only the lowest 4 bits of VX are used, since there are only 16 keys
+      pressed = chip8->key[chip8->V[x] & 0xF];
+      chip8->keys_read |= 1 << (chip8->V[x] & 0xF);
+      if ((nn == BK_P && pressed) || (nn == BK_NP && !pressed)) {
         branch_msg = "condition met, branching";
         chip8->pc += 2;
       }
@@ -370,88 +393,153 @@ void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
       } else {
         ext_msg = "Bad instruction";
       }
-      SDL_LogDebug(CATEGORY, "%s - Checking if key %x is pressed: %s, pc: %d",
+      CHIP8_LOG("%s - Checking if key %x is pressed: %s, pc: %d",
           ext_msg, chip8->V[x], branch_msg, chip8->pc);
       break;
     
     case OP_IO:
-      exec_io(chip8, x, nn);
+      exec_io_quirks(chip8, x, nn, quirks);
       break;
   }
 
 }
 
-int exec_cycle(Chip8 *const chip8, struct View *const view) {
-  // reset the play_sound flag
-
-  // NOTE - get_input technically doesn't error here, but if a quit signal is pressed
-  // then the program should stop running
-  int error = view_get_input(chip8->key, KEY_COUNT);
-  if (error) {
-    return error;
+// Define one specialized `exec_instruction_vXXX` function per quirk combination,
+// where XXX is the quirk mask written out in binary
+#define DEFINE_VARIANT(id, mask) \
+  static void exec_instruction_##id(Chip8 *const chip8, uint16_t instruction) { \
+    exec_instruction_quirks(chip8, instruction, mask); \
   }
+FOR_EACH_VARIANT(DEFINE_VARIANT)
+#undef DEFINE_VARIANT
+
+// Lookup table from a quirk mask to the variant specialized for it
+#define VARIANT_ENTRY(id, mask) [mask] = exec_instruction_##id,
+static const InstructionHandler VARIANTS[VARIANT_COUNT] = {
+  FOR_EACH_VARIANT(VARIANT_ENTRY)
+};
+#undef VARIANT_ENTRY
+
+unsigned quirk_mask(const ConfigFlags *const config) {
+  unsigned mask = 0;
+#define QUIRK_BIT(field, bit) mask |= config->field ? bit : 0;
+  QUIRK_LIST(QUIRK_BIT)
+#undef QUIRK_BIT
+  return mask;
+}
 
-  uint16_t instruction = fetch_instruction(chip8);
-  SDL_LogDebug(CATEGORY, "fetched instruction %04x at address %d", instruction, chip8->pc - 2);
+InstructionHandler select_instruction_handler(const ConfigFlags *const config) {
+  return VARIANTS[quirk_mask(config)];
+}
 
-  exec_instruction(chip8, instruction);
-  
-  if (chip8->display_flag) {
-    view_draw(view, chip8->screen);
-  }
+void exec_alu(Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n) {
+  exec_alu_quirks(chip8, x, y, n, quirk_mask(&chip8->config));
+}
 
-  view_set_sound(view, chip8->sound_flag);
+void exec_io(Chip8 *const chip8, uint8_t x, uint8_t nn) {
+  exec_io_quirks(chip8, x, nn, quirk_mask(&chip8->config));
+}
 
-  return 0;
+void exec_instruction(Chip8 *const chip8, uint16_t instruction) {
+  select_instruction_handler(&chip8->config)(chip8, instruction);
 }
 
-int exec_program(Chip8 *const chip8, struct View *const view) {
-  // Timers decrement every second, and the sound timer will update the chip8's
-  // sound flag to indicate when a sound should be played
-  uint64_t last_time = SDL_GetTicks64();
-  int manual = 1; // flag for manually stepping through instructions in debug mode
-  
-  while (chip8->pc < ADDRESS_COUNT) {
-    uint64_t current_time = SDL_GetTicks64();
-    if (current_time > last_time + (int)(1.0 / TIMER_FREQUENCY * 1000)) {
-      chip8_decrement_timers(chip8);
-      last_time = current_time;
-    }
+long instruction_frequency(const ConfigFlags *const config) {
+  return config->instruction_frequency > 0 ? config->instruction_frequency : INSTRUCTION_FREQUENCY;
+}
 
-    int result = exec_cycle(chip8, view);
-    if (result) {
-      return result;
-    }
-    // calculate the timing to sleep in nanoseconds and wait that long
-    // before running the next instruction
-    precise_sleep((long)(1.0 / INSTRUCTION_FREQUENCY * 1000000000));
-
-    // additional debug step for manually stepping through instructions
-    if (chip8->config.debug) {
-      int key_count;
-      SDL_PumpEvents();
-      const uint8_t* keystate = SDL_GetKeyboardState(&key_count);
-      bool paused = true;
-      while (paused) {
-        SDL_PumpEvents();
-        if (keystate[SDL_SCANCODE_RETURN]) {
-          manual = !manual;
-          SDL_Delay(200);
-          break;
-        }
-        if (!manual) {
-          break;
-        }
-        view_set_sound(view, 0);
-        paused = !keystate[SDL_SCANCODE_N] && manual;
-      }
-      view_set_sound(view, chip8->sound_flag);
-      if (manual) {
-        SDL_Delay(250);
+long frame_instructions(uint64_t tick, long frequency) {
+  return (tick + 1) * frequency / TIMER_FREQUENCY - tick * frequency / TIMER_FREQUENCY;
+}
+
+long frame_budget(const Chip8 *const chip8) {
+  return chip8->config.vip_timing ? VIP_FRAME_BUDGET
+    : frame_instructions(chip8->ticks, instruction_frequency(&chip8->config));
+}
+
+// machine cycles of each group of instructions on the COSMAC VIP, for the groups where every
+// instruction costs the same
+static const uint16_t VIP_CYCLES[16] = {
+  [OP_SYS] = 23, [OP_JUMP] = 23, [OP_CALL] = 23, [OP_BEQI] = 12, [OP_BNEI] = 12, [OP_BEQ] = 16,
+  [OP_LI] = 6, [OP_ADDI] = 10, [OP_ALU] = 44, [OP_BNE] = 16, [OP_SET_IDX] = 12, [OP_JO] = 23,
+  [OP_RAND] = 36, [OP_DISPLAY] = VIP_DRAW_SETUP_CYCLES, [OP_BKEY] = 16, [OP_IO] = 10,
+};
+
+uint32_t vip_instruction_cycles(uint16_t instruction) {
+  uint8_t x = (instruction & OP_X) >> 8;
+  switch (instruction >> 12) {
+    case OP_SYS:
+      return instruction == OP_CLR_SCRN ? 24 : VIP_CYCLES[OP_SYS];
+    case OP_DISPLAY:
+      return VIP_DRAW_SETUP_CYCLES + VIP_DRAW_ROW_CYCLES * (instruction & OP_N);
+    case OP_IO:
+      switch (instruction & OP_NN) {
+        case IO_ADD_IDX:
+          return 19;
+        case IO_CHAR:
+          return 20;
+        case IO_BIN_DEC:
+          return 204;
+        case IO_SMEM:
+        case IO_LMEM:
+          return 14 + 14 * (x + 1);
       }
-    }
+      break;
   }
+  return VIP_CYCLES[instruction >> 12];
+}
 
-  return 0;
+void account_instruction(Chip8 *const chip8, uint16_t instruction) {
+  bool wait = chip8->config.display_wait && (instruction >> 12) == OP_DISPLAY;
+  uint32_t budget = frame_budget(chip8);
+  if (!chip8->config.vip_timing) {
+    chip8->frame_cycles = wait ? budget : chip8->frame_cycles + 1;
+    return;
+  }
+
+  uint32_t cycles = vip_instruction_cycles(instruction);
+  if (wait) {
+    // the sprite only gets drawn once the display interrupt is over, in the next frame
+    chip8->cycle_carry += cycles - VIP_DRAW_SETUP_CYCLES;
+    chip8->frame_cycles = budget;
+    return;
+  }
+  chip8->frame_cycles += cycles;
+  if (chip8->frame_cycles > budget) {
+    // the interrupt arrived in the middle of the instruction, which finishes after it
+    chip8->cycle_carry += chip8->frame_cycles - budget;
+    chip8->frame_cycles = budget;
+  }
+}
+
+void exec_frame(Chip8 *const chip8) {
+  long count = frame_budget(chip8);
+  if (chip8->config.vip_timing || chip8->config.display_wait) {
+    while (chip8->frame_cycles < count && chip8->pc < ADDRESS_COUNT && !chip8->fault) {
+      uint16_t instruction = fetch_instruction(chip8);
+      chip8->exec_variant(chip8, instruction);
+      account_instruction(chip8, instruction);
+    }
+  } else {
+    for (; chip8->frame_cycles < count && chip8->pc < ADDRESS_COUNT && !chip8->fault;
+        chip8->frame_cycles++) {
+      uint16_t instruction = fetch_instruction(chip8);
+      chip8->exec_variant(chip8, instruction);
+    }
+  }
+  chip8_decrement_timers(chip8);
 }
 
+long exec_instructions(Chip8 *const chip8, long count) {
+  long executed = 0;
+  for (; executed < count && chip8->pc < ADDRESS_COUNT && !chip8->fault; executed++) {
+    // the timers update once the previous frame's instructions have all run
+    if (chip8->frame_cycles >= frame_budget(chip8)) {
+      chip8_decrement_timers(chip8);
+    }
+    uint16_t instruction = fetch_instruction(chip8);
+    chip8->exec_variant(chip8, instruction);
+    account_instruction(chip8, instruction);
+  }
+  return executed;
+}
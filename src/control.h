@@ -2,11 +2,9 @@
 #define CONTROL
 
 #include "chip8.h"
-#include "view.h"
 #include <stdint.h>
 
 #define INSTRUCTION_FREQUENCY 700
-#define TIMER_FREQUENCY 60
 
 // Instruction decoding bitmasks
 #define OP_MASK 0xF000
@@ -92,23 +90,68 @@ void exec_display(Chip8 *const chip8, uint8_t x, uint8_t y, uint8_t n);
 // `nn`: the 8-bit number taken from the 3rd and 4th (last 2) hex digits of the instruction
 void exec_io(Chip8 *const chip8, uint8_t x, uint8_t nn);
 
-// Execute a single opcode instruction for the CHIP-8
+// Execute a single opcode instruction for the CHIP-8.
+// NOTE: This looks up the quirks in the CHIP-8's config on every call, prefer calling
+// `chip8->exec_variant` (see `select_instruction_handler`) in loops.
 //
 // `chip8`: the CHIP-8 processor to run the instruction on
 // `instruction`: the 16-bit instruction to run
 void exec_instruction(Chip8 *const chip8, uint16_t instruction);
 
-// Execute a single fetch-decode-execute cycle for an instruction on the CHIP-8 system
+// Get the number of instructions run per second at the flat rate, which is INSTRUCTION_FREQUENCY
+// unless the config sets its own
+// `config`: the config flags to read the frequency from
+long instruction_frequency(const ConfigFlags *const config);
+
+// Get the number of instructions which run during a single 60 Hz timer frame. Since the
+// instruction frequency isn't a multiple of the timer frequency, this spreads the remainder
+// evenly over the frames.
+// `tick`: the index of the frame (see `Chip8.ticks`)
+// `frequency`: the number of instructions run per second (see `instruction_frequency`)
+long frame_instructions(uint64_t tick, long frequency);
+
+// COSMAC VIP timing (see `ConfigFlags.vip_timing`). The VIP's CDP1802 runs at 1.76064 MHz with 8
+// clock cycles per machine cycle, so each 60 Hz frame lasts 3668 machine cycles. The display's DMA
+// takes 1024 of them (8 bytes for each of 128 scanlines) and its interrupt routine roughly another
+// 46, which leaves the rest of the frame for the CHIP-8 interpreter.
+#define VIP_FRAME_CYCLES 3668
+#define VIP_INTERRUPT_CYCLES (1024 + 46)
+#define VIP_FRAME_BUDGET (VIP_FRAME_CYCLES - VIP_INTERRUPT_CYCLES)
+// DXYN takes some setup, then a cost for every row of the sprite
+#define VIP_DRAW_SETUP_CYCLES 22
+#define VIP_DRAW_ROW_CYCLES 26
+
+// Get how much time a 60 Hz timer frame has for running instructions, in the same units as
+// `Chip8.frame_cycles`: instructions (see `frame_instructions`), or machine cycles with VIP timing
+// `chip8`: the CHIP-8 processor to get the current frame's budget of
+long frame_budget(const Chip8 *const chip8);
+
+// Get the number of machine cycles an instruction takes on the COSMAC VIP's interpreter, not
+// counting any wait for the display. These are averages, since the real costs vary a little with
+// the operands (like how far a sprite is shifted).
+// `instruction`: the 16-bit instruction to get the cost of
+uint32_t vip_instruction_cycles(uint16_t instruction);
+
+// Count an instruction which just ran towards the current frame's budget (see `frame_budget`).
+// With `config.display_wait`, drawing uses up the rest of the frame.
+// `chip8`: the CHIP-8 processor which ran the instruction
+// `instruction`: the 16-bit instruction which ran
+void account_instruction(Chip8 *const chip8, uint16_t instruction);
+
+// Run the rest of the current timer frame's instructions as fast as possible and then update the
+// timers, without reading input or presenting the screen. This stops early if the program faults.
+// NOTE: `chip8->exec_variant` must already be set, e.g. with `select_instruction_handler`
+//
+// `chip8`: the CHIP-8 processor to run the frame on
+void exec_frame(Chip8 *const chip8);
+
+// Run up to `count` instructions as fast as possible, updating the timers whenever a full frame
+// worth of instructions has run. This stops early if the program ends or faults.
+// Returns the number of instructions which were run.
+// NOTE: `chip8->exec_variant` must already be set, e.g. with `select_instruction_handler`
 //
-// `chip8`: the chip8 processor on which a cycle will be executed 
-// `view`: the object used to display the state of the CHIP-8 to the user
-int exec_cycle(Chip8 *const chip8, struct View *const view);
-
-// Execute the program currently stored in the CHIP-8's memory
-// `chip8`: the chip8 processor to load the program from
-// `view`: the object used to display the state of the CHIP-8 to the user
-// `debug`: a flag for whether or not the program should be stepped through manually,
-//          one cycle at a time
-int exec_program(Chip8 *chip8, struct View *const view);
+// `chip8`: the CHIP-8 processor to run the instructions on
+// `count`: the maximum number of instructions to run
+long exec_instructions(Chip8 *const chip8, long count);
 
 #endif
@@ -0,0 +1,520 @@
+#include "frontend.h"
+#include "chip8-timer.h"
+#include "chip8.h"
+#include "control.h"
+#include "quirks.h"
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_log.h>
+#include <SDL2/SDL_scancode.h>
+#include <SDL2/SDL_timer.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+void frontend_log(const char *message) {
+  SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "%s", message);
+}
+
+// Start following any keys which changed state since input was last read
+static void trace_input(Chip8 *const chip8, InputTrace *const trace) {
+  uint64_t now = 0;
+  for (int key = 0; key < KEY_COUNT; key++) {
+    // an edge the program hasn't checked yet keeps its time, since that's when the wait began
+    if (chip8->key[key] != trace->keys[key] && !(trace->pending & (1 << key))) {
+      now = now ? now : current_time_us();
+      trace->pending |= 1 << key;
+      trace->observed &= ~(1 << key);
+      trace->presented &= ~(1 << key);
+      trace->edge_us[key] = now;
+    }
+    trace->keys[key] = chip8->key[key];
+  }
+}
+
+// Record the latency of the pending edges of any keys the last instruction checked
+static void trace_keys_read(Chip8 *const chip8, Frontend *const frontend) {
+  InputTrace *trace = &frontend->trace;
+  uint16_t read = chip8->keys_read & trace->pending;
+  chip8->keys_read = 0;
+  if (!read) {
+    return;
+  }
+  uint64_t now = current_time_us();
+  for (int key = 0; key < KEY_COUNT; key++) {
+    if (read & (1 << key)) {
+      metrics_observe(&frontend->metrics->input_read, now - trace->edge_us[key]);
+    }
+  }
+  trace->pending &= ~read;
+  trace->observed |= read & ~trace->presented;
+  trace->presented &= ~read;
+}
+
+// Record the latency of the checked edges of `keys` once a screen has been presented
+static void trace_present(Frontend *const frontend, uint16_t keys) {
+  InputTrace *trace = &frontend->trace;
+  uint64_t now = current_time_us();
+  for (int key = 0; key < KEY_COUNT; key++) {
+    if (keys & (1 << key)) {
+      uint64_t latency = now - trace->edge_us[key];
+      if (latency < INPUT_TRACE_TIMEOUT_US) {
+        metrics_observe(&frontend->metrics->input_present, latency);
+      }
+    }
+  }
+  trace->observed &= ~keys;
+  // edges only checked by run-ahead don't need to be presented again once the program checks them
+  trace->presented |= keys & trace->pending;
+}
+
+// Present a screen to the view, recording how long it took
+static void present(Frontend *const frontend, uint8_t *const screen, uint16_t traced_keys) {
+  uint64_t start = frontend->metrics ? current_time_us() : 0;
+  view_draw(frontend->view, screen);
+  if (frontend->metrics) {
+    metrics_observe(&frontend->metrics->present_time, current_time_us() - start);
+    metrics_add(&frontend->metrics->presents, 1);
+    if (traced_keys) {
+      trace_present(frontend, traced_keys);
+    }
+  }
+}
+
+int exec_cycle(Chip8 *const chip8, Frontend *const frontend) {
+  // reset the play_sound flag
+
+  // NOTE - get_input technically doesn't error here, but if a quit signal is pressed
+  // then the program should stop running
+  if (frontend->view) {
+    int error = view_get_input(frontend->view, chip8->key, KEY_COUNT);
+    if (error) {
+      return error;
+    }
+  }
+  if (frontend->stream) {
+    // without a window the stream's clients are the only source of input
+    if (!frontend->view) {
+      memset(chip8->key, 0, KEY_COUNT);
+    }
+    stream_merge_input(frontend->stream, chip8->key);
+  }
+  if (frontend->metrics) {
+    trace_input(chip8, &frontend->trace);
+  }
+
+  uint16_t instruction = fetch_instruction(chip8);
+  SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "fetched instruction %04x at address %d", instruction, chip8->pc - 2);
+
+  PerfRun *perf = &frontend->perf;
+  if (perf->by_class) {
+    PerfSample before, after;
+    perf_read(perf->perf, &before);
+    chip8->exec_variant(chip8, instruction);
+    perf_read(perf->perf, &after);
+    perf_attribute(perf->perf, &perf->classes, instruction, &before, &after);
+  } else {
+    chip8->exec_variant(chip8, instruction);
+  }
+  account_instruction(chip8, instruction);
+  perf->instructions++;
+  if (frontend->metrics) {
+    metrics_add(&frontend->metrics->instructions, 1);
+    trace_keys_read(chip8, frontend);
+  }
+  
+  if (chip8->display_flag) {
+    // when running ahead or fading pixels out, the screen is presented once per frame instead
+    if (frontend->view && !frontend->run_ahead.frames && !view_fades(frontend->view)) {
+      present(frontend, chip8->screen, frontend->trace.observed);
+    }
+    if (frontend->capture) {
+      capture_frame(frontend->capture, chip8->screen, chip8->ticks);
+    }
+  }
+
+  if (frontend->view) {
+    view_set_sound(frontend->view, chip8->sound_flag);
+  }
+
+  return 0;
+}
+
+// Run the program a few frames ahead with the current input, present the screen from then and
+// roll back to the real state. The real program never sees the speculative frames.
+static void present_run_ahead(Chip8 *const chip8, Frontend *const frontend) {
+  RunAhead *run_ahead = &frontend->run_ahead;
+  uint64_t start = frontend->metrics ? current_time_us() : 0;
+
+  chip8_save_state(chip8, &run_ahead->snapshot);
+  chip8->keys_read = 0;
+  for (int frame = 0; frame < run_ahead->frames && !chip8->fault; frame++) {
+    exec_frame(chip8);
+  }
+  uint16_t keys_read = chip8->keys_read;
+  bool changed = memcmp(chip8->screen, run_ahead->presented, sizeof(run_ahead->presented)) != 0;
+  // fading pixels change every frame, even when the screen doesn't
+  if (changed || view_fades(frontend->view)) {
+    memcpy(run_ahead->presented, chip8->screen, sizeof(run_ahead->presented));
+    // the edges checked for real or in the speculative frames are now on screen
+    present(frontend, run_ahead->presented,
+        frontend->trace.observed | (keys_read & frontend->trace.pending));
+  }
+  chip8_load_state(chip8, &run_ahead->snapshot);
+
+  if (frontend->metrics) {
+    metrics_observe(&frontend->metrics->run_ahead_time, current_time_us() - start);
+    metrics_add(&frontend->metrics->run_ahead_frames, run_ahead->frames);
+  }
+}
+
+// Rewrite the overlay text with the rates of the last `elapsed_us` microseconds, given the
+// values of the metrics at the start of that period
+static void update_overlay(Frontend *const frontend, Metrics *const previous, uint64_t elapsed_us) {
+  Metrics *metrics = frontend->metrics;
+  uint64_t instructions = metrics->instructions - previous->instructions;
+  uint64_t frames = metrics->frame_interval.count - previous->frame_interval.count;
+  uint64_t presents = metrics->present_time.count - previous->present_time.count;
+  double frame_ms = frames
+    ? (double)(metrics->frame_interval.sum - previous->frame_interval.sum) / frames / 1000 : 0;
+  double lag_ms = frames
+    ? (double)(metrics->timer_lag.sum - previous->timer_lag.sum) / frames / 1000 : 0;
+  double present_ms = presents
+    ? (double)(metrics->present_time.sum - previous->present_time.sum) / presents / 1000 : 0;
+  uint64_t ahead = metrics->run_ahead_time.count - previous->run_ahead_time.count;
+  double ahead_us = ahead
+    ? (double)(metrics->run_ahead_time.sum - previous->run_ahead_time.sum) / ahead : 0;
+  uint64_t inputs = metrics->input_present.count - previous->input_present.count;
+  double input_ms = inputs
+    ? (double)(metrics->input_present.sum - previous->input_present.sum) / inputs / 1000 : 0;
+
+  char text[256];
+  snprintf(text, sizeof(text), "IPS %.0f\nFRAME %.2f MS\nLAG %.2f MS\nDRAW %.2f MS\n"
+      "INPUT %.1f MS\nRUN AHEAD %.0f US\nUNDERRUNS %lu",
+      (double)instructions * 1000000 / elapsed_us, frame_ms, lag_ms, present_ms, input_ms,
+      ahead_us, (unsigned long)metrics->audio_underruns);
+  view_set_overlay(frontend->view, text);
+  *previous = *metrics;
+}
+
+// Print how the program which was just loaded differs from the state before the reload
+// `previous_ticks`: the ticks the previous program was loaded at
+static void compare_reload(const Chip8 *const chip8, const Chip8 *const previous,
+    uint64_t previous_ticks) {
+  int changed = 0;
+  int first = 0;
+  int last = 0;
+  for (int address = PROGRAM_START; address < ADDRESS_COUNT; address++) {
+    if (chip8->memory[address] != previous->memory[address]) {
+      first = changed ? first : address;
+      last = address;
+      changed++;
+    }
+  }
+  if (changed) {
+    printf("%d bytes of memory changed, from address %d to %d\n", changed, first, last);
+  } else {
+    printf("memory is unchanged\n");
+  }
+  printf("the previous program had run %lu frames and was at address %d%s%s\n",
+      (unsigned long)(previous->ticks - previous_ticks), previous->pc, previous->fault ? ", stopped by a " : "",
+      previous->fault ? chip8_fault_message(previous->fault) : "");
+}
+
+// Reset the CHIP-8 in place and load the program from its file again, keeping the view and
+// everything else in the frontend. Returns -1 if the program couldn't be loaded, which leaves
+// the CHIP-8 reset with no program and its pc past the end of memory, so the run loop waits for
+// the file to change again straight away.
+static int reload_program(Chip8 *const chip8, Frontend *const frontend) {
+  HotReload *reload = &frontend->reload;
+  uint64_t start = current_time_us();
+  if (reload->keep_previous) {
+    chip8_save_state(chip8, &reload->previous);
+    reload->previous_ticks = reload->loaded_ticks;
+    reload->has_previous = true;
+  }
+  // ticks keep counting across reloads, since the capture's records are timed by them
+  uint64_t ticks = chip8->ticks;
+  chip8_reset(chip8);
+  chip8->ticks = ticks;
+  reload->loaded_ticks = ticks;
+  chip8_seed(chip8, time(NULL));
+  // edges being followed belong to the previous program
+  memset(&frontend->trace, 0, sizeof(frontend->trace));
+  int size = load_program(chip8, (char*)reload->path);
+  if (size == -1) {
+    fprintf(stderr, "Unable to reload %s, waiting for it to change again\n", reload->path);
+    chip8->pc = ADDRESS_COUNT;
+    return -1;
+  }
+
+  if (frontend->view) {
+    view_set_sound(frontend->view, false);
+    memset(frontend->run_ahead.presented, 0, sizeof(frontend->run_ahead.presented));
+    present(frontend, chip8->screen, 0);
+  }
+  printf("Reloaded %s (%d bytes) in %.2f ms\n", reload->path, size,
+      (current_time_us() - start) / 1000.0);
+  if (reload->has_previous) {
+    compare_reload(chip8, &reload->previous, reload->previous_ticks);
+  }
+  return 0;
+}
+
+// Wait for the program's file to change and reload it, for when the program has stopped.
+// Returns QUIT_SIGNAL if the user quit while waiting.
+static int wait_for_reload(Chip8 *const chip8, Frontend *const frontend) {
+  printf("Waiting for %s to change...\n", frontend->reload.path);
+  if (frontend->view) {
+    view_set_sound(frontend->view, false);
+  }
+  while (!watch_changed(frontend->reload.watch, 1000 / TIMER_FREQUENCY)) {
+    // keep handling the window's events, so it can still be closed
+    if (frontend->view && view_get_input(frontend->view, chip8->key, KEY_COUNT)) {
+      return QUIT_SIGNAL;
+    }
+  }
+  reload_program(chip8, frontend);
+  return 0;
+}
+
+// Update the parts of the frontend which work once per 60 Hz frame instead of once per cycle
+// `last_frame_us`: the time of the previous frame, updated to the time of this one
+// `overlay`: the metrics when the overlay was last updated, and the time it happened
+static void exec_frame_end(Chip8 *const chip8, Frontend *const frontend, uint64_t *last_frame_us,
+    Metrics *const overlay, uint64_t *overlay_us) {
+  if (frontend->reload.watch && watch_changed(frontend->reload.watch, 0)) {
+    reload_program(chip8, frontend);
+  }
+  if (frontend->stream) {
+    stream_publish(frontend->stream, chip8->screen);
+  }
+  if (frontend->view && frontend->run_ahead.frames) {
+    present_run_ahead(chip8, frontend);
+  } else if (frontend->view && view_fades(frontend->view)) {
+    present(frontend, chip8->screen, frontend->trace.observed);
+  }
+
+  if (frontend->metrics) {
+    Metrics *metrics = frontend->metrics;
+    uint64_t now = current_time_us();
+    uint64_t interval = now - *last_frame_us;
+    uint64_t period = 1000000 / TIMER_FREQUENCY;
+    metrics_add(&metrics->frames, 1);
+    metrics_observe(&metrics->frame_interval, interval);
+    // lag only means something when the timers are supposed to follow the wall clock
+    if (!chip8->config.unthrottled) {
+      metrics_observe(&metrics->timer_lag, interval > period ? interval - period : 0);
+    }
+    *last_frame_us = now;
+
+    if (frontend->view && now - *overlay_us >= 1000000) {
+      update_overlay(frontend, overlay, now - *overlay_us);
+      *overlay_us = now;
+      // redraw so the overlay changes even when the program isn't drawing anything (fading
+      // pixels are already drawn every frame, and drawing again would fade them twice as fast)
+      if (view_overlay_visible(frontend->view) && !view_fades(frontend->view)) {
+        view_draw(frontend->view,
+            frontend->run_ahead.frames ? frontend->run_ahead.presented : chip8->screen);
+      }
+    }
+  }
+}
+
+// Check whether a program's frames end once they've used up their budget of instructions or
+// cycles (see `frame_budget`), instead of after a 60th of a second of running at a flat rate
+static bool paced_by_frame(const Chip8 *const chip8) {
+  return chip8->config.vip_timing || chip8->config.display_wait;
+}
+
+// Run the program until it ends or the user quits, see `exec_program`
+static int run_program(Chip8 *const chip8, Frontend *const frontend) {
+  // Timers decrement every second, and the sound timer will update the chip8's
+  // sound flag to indicate when a sound should be played
+  uint64_t last_time = SDL_GetTicks64();
+  int manual = 1; // flag for manually stepping through instructions in debug mode
+  long cycles = 0;
+  uint64_t last_frame_us = current_time_us();
+  uint64_t overlay_us = last_frame_us;
+  uint64_t next_frame_us = last_frame_us + 1000000 / TIMER_FREQUENCY;
+  Metrics overlay = { 0 };
+
+  // quirks can't change while a program is running, so pick the specialized interpreter once
+  chip8->exec_variant = select_instruction_handler(&chip8->config);
+  
+  // a program which is reloaded when it changes waits to be fixed instead of ending
+  while (chip8->pc < ADDRESS_COUNT || frontend->reload.watch) {
+    if (chip8->pc >= ADDRESS_COUNT && wait_for_reload(chip8, frontend)) {
+      return QUIT_SIGNAL;
+    }
+    if (chip8->config.cycle_limit && cycles++ >= chip8->config.cycle_limit) {
+      break;
+    }
+
+    if (chip8->config.unthrottled) {
+      // in virtual time, the timers update after each frame's worth of instructions
+      if (chip8->frame_cycles >= frame_budget(chip8)) {
+        chip8_decrement_timers(chip8);
+        exec_frame_end(chip8, frontend, &last_frame_us, &overlay, &overlay_us);
+      }
+    } else if (paced_by_frame(chip8)) {
+      // the program runs until the frame's budget is used up, and then waits for the next
+      // display interrupt (60 Hz on the wall clock) to start the next frame
+      if (chip8->frame_cycles >= frame_budget(chip8)) {
+        uint64_t now = current_time_us();
+        if (now < next_frame_us) {
+          precise_sleep((next_frame_us - now) * 1000);
+        }
+        // after falling more than a frame behind, start counting again from now instead of
+        // rushing through the missed frames
+        next_frame_us += 1000000 / TIMER_FREQUENCY;
+        if (next_frame_us < now) {
+          next_frame_us = now + 1000000 / TIMER_FREQUENCY;
+        }
+        chip8_decrement_timers(chip8);
+        exec_frame_end(chip8, frontend, &last_frame_us, &overlay, &overlay_us);
+      }
+    } else {
+      uint64_t current_time = SDL_GetTicks64();
+      if (current_time > last_time + (int)(1.0 / TIMER_FREQUENCY * 1000)) {
+        chip8_decrement_timers(chip8);
+        exec_frame_end(chip8, frontend, &last_frame_us, &overlay, &overlay_us);
+        last_time = current_time;
+      }
+    }
+
+    // a reload which failed leaves nothing to run until the file changes again
+    if (chip8->pc >= ADDRESS_COUNT) {
+      continue;
+    }
+
+    int result = exec_cycle(chip8, frontend);
+    if (result) {
+      return result;
+    }
+    if (chip8->fault) {
+      fprintf(stderr, "Program stopped at address %d: %s\n",
+          chip8->pc - 2, chip8_fault_message(chip8->fault));
+      if (!frontend->reload.watch) {
+        return chip8->fault;
+      }
+      if (wait_for_reload(chip8, frontend)) {
+        return QUIT_SIGNAL;
+      }
+    }
+    // calculate the timing to sleep in nanoseconds and wait that long
+    // before running the next instruction
+    if (!chip8->config.unthrottled && !paced_by_frame(chip8)) {
+      precise_sleep(1000000000 / instruction_frequency(&chip8->config));
+    }
+
+    // additional debug step for manually stepping through instructions
+    // (this needs the keyboard, so it isn't available when running headless)
+    if (chip8->config.debug && frontend->view) {
+      int key_count;
+      SDL_PumpEvents();
+      const uint8_t* keystate = SDL_GetKeyboardState(&key_count);
+      bool paused = true;
+      while (paused) {
+        SDL_PumpEvents();
+        if (keystate[SDL_SCANCODE_RETURN]) {
+          manual = !manual;
+          SDL_Delay(200);
+          break;
+        }
+        if (!manual) {
+          break;
+        }
+        view_set_sound(frontend->view, 0);
+        paused = !keystate[SDL_SCANCODE_N] && manual;
+      }
+      view_set_sound(frontend->view, chip8->sound_flag);
+      if (manual) {
+        SDL_Delay(250);
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Run the program in step with a peer until it ends or the user quits, see netplay.h. Frames run
+// in virtual time (see `chip8_run_frame`), 60 times a second on the wall clock, so the screen is
+// presented once per frame and only after any rollbacks have been run.
+static int run_netplay(Chip8 *const chip8, Frontend *const frontend) {
+  uint64_t next_frame_us = current_time_us();
+  bool warned = false;
+  chip8->exec_variant = select_instruction_handler(&chip8->config);
+
+  while (chip8->pc < ADDRESS_COUNT) {
+    uint8_t keys[KEY_COUNT] = { 0 };
+    if (frontend->view && view_get_input(frontend->view, keys, KEY_COUNT)) {
+      return QUIT_SIGNAL;
+    }
+    if (frontend->stream) {
+      stream_merge_input(frontend->stream, keys);
+    }
+    uint16_t held = 0;
+    for (int key = 0; key < KEY_COUNT; key++) {
+      held |= (keys[key] != 0) << key;
+    }
+
+    int result = netplay_frame(frontend->netplay, chip8, held);
+    if (result == -1) {
+      fprintf(stderr, "Unable to save the state for rolling back\n");
+      return -1;
+    }
+    // a peer with a different program would otherwise just look like one which never answers
+    if (!warned && netplay_stats(frontend->netplay)->peer_mismatch) {
+      fprintf(stderr, "Netplay peer is running a different program or quirks\n");
+      warned = true;
+    }
+    if (frontend->stream) {
+      stream_publish(frontend->stream, chip8->screen);
+    }
+    if (frontend->view) {
+      present(frontend, chip8->screen, 0);
+      view_set_sound(frontend->view, chip8->sound_flag);
+    }
+    if (frontend->capture && result == NETPLAY_RAN) {
+      capture_frame(frontend->capture, chip8->screen, chip8->ticks);
+    }
+    if (frontend->metrics && result == NETPLAY_RAN) {
+      metrics_add(&frontend->metrics->frames, 1);
+    }
+    if (chip8->fault) {
+      fprintf(stderr, "Program stopped at address %d: %s\n",
+          chip8->pc - 2, chip8_fault_message(chip8->fault));
+      return chip8->fault;
+    }
+
+    uint64_t now = current_time_us();
+    next_frame_us += 1000000 / TIMER_FREQUENCY;
+    if (now < next_frame_us) {
+      precise_sleep((next_frame_us - now) * 1000);
+    } else {
+      next_frame_us = now;
+    }
+  }
+  return 0;
+}
+
+int exec_program(Chip8 *const chip8, Frontend *const frontend) {
+  PerfRun *perf = &frontend->perf;
+  if (perf->perf == NULL) {
+    return frontend->netplay ? run_netplay(chip8, frontend) : run_program(chip8, frontend);
+  }
+  perf->instructions = 0;
+  memset(&perf->classes, 0, sizeof(perf->classes));
+  perf_start(perf->perf);
+  int result = frontend->netplay ? run_netplay(chip8, frontend) : run_program(chip8, frontend);
+  PerfSample total;
+  perf_stop(perf->perf, &total);
+
+  printf("Hardware counters over %" PRIu64 " instructions: ", perf->instructions);
+  perf_print(perf->perf, stdout, &total, perf->instructions);
+  if (perf->by_class) {
+    perf_print_classes(perf->perf, stdout, &perf->classes);
+  }
+  return result;
+}
@@ -0,0 +1,90 @@
+#ifndef FRONTEND
+#define FRONTEND
+
+#include "capture.h"
+#include "chip8.h"
+#include "metrics.h"
+#include "netplay.h"
+#include "perf.h"
+#include <stdbool.h>
+#include "stream.h"
+#include "view.h"
+#include "watch.h"
+
+// Observations which have waited this long for a screen to be presented are dropped, since the
+// program didn't draw anything in response to them
+#define INPUT_TRACE_TIMEOUT_US 1000000
+
+// Follows each change in the state of a key (an edge) from the moment it's read from the host,
+// to the first instruction which checks that key, to the first screen presented after that.
+typedef struct InputTrace {
+  uint8_t keys[KEY_COUNT]; // key states the last time input was read
+  uint16_t pending; // bitmask of keys with an edge the program hasn't checked yet
+  uint16_t observed; // bitmask of keys with an edge checked by the program but not yet presented
+  uint16_t presented; // bitmask of keys with an edge already presented by run-ahead, before
+                      // the program itself checked it
+  uint64_t edge_us[KEY_COUNT]; // when the edge being followed for each key happened
+} InputTrace;
+
+// Presenting the screen from a few frames in the future, which hides the frames of latency most
+// programs take to react to input
+typedef struct RunAhead {
+  int frames; // number of frames to run ahead, 0 when disabled
+  Chip8 snapshot; // the real state, saved while running ahead
+  uint8_t presented[DISPLAY_WIDTH * DISPLAY_HEIGHT]; // the screen most recently presented
+} RunAhead;
+
+// Reloading the program from its file whenever the file changes, keeping the window, audio and
+// everything else in the frontend alive
+typedef struct HotReload {
+  Watch *watch; // the program's file, NULL when not reloading
+  const char *path; // the path of the program's file
+  bool keep_previous; // whether to keep the state from just before each reload to compare with
+  bool has_previous; // whether `previous` holds a state yet
+  Chip8 previous; // the state just before the last reload, with `keep_previous`
+  uint64_t loaded_ticks; // `Chip8.ticks` when the program was last loaded
+  uint64_t previous_ticks; // `loaded_ticks` of the program in `previous`
+} HotReload;
+
+// Hardware performance counters around the run loop, see perf.h
+typedef struct PerfRun {
+  Perf *perf; // NULL when not counting
+  bool by_class; // whether to also read the counters around every instruction and attribute the
+                 // events to its class, which makes running several times slower
+  uint64_t instructions; // instructions executed while counting
+  PerfClasses classes; // only used `by_class`
+} PerfRun;
+
+// Everything outside of the CHIP-8 itself that a running program presents its screen to
+// and reads its input from. Any of these can be NULL if they aren't being used.
+typedef struct Frontend {
+  View *view; // the window to draw to and read input from, NULL when running headless
+  Capture *capture; // records every presented screen to a file
+  Stream *stream; // publishes the screen to and reads key presses from socket clients
+  Metrics *metrics; // performance counters and timings of the running program
+  InputTrace trace; // input latency tracing, only used when there are metrics to record it in
+  RunAhead run_ahead; // only used with a view, which then presents once per frame instead of
+                      // after every draw
+  HotReload reload;
+  PerfRun perf;
+  Netplay *netplay; // plays the program with a peer over the network, a frame at a time
+} Frontend;
+
+// Log handler for the interpreter core which sends its messages to SDL's debug log
+// (see `chip8_set_log_handler`)
+// `message`: the message to log
+void frontend_log(const char *message);
+
+// Execute a single fetch-decode-execute cycle for an instruction on the CHIP-8 system
+//
+// `chip8`: the chip8 processor on which a cycle will be executed 
+// `frontend`: the objects used to display the state of the CHIP-8 and get input from the user
+int exec_cycle(Chip8 *const chip8, Frontend *const frontend);
+
+// Execute the program currently stored in the CHIP-8's memory, printing the hardware counters
+// afterwards if they're being used
+// `chip8`: the chip8 processor to load the program from
+// `frontend`: the objects used to display the state of the CHIP-8 and get input from the user
+int exec_program(Chip8 *chip8, Frontend *const frontend);
+
+#endif
@@ -0,0 +1,51 @@
+#include "chip8.h"
+#include "control.h"
+#include "quirks.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// libFuzzer target for the instruction core. Each input is laid out as
+//
+// byte 0: quirk mask (see quirks.h)
+// bytes 1-2: bitmask of the keys held down while the program runs
+// bytes 3+: the program, loaded at PROGRAM_START
+//
+// The program is run for FUZZ_FRAMES frames or until it faults. A single CHIP-8 is reset in
+// place between inputs so that no time is spent on allocation.
+
+#define FUZZ_FRAMES 64
+#define FUZZ_HEADER_SIZE 3
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static Chip8 *chip8 = NULL;
+  if (chip8 == NULL) {
+    chip8 = chip8_init();
+  }
+  if (size < FUZZ_HEADER_SIZE) {
+    return 0;
+  }
+
+  unsigned quirks = data[0] % VARIANT_COUNT;
+  chip8->config.legacy_shift = (quirks & QUIRK_LEGACY_SHIFT) != 0;
+  chip8->config.jump_quirk = (quirks & QUIRK_JUMP) != 0;
+  chip8->config.legacy_indexing = (quirks & QUIRK_LEGACY_INDEXING) != 0;
+  chip8->exec_variant = select_instruction_handler(&chip8->config);
+  chip8_reset(chip8);
+
+  uint16_t keys = data[1] | data[2] << 8;
+  for (int key = 0; key < KEY_COUNT; key++) {
+    chip8->key[key] = (keys >> key) & 1;
+  }
+
+  size_t program_size = size - FUZZ_HEADER_SIZE;
+  if (program_size > ADDRESS_COUNT - PROGRAM_START) {
+    program_size = ADDRESS_COUNT - PROGRAM_START;
+  }
+  memcpy(chip8->memory + PROGRAM_START, data + FUZZ_HEADER_SIZE, program_size);
+
+  for (int frame = 0; frame < FUZZ_FRAMES && !chip8->fault && chip8->pc < ADDRESS_COUNT; frame++) {
+    exec_frame(chip8);
+  }
+  return 0;
+}
@@ -0,0 +1,368 @@
+#include "chip8.h"
+#include "control.h"
+#include "pack.h"
+#include "perf.h"
+#include "quirks.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CHIP8_AOT
+#include "aot.h"
+// the program translated by chip8-aot which this harness was built with (see CMakeLists.txt)
+extern const AotProgram chip8_aot_program;
+#endif
+
+// Regression harness which runs CHIP-8 programs headlessly and compares hashes of their state
+// (see `chip8_hash_state`) at chosen frames against known good ("golden") values.
+//
+// Golden files contain one checkpoint per line, with blank lines and lines starting with # ignored:
+//
+// [rom-filepath] [quirks] [frame] [hash]
+//
+// where `quirks` is a comma separated list of old-shift, jump-quirk, old-index, vip (COSMAC VIP
+// timing) and display-wait (or - for none),
+// `frame` is the number of 60 Hz frames to run before checking the hash, and `hash` is the hash in
+// hexadecimal. ROM paths are relative to the golden file. Programs run in virtual time with no
+// sleeping, so each checkpoint takes roughly a millisecond per 100 frames.
+//
+// Running with --update rewrites the hash of every checkpoint with the current value.
+//
+// Running with --pack [file] loads ROMs from a pack (see pack.h) instead, looking each one up by
+// the name or hash given in place of its path, and falling back to the file if it isn't in the
+// pack. `quirks` can then also be `pack`, for the profile the pack has for the ROM.
+//
+// Running with --perf also counts hardware events (see perf.h) while each checkpoint runs, and
+// --perf-classes also counts each class of instruction separately, which only works for
+// interpreted checkpoints. Both carry on without the counters if they aren't available.
+//
+// When built with CHIP8_AOT and a program translated by chip8-aot, checkpoints for that program
+// (with the quirks it was translated for) run the translated code instead of the interpreter, so
+// the same golden file checks that the translation behaves exactly like the interpreter.
+
+#define MAX_CHECKPOINTS 1024
+#define MAX_PATH 512
+
+typedef struct Checkpoint {
+  char rom[2 * MAX_PATH]; // path of the golden file's directory + the path given in the file
+  char name[MAX_PATH]; // the path given in the file, used to look the ROM up in a pack
+  char quirks[64];
+  long frame;
+  uint64_t hash;
+} Checkpoint;
+
+void help_menu() {
+  printf("Usage: chip8-golden [...options] [golden-filepath]\n");
+  printf("Options:\t\tDescription\n");
+  printf("--update\tReplace the golden hashes with the current ones instead of checking them\n");
+  printf("--pack [file]\tLoad ROMs from a pack by name or hash, see pack.h\n");
+  printf("--perf\t\tCount hardware events while each checkpoint runs, see perf.h\n");
+  printf("--perf-classes\tLike --perf, also counting each class of instruction separately\n");
+}
+
+// Set the quirks of a CHIP-8 from a comma separated list, returning 0 if they are all valid
+int parse_quirks(ConfigFlags *const config, char *const quirks) {
+  if (strcmp(quirks, "-") == 0) {
+    return 0;
+  }
+  char list[64];
+  strncpy(list, quirks, sizeof(list) - 1);
+  list[sizeof(list) - 1] = 0;
+  for (char *quirk = strtok(list, ","); quirk != NULL; quirk = strtok(NULL, ",")) {
+    if (strcmp(quirk, "old-shift") == 0) {
+      config->legacy_shift = 1;
+    } else if (strcmp(quirk, "jump-quirk") == 0) {
+      config->jump_quirk = 1;
+    } else if (strcmp(quirk, "old-index") == 0) {
+      config->legacy_indexing = 1;
+    } else if (strcmp(quirk, "vip") == 0) {
+      config->vip_timing = 1;
+    } else if (strcmp(quirk, "display-wait") == 0) {
+      config->display_wait = 1;
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Read every checkpoint in a golden file, returning the number read or -1 on an error
+int read_golden(const char *path, Checkpoint *checkpoints) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+
+  // ROM paths are relative to the directory of the golden file
+  char dir[MAX_PATH] = "";
+  const char *slash = strrchr(path, '/');
+  if (slash != NULL && slash - path + 1 < MAX_PATH) {
+    memcpy(dir, path, slash - path + 1);
+    dir[slash - path + 1] = 0;
+  }
+
+  char line[MAX_PATH + 128];
+  int count = 0;
+  for (int line_number = 1; fgets(line, sizeof(line), file) != NULL; line_number++) {
+    char rom[MAX_PATH];
+    Checkpoint *checkpoint = &checkpoints[count];
+    if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)) {
+      continue;
+    }
+    if (count == MAX_CHECKPOINTS || sscanf(line, "%511s %63s %ld %" SCNx64,
+          rom, checkpoint->quirks, &checkpoint->frame, &checkpoint->hash) != 4) {
+      fprintf(stderr, "%s:%d: invalid checkpoint\n", path, line_number);
+      fclose(file);
+      return -1;
+    }
+    snprintf(checkpoint->rom, sizeof(checkpoint->rom), "%s%s", rom[0] == '/' ? "" : dir, rom);
+    strcpy(checkpoint->name, rom);
+    count++;
+  }
+
+  fclose(file);
+  return count;
+}
+
+// Rewrite a golden file with updated hashes, keeping the original ROM paths and comments
+int write_golden(const char *path, Checkpoint *checkpoints) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char *contents = NULL;
+  size_t size = 0;
+  FILE *out = open_memstream(&contents, &size);
+
+  char line[MAX_PATH + 128];
+  int count = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char rom[MAX_PATH];
+    char quirks[64];
+    long frame;
+    if (line[0] == '#' || sscanf(line, "%511s %63s %ld", rom, quirks, &frame) != 3) {
+      fputs(line, out);
+      continue;
+    }
+    fprintf(out, "%s %s %ld %016" PRIx64 "\n", rom, quirks, frame, checkpoints[count++].hash);
+  }
+  fclose(file);
+  fclose(out);
+
+  file = fopen(path, "w");
+  if (file == NULL) {
+    free(contents);
+    return -1;
+  }
+  fwrite(contents, 1, size, file);
+  fclose(file);
+  free(contents);
+  return 0;
+}
+
+// Load a checkpoint's program and set its quirks, returning 0 if successful
+// `pack`: the pack to load the program from, or NULL to load it from its file
+int load_checkpoint(Chip8 *const chip8, const Checkpoint *const checkpoint,
+    const Pack *const pack) {
+  const PackEntry *entry = pack ? pack_lookup(pack, checkpoint->name) : NULL;
+  if (entry != NULL) {
+    pack_load(pack, entry, chip8);
+  } else {
+    int size = load_program(chip8, (char*)checkpoint->rom);
+    if (size < 0) {
+      return -1;
+    }
+    entry = pack ? pack_find(pack, pack_hash(chip8->memory + PROGRAM_START, size)) : NULL;
+  }
+
+  if (strcmp(checkpoint->quirks, "pack") == 0) {
+    if (entry == NULL) {
+      return -1;
+    }
+    pack_configure(entry, &chip8->config);
+    return 0;
+  }
+  char quirks[64];
+  strcpy(quirks, checkpoint->quirks);
+  return parse_quirks(&chip8->config, quirks);
+}
+
+// Run a frame the same as `exec_frame`, attributing the events counted while running each
+// instruction to its class
+void exec_frame_by_class(Chip8 *const chip8, Perf *const perf, PerfClasses *const classes) {
+  long count = frame_budget(chip8);
+  while (chip8->frame_cycles < count && chip8->pc < ADDRESS_COUNT && !chip8->fault) {
+    uint16_t instruction = fetch_instruction(chip8);
+    PerfSample before, after;
+    perf_read(perf, &before);
+    chip8->exec_variant(chip8, instruction);
+    perf_read(perf, &after);
+    perf_attribute(perf, classes, instruction, &before, &after);
+    account_instruction(chip8, instruction);
+  }
+  chip8_decrement_timers(chip8);
+}
+
+// Run a frame the same as `exec_frame`, returning the number of instructions it ran
+uint64_t exec_frame_counted(Chip8 *const chip8) {
+  long count = frame_budget(chip8);
+  uint64_t executed = 0;
+  while (chip8->frame_cycles < count && chip8->pc < ADDRESS_COUNT && !chip8->fault) {
+    uint16_t instruction = fetch_instruction(chip8);
+    chip8->exec_variant(chip8, instruction);
+    account_instruction(chip8, instruction);
+    executed++;
+  }
+  chip8_decrement_timers(chip8);
+  return executed;
+}
+
+// Run a checkpoint's program up to its frame, returning the hash of the state at that point
+// `pack`: the pack to load the program from, or NULL to load it from its file
+// `perf`: counters to count the run with, or NULL to not count it
+// `classes`: out parameter for the events of each class of instruction, or NULL to only count
+// the totals
+// `total`: out parameter for the events counted, if `perf` isn't NULL
+// `executed`: out parameter for the number of CHIP-8 instructions run, if `perf` isn't NULL
+// `native`: out parameter set to 1 if the program ran as translated code, 0 if interpreted
+int run_checkpoint(const Checkpoint *const checkpoint, const Pack *const pack, Perf *const perf,
+    PerfClasses *const classes, PerfSample *const total, uint64_t *executed, uint64_t *hash,
+    int *native) {
+  Chip8 *chip8 = chip8_init();
+  if (load_checkpoint(chip8, checkpoint, pack)) {
+    chip8_destroy(chip8);
+    return -1;
+  }
+  chip8->exec_variant = select_instruction_handler(&chip8->config);
+  *native = 0;
+  // the counted run can't count instructions without slowing down, so they're counted afterwards
+  // by running a copy of the starting state again
+  Chip8 start = *chip8;
+  if (perf) {
+    perf_start(perf);
+  }
+#ifdef CHIP8_AOT
+  if (aot_matches(chip8, &chip8_aot_program)) {
+    *native = 1;
+    for (long frame = 0; frame < checkpoint->frame; frame++) {
+      aot_exec_frame(chip8, &chip8_aot_program);
+    }
+  }
+#endif
+  for (long frame = 0; !*native && frame < checkpoint->frame; frame++) {
+    if (classes) {
+      exec_frame_by_class(chip8, perf, classes);
+    } else {
+      exec_frame(chip8);
+    }
+  }
+  if (perf) {
+    perf_stop(perf, total);
+    *executed = 0;
+    if (classes) {
+      for (int class = 0; class < PERF_CLASS_COUNT; class++) {
+        *executed += classes->instructions[class];
+      }
+    } else {
+      for (long frame = 0; frame < checkpoint->frame; frame++) {
+        *executed += exec_frame_counted(&start);
+      }
+    }
+  }
+  *hash = chip8_hash_state(chip8);
+  chip8_destroy(chip8);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  char *golden_path = NULL;
+  char *pack_path = NULL;
+  int update = 0;
+  int count_events = 0;
+  int count_classes = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--update", 9) == 0) {
+      update = 1;
+    } else if (strncmp(argv[i], "--perf", 7) == 0) {
+      count_events = 1;
+    } else if (strncmp(argv[i], "--perf-classes", 15) == 0) {
+      count_events = 1;
+      count_classes = 1;
+    } else if (strncmp(argv[i], "--pack", 7) == 0 && i + 1 < argc) {
+      pack_path = argv[++i];
+    } else {
+      golden_path = argv[i];
+    }
+  }
+  if (golden_path == NULL) {
+    help_menu();
+    return -1;
+  }
+
+  static Checkpoint checkpoints[MAX_CHECKPOINTS];
+  int count = read_golden(golden_path, checkpoints);
+  if (count < 0) {
+    fprintf(stderr, "Unable to read golden file %s\n", golden_path);
+    return -1;
+  }
+  Pack *pack = NULL;
+  if (pack_path != NULL && (pack = pack_open(pack_path)) == NULL) {
+    fprintf(stderr, "Unable to open pack %s\n", pack_path);
+    return -1;
+  }
+
+  Perf *perf = NULL;
+  if (count_events && (perf = perf_open()) == NULL) {
+    fprintf(stderr, "Hardware counters aren't available (%s), running without them\n",
+        perf_unavailable_reason(errno));
+  }
+
+  int failures = 0;
+  for (int i = 0; i < count; i++) {
+    Checkpoint *checkpoint = &checkpoints[i];
+    uint64_t hash;
+    int native;
+    PerfClasses classes = { 0 };
+    PerfSample total;
+    uint64_t executed;
+    int error = run_checkpoint(checkpoint, pack, perf, perf && count_classes ? &classes : NULL,
+        &total, &executed, &hash, &native);
+    if (error) {
+      printf("ERROR %s [%s] - unable to load program\n", checkpoint->rom, checkpoint->quirks);
+      failures++;
+    } else if (update) {
+      checkpoint->hash = hash;
+    } else if (hash != checkpoint->hash) {
+      printf("FAIL  %s [%s] @ frame %ld%s: expected %016" PRIx64 ", got %016" PRIx64 "\n",
+          checkpoint->rom, checkpoint->quirks, checkpoint->frame, native ? " (native)" : "",
+          checkpoint->hash, hash);
+      failures++;
+    } else {
+      printf("ok    %s [%s] @ frame %ld%s\n", checkpoint->rom, checkpoint->quirks,
+          checkpoint->frame, native ? " (native)" : "");
+    }
+    if (perf && !error) {
+      // per ROM, so a change to the interpreter shows up in the programs it affects
+      printf("      ");
+      perf_print(perf, stdout, &total, executed);
+      if (count_classes && !native) {
+        perf_print_classes(perf, stdout, &classes);
+      }
+    }
+  }
+
+  if (perf) {
+    perf_close(perf);
+  }
+  if (pack) {
+    pack_close(pack);
+  }
+  if (update && !failures && write_golden(golden_path, checkpoints)) {
+    fprintf(stderr, "Unable to update golden file %s\n", golden_path);
+    return -1;
+  }
+  printf("%d/%d checkpoints passed\n", count - failures, count);
+  return failures ? 1 : 0;
+}
@@ -38,4 +38,7 @@ const SDL_Scancode EXIT_HOTKEY[] = {
   SDL_SCANCODE_C
 };
 
+// toggles the overlay showing performance metrics
+const SDL_Scancode OVERLAY_HOTKEY = SDL_SCANCODE_F1;
+
 #endif
@@ -0,0 +1,62 @@
+#include "libchip8.h"
+#include "chip8.h"
+#include "control.h"
+#include "quirks.h"
+#include <stdlib.h>
+#include <string.h>
+
+Chip8* chip8_create(void) {
+  Chip8 *chip8 = chip8_init();
+  chip8->exec_variant = select_instruction_handler(&chip8->config);
+  return chip8;
+}
+
+Chip8* chip8_clone(const Chip8 *const chip8) {
+  Chip8 *clone = malloc(sizeof(Chip8));
+  if (clone != NULL) {
+    chip8_save_state(chip8, clone);
+  }
+  return clone;
+}
+
+void chip8_configure(Chip8 *const chip8, const ConfigFlags *const config) {
+  chip8->config = *config;
+  chip8->exec_variant = select_instruction_handler(&chip8->config);
+}
+
+int chip8_load(Chip8 *const chip8, const uint8_t *const program, size_t size) {
+  if (size > ADDRESS_COUNT - PROGRAM_START) {
+    return -1;
+  }
+  memcpy(chip8->memory + PROGRAM_START, program, size);
+  return 0;
+}
+
+int chip8_run_frame(Chip8 *const chip8, const uint8_t *const keys) {
+  if (keys) {
+    memcpy(chip8->key, keys, KEY_COUNT);
+  } else {
+    memset(chip8->key, 0, KEY_COUNT);
+  }
+  exec_frame(chip8);
+  if (chip8->fault == FAULT_NONE && chip8->pc >= ADDRESS_COUNT) {
+    return CHIP8_ENDED;
+  }
+  return chip8->fault;
+}
+
+long chip8_run_instructions(Chip8 *const chip8, long count) {
+  return exec_instructions(chip8, count);
+}
+
+const uint8_t* chip8_screen(const Chip8 *const chip8) {
+  return chip8->screen;
+}
+
+const uint8_t* chip8_registers(const Chip8 *const chip8) {
+  return chip8->V;
+}
+
+const uint8_t* chip8_memory(const Chip8 *const chip8) {
+  return chip8->memory;
+}
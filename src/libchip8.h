@@ -0,0 +1,83 @@
+#ifndef LIBCHIP8
+#define LIBCHIP8
+
+#include "chip8.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// The public API of libchip8, the interpreter core without any frontend (no SDL, no threads).
+//
+// A typical embedding looks like:
+//
+//   Chip8 *chip8 = chip8_create();
+//   chip8_load(chip8, rom, rom_size);
+//   while (!chip8_run_frame(chip8, keys)) {
+//     draw(chip8_screen(chip8));
+//   }
+//   chip8_destroy(chip8);
+//
+// Frames run in virtual time, so they take as long as the instructions do to execute. The
+// caller is responsible for pacing them at 60 Hz if the program should run in real time.
+// `chip8_reset` (see chip8.h) resets a CHIP-8 in place, keeping its quirks.
+//
+// The Chip8 struct isn't opaque, so its layout is part of the shared library's ABI: any change to
+// it bumps the library's SOVERSION (see src/CMakeLists.txt), and programs using libchip8.so have
+// to be rebuilt against the new headers.
+
+// Create a CHIP-8 system in its initial state, with the font loaded and no quirks enabled.
+// NOTE: This function uses memory allocation. It is expected that `chip8_destroy` will be called
+// when the CHIP-8 is no longer needed in order to free that memory.
+Chip8* chip8_create(void);
+
+// Create a copy of a CHIP-8 system, which runs independently of the original from then on. A Chip8
+// doesn't point to any other memory, so this is a single allocation and copy. Returns NULL if the
+// copy can't be allocated. To reuse memory instead, copy into an existing system with
+// `chip8_save_state` (see chip8.h).
+// NOTE: This function uses memory allocation. It is expected that `chip8_destroy` will be called
+// when the copy is no longer needed in order to free that memory.
+// `chip8`: the CHIP-8 system to copy
+Chip8* chip8_clone(const Chip8 *const chip8);
+
+// Set the quirks a CHIP-8 system runs with, which also picks the interpreter specialized for them
+// `chip8`: the CHIP-8 system to configure
+// `config`: the config to copy, only the quirk and timing flags affect the core
+void chip8_configure(Chip8 *const chip8, const ConfigFlags *const config);
+
+// Copy a program into memory at PROGRAM_START, returning 0 if successful and -1 if the program
+// is too big to fit in memory
+// `chip8`: the CHIP-8 system to load the program into
+// `program`: the bytes of the program
+// `size`: the number of bytes in the program
+int chip8_load(Chip8 *const chip8, const uint8_t *const program, size_t size);
+
+// Run a single 60 Hz frame: set the keys, run a frame worth of instructions and update the timers.
+// Returns the program's fault, CHIP8_ENDED if it ran off the end of memory without one, or
+// FAULT_NONE if it is still running normally.
+// `chip8`: the CHIP-8 system to run
+// `keys`: KEY_COUNT key states (non-zero for pressed), or NULL if no keys are pressed
+int chip8_run_frame(Chip8 *const chip8, const uint8_t *const keys);
+
+// Run up to `count` instructions, updating the timers every frame worth of instructions.
+// Returns the number of instructions which were run, which is less than `count` if the program
+// ended or faulted.
+// `chip8`: the CHIP-8 system to run
+// `count`: the maximum number of instructions to run
+long chip8_run_instructions(Chip8 *const chip8, long count);
+
+// Get the screen of a CHIP-8 system without copying it: DISPLAY_WIDTH * DISPLAY_HEIGHT bytes,
+// row by row, where each byte is non-zero if that pixel is on. The pointer stays valid until
+// the CHIP-8 is destroyed.
+// `chip8`: the CHIP-8 system
+const uint8_t* chip8_screen(const Chip8 *const chip8);
+
+// Get the REGISTER_COUNT general purpose registers (V0 - VF) of a CHIP-8 system without copying
+// them. The pointer stays valid until the CHIP-8 is destroyed.
+// `chip8`: the CHIP-8 system
+const uint8_t* chip8_registers(const Chip8 *const chip8);
+
+// Get the ADDRESS_COUNT bytes of a CHIP-8 system's memory without copying it. The pointer stays
+// valid until the CHIP-8 is destroyed.
+// `chip8`: the CHIP-8 system
+const uint8_t* chip8_memory(const Chip8 *const chip8);
+
+#endif
@@ -0,0 +1,497 @@
+#include "lockstep.h"
+#include "control.h"
+#include "quirks.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// The engine uses GCC vector extensions rather than intrinsics, so the same code is compiled once
+// for AVX2 and once for the baseline instruction set, and the AVX2 copy is picked at runtime.
+// Only the reductions across lanes have AVX2 specific versions.
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
+typedef uint8_t Lanes8 __attribute__((vector_size(LOCKSTEP_LANES)));
+typedef int8_t Mask8 __attribute__((vector_size(LOCKSTEP_LANES)));
+
+// 16-bit registers are stored as two vectors holding half of the lanes each, so every vector is
+// at most 256 bits wide (GCC falls back to scalar code for comparisons on wider vectors). They are
+// signed since x86 only has signed 16-bit comparisons, but the values compared (program counters
+// and instruction counts) always fit in 15 bits.
+#define HALF_LANES (LOCKSTEP_LANES / 2)
+typedef uint8_t HalfLanes8 __attribute__((vector_size(HALF_LANES)));
+typedef int8_t HalfMask8 __attribute__((vector_size(HALF_LANES)));
+typedef int16_t Lanes16 __attribute__((vector_size(HALF_LANES * 2)));
+typedef Lanes16 Mask16;
+
+// Access one lane of a 16-bit register
+#define LANE16(reg, lane) ((reg)[(lane) / HALF_LANES][(lane) % HALF_LANES])
+
+// program counter used for lanes which can't run, higher than any real one
+#define NO_PC 0x7FFF
+
+// Set the lanes of `reg` selected by `mask` (all bits set for selected lanes) to `value`
+#define ASSIGN(reg, value, mask) ((reg) = ((reg) & ~(mask)) | ((value) & (mask)))
+
+struct Lockstep {
+  Lanes8 V[REGISTER_COUNT];
+  Lanes16 I[2];
+  Lanes16 pc[2];
+  Lanes16 cycles[2]; // instructions each lane has run in the current frame
+  Mask16 halted[2]; // all bits set for lanes which faulted
+  Lanes8 delay_timer;
+  Lanes8 sound_timer;
+  Lanes8 sound_flag;
+  uint32_t dirty; // bitmask of lanes which have written to memory, so might have modified code
+  uint64_t ticks;
+  long frequency; // instructions per second, see `instruction_frequency`
+  InstructionHandler handler;
+  unsigned quirks;
+  LockstepStats stats;
+  void (*run_frame)(Lockstep *const lockstep);
+  uint8_t program[ADDRESS_COUNT]; // the memory every lane started with
+  Chip8 lanes[LOCKSTEP_LANES]; // everything besides the vector registers
+};
+
+// Copy a lane's vector registers into its Chip8
+// `registers`: bitmask of the V registers to copy (bit N = VN)
+ALWAYS_INLINE void gather_lane(Lockstep *const lockstep, int lane, uint16_t registers) {
+  Chip8 *chip8 = &lockstep->lanes[lane];
+  for (; registers; registers &= registers - 1) {
+    int r = __builtin_ctz(registers);
+    chip8->V[r] = lockstep->V[r][lane];
+  }
+  chip8->I = LANE16(lockstep->I, lane);
+  chip8->pc = LANE16(lockstep->pc, lane);
+  chip8->delay_timer = lockstep->delay_timer[lane];
+  chip8->sound_timer = lockstep->sound_timer[lane];
+}
+
+// Copy a lane's registers from its Chip8 back into the vector registers
+// `registers`: bitmask of the V registers to copy (bit N = VN)
+ALWAYS_INLINE void scatter_lane(Lockstep *const lockstep, int lane, uint16_t registers) {
+  Chip8 *chip8 = &lockstep->lanes[lane];
+  for (; registers; registers &= registers - 1) {
+    int r = __builtin_ctz(registers);
+    lockstep->V[r][lane] = chip8->V[r];
+  }
+  LANE16(lockstep->I, lane) = chip8->I;
+  LANE16(lockstep->pc, lane) = chip8->pc;
+  lockstep->delay_timer[lane] = chip8->delay_timer;
+  lockstep->sound_timer[lane] = chip8->sound_timer;
+}
+
+// Widen 8-bit lanes to 16 bits (zero extended)
+// `lanes`: the lanes to widen
+// `wide`: out parameter for both halves of the widened lanes
+ALWAYS_INLINE void widen_lanes(const Lanes8 *const lanes, Lanes16 wide[2]) {
+  HalfLanes8 halves[2];
+  memcpy(halves, lanes, sizeof(halves));
+  wide[0] = __builtin_convertvector(halves[0], Lanes16);
+  wide[1] = __builtin_convertvector(halves[1], Lanes16);
+}
+
+// Widen an 8-bit mask to 16 bits
+// `mask`: the mask to widen
+// `wide`: out parameter for both halves of the widened mask
+ALWAYS_INLINE void widen_mask(const Mask8 *const mask, Mask16 wide[2]) {
+  HalfMask8 halves[2];
+  memcpy(halves, mask, sizeof(halves));
+  wide[0] = __builtin_convertvector(halves[0], Mask16);
+  wide[1] = __builtin_convertvector(halves[1], Mask16);
+}
+
+// Narrow both halves of a 16-bit mask into one 8-bit mask
+// `wide`: the mask to narrow
+// `mask`: out parameter for the narrowed mask
+ALWAYS_INLINE void narrow_mask(const Mask16 wide[2], Mask8 *const mask) {
+  HalfMask8 halves[2] = {
+    __builtin_convertvector(wide[0], HalfMask8),
+    __builtin_convertvector(wide[1], HalfMask8),
+  };
+  memcpy(mask, halves, sizeof(*mask));
+}
+
+// Get a bitmask of the lanes selected by a mask (bit N = lane N)
+ALWAYS_INLINE uint32_t lane_bits_generic(const Mask8 *const mask) {
+  uint32_t bits = 0;
+  for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+    bits |= (uint32_t)((*mask)[lane] & 1) << lane;
+  }
+  return bits;
+}
+
+// Get the lowest program counter out of every lane
+ALWAYS_INLINE uint16_t min_pc_generic(const Lanes16 pcs[2]) {
+  Mask16 lower = pcs[0] < pcs[1];
+  Lanes16 both = (pcs[0] & lower) | (pcs[1] & ~lower);
+  int16_t min = NO_PC;
+  for (int lane = 0; lane < HALF_LANES; lane++) {
+    min = both[lane] < min ? both[lane] : min;
+  }
+  return min;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static inline uint32_t lane_bits_avx2(const Mask8 *const mask) {
+  return _mm256_movemask_epi8((__m256i)*mask);
+}
+
+__attribute__((target("avx2"))) static inline uint16_t min_pc_avx2(const Lanes16 pcs[2]) {
+  __m256i min = _mm256_min_epi16((__m256i)pcs[0], (__m256i)pcs[1]);
+  __m128i quarter = _mm_min_epi16(_mm256_castsi256_si128(min), _mm256_extracti128_si256(min, 1));
+  // every value is positive, so the unsigned minimum is the same as the signed one
+  return _mm_cvtsi128_si32(_mm_minpos_epu16(quarter));
+}
+#endif
+
+// Run an instruction on each lane in `lanes` with the interpreter
+ALWAYS_INLINE void interpret(Lockstep *const lockstep, uint32_t lanes, uint16_t instruction) {
+  // only copy the registers the instruction can use, which is every register up to X for
+  // FX55 and FX65 and otherwise just VX, VY and VF
+  uint8_t x = (instruction & OP_X) >> 8;
+  uint16_t registers = (1 << x) | (1 << ((instruction & OP_Y) >> 4)) | (1 << 0xF);
+  if ((instruction >> 12) == OP_IO
+      && ((instruction & OP_NN) == IO_SMEM || (instruction & OP_NN) == IO_LMEM)) {
+    registers = (2 << x) - 1;
+  }
+  for (uint32_t remaining = lanes; remaining; remaining &= remaining - 1) {
+    int lane = __builtin_ctz(remaining);
+    Chip8 *chip8 = &lockstep->lanes[lane];
+    gather_lane(lockstep, lane, registers);
+    // the same as `fetch_instruction`, which already happened for the whole group
+    chip8->opcode = instruction >> 12;
+    chip8->pc += 2;
+    lockstep->handler(chip8, instruction);
+    scatter_lane(lockstep, lane, registers);
+    if (chip8->fault) {
+      LANE16(lockstep->halted, lane) = -1;
+    }
+  }
+  lockstep->stats.interpreted += __builtin_popcount(lanes);
+  // only these write to memory, which might overwrite code
+  if ((instruction >> 12) == OP_IO
+      && ((instruction & OP_NN) == IO_BIN_DEC || (instruction & OP_NN) == IO_SMEM)) {
+    lockstep->dirty |= lanes;
+  }
+}
+
+// Run an ALU instruction on the lanes selected by `mask`, in the same order as exec_alu
+ALWAYS_INLINE void exec_alu_lanes(Lockstep *const lockstep, uint8_t x, uint8_t y, uint8_t n,
+    const Lanes8 *const lane_mask) {
+  Lanes8 *V = lockstep->V;
+  Lanes8 mask = *lane_mask;
+  Lanes8 result;
+  switch (n) {
+    case ALU_SET:
+      ASSIGN(V[x], V[y], mask);
+      break;
+    case ALU_OR:
+      ASSIGN(V[x], V[x] | V[y], mask);
+      break;
+    case ALU_AND:
+      ASSIGN(V[x], V[x] & V[y], mask);
+      break;
+    case ALU_XOR:
+      ASSIGN(V[x], V[x] ^ V[y], mask);
+      break;
+    case ALU_ADD:
+      result = V[x] + V[y];
+      {
+        Lanes8 carry = (Lanes8)(result < V[x]) & 1;
+        ASSIGN(V[x], result, mask);
+        ASSIGN(V[0xF], carry, mask);
+      }
+      break;
+    case ALU_SUBY:
+      result = V[x] - V[y];
+      ASSIGN(V[0xF], (Lanes8)(V[y] <= V[x]) & 1, mask);
+      ASSIGN(V[x], result, mask);
+      break;
+    case ALU_SRL:
+      if (lockstep->quirks & QUIRK_LEGACY_SHIFT) {
+        ASSIGN(V[x], V[y], mask);
+      }
+      ASSIGN(V[0xF], V[x] & 1, mask);
+      ASSIGN(V[x], V[x] >> 1, mask);
+      break;
+    case ALU_SUBX:
+      result = V[y] - V[x];
+      ASSIGN(V[0xF], (Lanes8)(V[x] <= V[y]) & 1, mask);
+      ASSIGN(V[x], result, mask);
+      break;
+    case ALU_SLL:
+      if (lockstep->quirks & QUIRK_LEGACY_SHIFT) {
+        ASSIGN(V[x], V[y], mask);
+      }
+      ASSIGN(V[0xF], (Lanes8)(V[x] >= 0x80) & 1, mask);
+      ASSIGN(V[x], V[x] << 1, mask);
+      break;
+  }
+}
+
+// Run `instruction` on the lanes selected by `mask` (also given as the bitmask `lanes`), which
+// have all just fetched it
+ALWAYS_INLINE void exec_lanes(Lockstep *const lockstep, uint16_t instruction,
+    const Mask16 mask_pc[2], const Mask8 *const mask8, uint32_t lanes) {
+  Lanes8 mask = (Lanes8)*mask8;
+  Lanes8 *V = lockstep->V;
+  uint16_t nnn = instruction & OP_NNN;
+  uint8_t nn = instruction & OP_NN;
+  uint8_t x = (instruction & OP_X) >> 8;
+  uint8_t y = (instruction & OP_Y) >> 4;
+  Lanes8 skip = { 0 };
+
+  switch (instruction >> 12) {
+    case OP_SYS:
+      if (instruction == OP_CLR_SCRN || instruction == OP_RET) {
+        interpret(lockstep, lanes, instruction);
+        return;
+      }
+      break; // other system calls do nothing
+    case OP_JUMP:
+      ASSIGN(lockstep->pc[0], (Lanes16){ 0 } + nnn, mask_pc[0]);
+      ASSIGN(lockstep->pc[1], (Lanes16){ 0 } + nnn, mask_pc[1]);
+      return;
+    case OP_BEQI:
+      skip = (Lanes8)(V[x] == nn);
+      break;
+    case OP_BNEI:
+      skip = (Lanes8)(V[x] != nn);
+      break;
+    case OP_BEQ:
+      skip = (Lanes8)(V[x] == V[y]);
+      break;
+    case OP_BNE:
+      skip = (Lanes8)(V[x] != V[y]);
+      break;
+    case OP_LI:
+      ASSIGN(V[x], (Lanes8){ 0 } + nn, mask);
+      break;
+    case OP_ADDI:
+      ASSIGN(V[x], V[x] + nn, mask);
+      break;
+    case OP_ALU:
+      exec_alu_lanes(lockstep, x, y, instruction & OP_N, &mask);
+      break;
+    case OP_SET_IDX:
+      ASSIGN(lockstep->I[0], (Lanes16){ 0 } + nnn, mask_pc[0]);
+      ASSIGN(lockstep->I[1], (Lanes16){ 0 } + nnn, mask_pc[1]);
+      break;
+    case OP_JO: {
+      Lanes16 offset[2];
+      widen_lanes(lockstep->quirks & QUIRK_JUMP ? &V[x] : &V[0], offset);
+      ASSIGN(lockstep->pc[0], offset[0] + nnn, mask_pc[0]);
+      ASSIGN(lockstep->pc[1], offset[1] + nnn, mask_pc[1]);
+      return;
+    }
+    default: // calls, random numbers, drawing, keys and IO all use per-lane state
+      interpret(lockstep, lanes, instruction);
+      return;
+  }
+
+  // move past the instruction, and past the next one too for lanes which are skipping it
+  Mask16 skip_pc[2];
+  widen_mask((Mask8 *)&skip, skip_pc);
+  for (int h = 0; h < 2; h++) {
+    lockstep->pc[h] += (mask_pc[h] & 2) + (skip_pc[h] & mask_pc[h] & 2);
+  }
+}
+
+// Run one frame on every lane, see `lockstep_run_frame`
+// `avx2`: whether to use the AVX2 reductions, only set when compiling for AVX2
+ALWAYS_INLINE void run_frame_lanes(Lockstep *const lockstep, const bool avx2) {
+  int16_t budget = frame_instructions(lockstep->ticks, lockstep->frequency);
+  lockstep->cycles[0] = (Lanes16){ 0 };
+  lockstep->cycles[1] = (Lanes16){ 0 };
+
+  while (1) {
+    Mask16 runnable[2];
+    Lanes16 candidates[2];
+    for (int h = 0; h < 2; h++) {
+      runnable[h] = (lockstep->cycles[h] < budget) & (lockstep->pc[h] < ADDRESS_COUNT)
+        & ~lockstep->halted[h];
+      // run the lanes furthest behind first, so the others wait for them to catch up
+      candidates[h] = (lockstep->pc[h] & runnable[h]) | (NO_PC & ~runnable[h]);
+    }
+    uint16_t leader;
+#if defined(__x86_64__) || defined(__i386__)
+    if (avx2) {
+      leader = min_pc_avx2(candidates);
+    } else
+#endif
+    {
+      leader = min_pc_generic(candidates);
+    }
+    if (leader == NO_PC) {
+      break;
+    }
+
+    Mask16 mask[2] = {
+      runnable[0] & (lockstep->pc[0] == (int16_t)leader),
+      runnable[1] & (lockstep->pc[1] == (int16_t)leader),
+    };
+    Mask8 mask8;
+    narrow_mask(mask, &mask8);
+    uint32_t lanes;
+#if defined(__x86_64__) || defined(__i386__)
+    if (avx2) {
+      lanes = lane_bits_avx2(&mask8);
+    } else
+#endif
+    {
+      lanes = lane_bits_generic(&mask8);
+    }
+
+    if (leader + 1 >= ADDRESS_COUNT) {
+      // the same fault `fetch_instruction` gives, which still counts as an instruction
+      for (uint32_t remaining = lanes; remaining; remaining &= remaining - 1) {
+        lockstep->lanes[__builtin_ctz(remaining)].fault = FAULT_BAD_PC;
+      }
+      for (int h = 0; h < 2; h++) {
+        lockstep->cycles[h] -= mask[h]; // the mask is -1 for every lane running
+        lockstep->halted[h] |= mask[h];
+      }
+      lockstep->stats.steps++;
+      lockstep->stats.lane_instructions += __builtin_popcount(lanes);
+      continue;
+    }
+
+    // Lanes which wrote to memory might have different code, so only the lanes which have the
+    // same instruction as the first one run it now. The rest will lead a later step.
+    int first = __builtin_ctz(lanes);
+    const uint8_t *code = lockstep->dirty & (1u << first)
+      ? lockstep->lanes[first].memory : lockstep->program;
+    uint16_t instruction = code[leader] << 8 | code[leader + 1];
+    uint32_t dirty = lockstep->dirty & lanes;
+    if (dirty) {
+      bool clean_match = code == lockstep->program
+        || (lockstep->program[leader] == code[leader]
+            && lockstep->program[leader + 1] == code[leader + 1]);
+      uint32_t mismatched = clean_match ? 0 : lanes & ~lockstep->dirty;
+      for (uint32_t remaining = dirty; remaining; remaining &= remaining - 1) {
+        int lane = __builtin_ctz(remaining);
+        const uint8_t *memory = lockstep->lanes[lane].memory;
+        if (memory[leader] != code[leader] || memory[leader + 1] != code[leader + 1]) {
+          mismatched |= 1u << lane;
+        }
+      }
+      for (uint32_t remaining = mismatched; remaining; remaining &= remaining - 1) {
+        int lane = __builtin_ctz(remaining);
+        LANE16(mask, lane) = 0;
+        mask8[lane] = 0;
+      }
+      lanes &= ~mismatched;
+    }
+
+    lockstep->stats.steps++;
+    lockstep->stats.lane_instructions += __builtin_popcount(lanes);
+    lockstep->cycles[0] -= mask[0]; // the mask is -1 for every lane running
+    lockstep->cycles[1] -= mask[1];
+    exec_lanes(lockstep, instruction, mask, &mask8, lanes);
+  }
+
+  // the same as `chip8_decrement_timers` on every lane
+  lockstep->ticks++;
+  lockstep->sound_flag |= (Lanes8)(lockstep->sound_timer != 0) & 1;
+  lockstep->delay_timer -= (Lanes8)(lockstep->delay_timer != 0) & 1;
+  lockstep->sound_timer -= (Lanes8)(lockstep->sound_timer != 0) & 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static void run_frame_avx2(Lockstep *const lockstep) {
+  run_frame_lanes(lockstep, true);
+}
+#endif
+
+static void run_frame_generic(Lockstep *const lockstep) {
+  run_frame_lanes(lockstep, false);
+}
+
+Lockstep* lockstep_create(const ConfigFlags *const config, const uint8_t *const program,
+    size_t size) {
+  // every lane runs the same number of instructions each frame, which cycle timing doesn't allow,
+  // and the lanes count them in 16 bits
+  if (size > ADDRESS_COUNT - PROGRAM_START || config->vip_timing || config->display_wait
+      || instruction_frequency(config) / TIMER_FREQUENCY >= INT16_MAX) {
+    return NULL;
+  }
+  // the vector registers need to be aligned to their size
+  size_t bytes = (sizeof(Lockstep) + 63) / 64 * 64;
+  Lockstep *lockstep = aligned_alloc(64, bytes);
+  if (lockstep == NULL) {
+    return NULL;
+  }
+  memset(lockstep, 0, bytes);
+
+  Chip8 *chip8 = chip8_init();
+  chip8->config = *config;
+  memcpy(chip8->memory + PROGRAM_START, program, size);
+  memcpy(lockstep->program, chip8->memory, ADDRESS_COUNT);
+  for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+    lockstep_write_lane(lockstep, lane, chip8);
+  }
+  chip8_destroy(chip8);
+
+  lockstep->quirks = quirk_mask(config);
+  lockstep->frequency = instruction_frequency(config);
+  lockstep->handler = select_instruction_handler(config);
+  lockstep->run_frame = run_frame_generic;
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_cpu_supports("avx2")) {
+    lockstep->run_frame = run_frame_avx2;
+  }
+#endif
+  return lockstep;
+}
+
+void lockstep_destroy(Lockstep *lockstep) {
+  free(lockstep);
+}
+
+void lockstep_use_generic(Lockstep *const lockstep) {
+  lockstep->run_frame = run_frame_generic;
+}
+
+void lockstep_read_lane(const Lockstep *const lockstep, int lane, Chip8 *const state) {
+  *state = lockstep->lanes[lane];
+  for (int r = 0; r < REGISTER_COUNT; r++) {
+    state->V[r] = lockstep->V[r][lane];
+  }
+  state->I = LANE16(lockstep->I, lane);
+  state->pc = LANE16(lockstep->pc, lane);
+  state->delay_timer = lockstep->delay_timer[lane];
+  state->sound_timer = lockstep->sound_timer[lane];
+  state->sound_flag = lockstep->sound_flag[lane];
+  state->ticks = lockstep->ticks;
+  state->frame_cycles = 0;
+}
+
+void lockstep_write_lane(Lockstep *const lockstep, int lane, const Chip8 *const state) {
+  lockstep->lanes[lane] = *state;
+  scatter_lane(lockstep, lane, 0xFFFF);
+  lockstep->sound_flag[lane] = state->sound_flag;
+  LANE16(lockstep->halted, lane) = state->fault ? -1 : 0;
+  // the new memory might not match the program the other lanes share
+  if (memcmp(state->memory, lockstep->program, ADDRESS_COUNT) != 0) {
+    lockstep->dirty |= 1u << lane;
+  } else {
+    lockstep->dirty &= ~(1u << lane);
+  }
+}
+
+void lockstep_set_keys(Lockstep *const lockstep, int lane, uint16_t keys) {
+  for (int key = 0; key < KEY_COUNT; key++) {
+    lockstep->lanes[lane].key[key] = (keys >> key) & 1;
+  }
+}
+
+void lockstep_run_frame(Lockstep *const lockstep) {
+  lockstep->run_frame(lockstep);
+}
+
+LockstepStats lockstep_stats(const Lockstep *const lockstep) {
+  return lockstep->stats;
+}
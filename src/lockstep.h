@@ -0,0 +1,81 @@
+#ifndef LOCKSTEP
+#define LOCKSTEP
+
+#include "chip8.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// A lockstep engine runs many copies ("lanes") of the same program at once, for sweeps over
+// different inputs or starting states. The registers, I, pc and timers of every lane are stored
+// as vectors (structure of arrays), so while the lanes' program counters agree, one instruction
+// runs on every lane with a few vector operations. Lanes which branch differently are masked off,
+// and they join back up once their program counters meet again (the lanes furthest behind in the
+// program always run first). On CPUs with AVX2, every 8-bit register of all 32 lanes fits in one
+// vector, and the 16-bit ones (I and pc) in two.
+//
+// Memory, the screen, the stack and the keys stay in one Chip8 per lane. Instructions which
+// mostly work on those (drawing, calls, key and IO instructions, random numbers) run on each lane
+// with the regular interpreter, so lanes always end up in the same state as a Chip8 running
+// `exec_frame`, random numbers included (each lane's Chip8 has its own generator).
+#define LOCKSTEP_LANES 32
+
+typedef struct Lockstep Lockstep;
+
+typedef struct LockstepStats {
+  uint64_t steps; // number of times an instruction was run on a group of lanes
+  uint64_t lane_instructions; // instructions run summed over every lane
+  uint64_t interpreted; // lane instructions which ran on the interpreter instead of as vectors
+} LockstepStats;
+
+// Create a lockstep engine with every lane holding a freshly initialized CHIP-8 with `program`
+// loaded, returning NULL if the program doesn't fit in memory or `config` uses VIP timing or
+// display wait (lanes all run at the same flat instruction rate), or an instruction frequency of
+// over 32767 instructions per frame.
+// NOTE: This function uses memory allocation. It is expected that `lockstep_destroy` will be
+// called when the engine is no longer needed in order to free that memory.
+//
+// `config`: the quirks every lane runs with
+// `program`: the program to run
+// `size`: the size of the program in bytes
+Lockstep* lockstep_create(const ConfigFlags *const config, const uint8_t *const program,
+    size_t size);
+
+// Free the memory used by a lockstep engine
+// `lockstep`: the engine to free
+void lockstep_destroy(Lockstep *lockstep);
+
+// Make an engine use the baseline instruction set even on a CPU with AVX2, which it otherwise
+// picks when it's available, e.g. to check that both give the same results
+// `lockstep`: the engine to change
+void lockstep_use_generic(Lockstep *const lockstep);
+
+// Copy the full state of a lane into a Chip8, e.g. to hash or display it
+// `lockstep`: the engine holding the lane
+// `lane`: the index of the lane, from 0 to LOCKSTEP_LANES - 1
+// `state`: out parameter for the state of the lane
+void lockstep_read_lane(const Lockstep *const lockstep, int lane, Chip8 *const state);
+
+// Replace the state of a lane, e.g. to give each lane different starting registers. The lane
+// keeps running in step with the others, so `ticks` and `frame_cycles` are ignored.
+// `lockstep`: the engine holding the lane
+// `lane`: the index of the lane, from 0 to LOCKSTEP_LANES - 1
+// `state`: the new state of the lane
+void lockstep_write_lane(Lockstep *const lockstep, int lane, const Chip8 *const state);
+
+// Set which keys are held down on a lane
+// `lockstep`: the engine holding the lane
+// `lane`: the index of the lane, from 0 to LOCKSTEP_LANES - 1
+// `keys`: bitmask of the keys held down (bit N = key N)
+void lockstep_set_keys(Lockstep *const lockstep, int lane, uint16_t keys);
+
+// Run one 60 Hz frame on every lane and then update their timers, the same as `exec_frame`.
+// Lanes which faulted or ran off the end of memory stop running.
+// `lockstep`: the engine to run
+void lockstep_run_frame(Lockstep *const lockstep);
+
+// Get how well the lanes have stayed together so far. The average number of lanes running each
+// instruction is `lane_instructions / steps`.
+// `lockstep`: the engine to get the stats of
+LockstepStats lockstep_stats(const Lockstep *const lockstep);
+
+#endif
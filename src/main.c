@@ -1,7 +1,18 @@
+#include "capture.h"
+#include "chip8-log.h"
 #include "chip8.h"
 #include "control.h"
+#include "frontend.h"
+#include "metrics.h"
+#include "netplay.h"
+#include "pack.h"
+#include "perf.h"
+#include "quirk-detect.h"
+#include "stream.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_log.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <time.h>
 #include <unistd.h>
 #include "view.h"
@@ -21,11 +32,103 @@ static inline int old_indexing(char* str) {
   return strncmp(str, "--old-index", 12) == 0;
 }
 
+static inline int detect(char* str) {
+  return strncmp(str, "--detect-quirks", 16) == 0;
+}
+
 static inline int debug(char* str) {
   // TODO - work out parsing for shorthand notation (-d)
   return strncmp(str, "--debug", 8) == 0;
 }
 
+static inline int vip(char* str) {
+  return strncmp(str, "--vip", 6) == 0;
+}
+
+static inline int display_wait(char* str) {
+  return strncmp(str, "--display-wait", 15) == 0;
+}
+
+static inline int headless(char* str) {
+  return strncmp(str, "--headless", 11) == 0;
+}
+
+static inline int unthrottled(char* str) {
+  return strncmp(str, "--unthrottled", 14) == 0;
+}
+
+static inline int capture(char* str) {
+  return strncmp(str, "--capture", 10) == 0;
+}
+
+static inline int stream(char* str) {
+  return strncmp(str, "--stream", 9) == 0;
+}
+
+static inline int metrics(char* str) {
+  return strncmp(str, "--metrics", 10) == 0;
+}
+
+static inline int run_ahead(char* str) {
+  return strncmp(str, "--run-ahead", 12) == 0;
+}
+
+static inline int scale(char* str) {
+  return strncmp(str, "--scale", 8) == 0;
+}
+
+static inline int phosphor(char* str) {
+  return strncmp(str, "--phosphor", 11) == 0;
+}
+
+static inline int scanlines(char* str) {
+  return strncmp(str, "--scanlines", 12) == 0;
+}
+
+static inline int pack(char* str) {
+  return strncmp(str, "--pack", 7) == 0;
+}
+
+static inline int ips(char* str) {
+  return strncmp(str, "--ips", 6) == 0;
+}
+
+static inline int watch(char* str) {
+  return strncmp(str, "--watch", 8) == 0;
+}
+
+static inline int watch_compare(char* str) {
+  return strncmp(str, "--watch-compare", 16) == 0;
+}
+
+static inline int perf(char* str) {
+  return strncmp(str, "--perf", 7) == 0;
+}
+
+static inline int perf_classes(char* str) {
+  return strncmp(str, "--perf-classes", 15) == 0;
+}
+
+static inline int netplay(char* str) {
+  return strncmp(str, "--netplay", 10) == 0;
+}
+
+static inline int net_delay(char* str) {
+  return strncmp(str, "--net-delay", 12) == 0;
+}
+
+static inline int net_jitter(char* str) {
+  return strncmp(str, "--net-jitter", 13) == 0;
+}
+
+static inline int net_loss(char* str) {
+  return strncmp(str, "--net-loss", 11) == 0;
+}
+
+static inline int cycles(char* str) {
+  return strncmp(str, "--cycles", 9) == 0;
+}
+
 void free_memory(Chip8* chip8, int flags) {
   chip8_destroy(chip8);
   SDL_QuitSubSystem(flags);
@@ -39,50 +142,287 @@ void help_menu() {
   printf("--old-shift\tIf enabled, copy VY into VX before doing bit shifts\n");
   printf("--jump-quirk\tIf enabled, use VX instead of V0 in 0xBNNN instruction\n");
   printf("--old-index\tIf enabled, increment index register when loading/storing memory\n");
+  printf("--detect-quirks\tTry the program with every combination of quirks and use the one it seems to need\n");
+  printf("--vip\t\tRun at the speed of the COSMAC VIP, timing each instruction by its cost on it\n");
+  printf("--display-wait\tWait for the next frame after drawing a sprite, like the COSMAC VIP\n");
+  printf("--headless\tRun without opening a window, playing sound or reading the keyboard\n");
+  printf("--unthrottled\tRun as fast as possible instead of at 700 instructions per second\n");
+  printf("--capture [file]\tRecord every frame drawn to a capture file\n");
+  printf("--stream [address]\tPublish the screen and accept key presses on unix:[path] or tcp:[port]\n");
+  printf("--metrics [file]\tWrite performance metrics to a file every second, in Prometheus format\n");
+  printf("--run-ahead [n]\tShow the screen from n frames in the future to hide input latency\n");
+  printf("--scale [n]\tStart with a window n times the size of the CHIP-8 screen (default 15)\n");
+  printf("--phosphor [fraction]\tFade pixels out, keeping this fraction of their brightness each frame\n");
+  printf("--scanlines\tDarken the gaps between rows of pixels, like a CRT\n");
+  printf("--pack [file]\tLoad the ROM from a pack by name or hash, or look up the profile of a ROM file in it\n");
+  printf("--ips [n]\tRun n instructions per second instead of 700\n");
+  printf("--watch\t\tReload the program whenever its file changes, without closing the window\n");
+  printf("--watch-compare\tLike --watch, also comparing each reload with the state before it\n");
+  printf("--perf\t\tCount cycles, instructions, branch misses and cache misses with the CPU's counters\n");
+  printf("--perf-classes\tLike --perf, also counting each class of instruction separately (much slower)\n");
+  printf("--netplay [port] [host:port]\tPlay with a peer over UDP, receiving on port and sending to host:port\n");
+  printf("--net-delay [ms]\tDelay every packet sent to the peer, to try netplay out locally\n");
+  printf("--net-jitter [ms]\tDelay each packet sent to the peer by up to this much more at random\n");
+  printf("--net-loss [percent]\tDrop this percentage of the packets sent to the peer\n");
+  printf("--cycles [n]\tStop running after n cycles\n");
 }
 
 int main(int argc, char* argv[]) {
-  int sdl_flags = SDL_INIT_AUDIO | SDL_INIT_TIMER;
-  SDL_Init(sdl_flags);
-  
   // using calloc to make sure everything is 0-initialized
   Chip8 *chip8 = chip8_init();
 
-  srand(time(NULL));
-
   char* filepath = NULL;
+  char* capture_path = NULL;
+  char* stream_address = NULL;
+  char* metrics_path = NULL;
+  int run_ahead_frames = 0;
+  double window_scale = DEFAULT_SCALE;
+  float persistence = 0;
+  bool draw_scanlines = false;
+  bool detect_program_quirks = false;
+  char* pack_path = NULL;
+  bool watch_program = false;
+  bool keep_previous = false;
+  bool count_events = false;
+  bool count_classes = false;
+  int netplay_port = 0;
+  char* netplay_peer = NULL;
+  NetplayShim shim = { 0 };
   for (int i = 1; i < argc; i++) {
     if (debug(argv[i])) {
       chip8->config.debug = 1;
       SDL_LogSetAllPriority(SDL_LOG_PRIORITY_DEBUG);
+      chip8_set_log_handler(frontend_log);
     } else if (old_shift(argv[i])) {
       chip8->config.legacy_shift = 1;
     } else if (jump_quirk(argv[i])) {
       chip8->config.jump_quirk = 1;
     }  else if (old_indexing(argv[i])) {
       chip8->config.legacy_indexing = 1;
+    } else if (detect(argv[i])) {
+      detect_program_quirks = true;
+    } else if (vip(argv[i])) {
+      // the VIP's interpreter always waits for the display before drawing
+      chip8->config.vip_timing = 1;
+      chip8->config.display_wait = 1;
+    } else if (display_wait(argv[i])) {
+      chip8->config.display_wait = 1;
+    } else if (headless(argv[i])) {
+      chip8->config.headless = 1;
+    } else if (unthrottled(argv[i])) {
+      chip8->config.unthrottled = 1;
+    } else if (capture(argv[i]) && i + 1 < argc) {
+      capture_path = argv[++i];
+    } else if (stream(argv[i]) && i + 1 < argc) {
+      stream_address = argv[++i];
+    } else if (metrics(argv[i]) && i + 1 < argc) {
+      metrics_path = argv[++i];
+    } else if (run_ahead(argv[i]) && i + 1 < argc) {
+      run_ahead_frames = atoi(argv[++i]);
+    } else if (scale(argv[i]) && i + 1 < argc) {
+      window_scale = atof(argv[++i]);
+    } else if (phosphor(argv[i]) && i + 1 < argc) {
+      persistence = atof(argv[++i]);
+    } else if (scanlines(argv[i])) {
+      draw_scanlines = true;
+    } else if (pack(argv[i]) && i + 1 < argc) {
+      pack_path = argv[++i];
+    } else if (ips(argv[i]) && i + 1 < argc) {
+      chip8->config.instruction_frequency = atol(argv[++i]);
+    } else if (watch(argv[i])) {
+      watch_program = true;
+    } else if (watch_compare(argv[i])) {
+      watch_program = true;
+      keep_previous = true;
+    } else if (perf(argv[i])) {
+      count_events = true;
+    } else if (perf_classes(argv[i])) {
+      count_events = true;
+      count_classes = true;
+    } else if (netplay(argv[i]) && i + 2 < argc) {
+      netplay_port = atoi(argv[++i]);
+      netplay_peer = argv[++i];
+    } else if (net_delay(argv[i]) && i + 1 < argc) {
+      shim.delay_ms = atoi(argv[++i]);
+    } else if (net_jitter(argv[i]) && i + 1 < argc) {
+      shim.jitter_ms = atoi(argv[++i]);
+    } else if (net_loss(argv[i]) && i + 1 < argc) {
+      shim.loss_percent = atoi(argv[++i]);
+    } else if (cycles(argv[i]) && i + 1 < argc) {
+      chip8->config.cycle_limit = atol(argv[++i]);
     } else {
       filepath = argv[i];
     }
   }
 
-  // try to load the file in
-  if (filepath == NULL || load_program(chip8, filepath) == -1) {
-    fprintf(stderr, "Unable to load program - error loading file");
-    help_menu();
-    free_memory(chip8, sdl_flags);
-    exit(-1);
+  // headless runs only need SDL for its timer, so they work without a display server
+  int sdl_flags = chip8->config.headless ? SDL_INIT_TIMER : SDL_INIT_AUDIO | SDL_INIT_TIMER;
+  SDL_Init(sdl_flags);
+
+  Pack *rom_pack = NULL;
+  const PackEntry *entry = NULL;
+  if (pack_path != NULL) {
+    rom_pack = pack_open(pack_path);
+    if (rom_pack == NULL) {
+      fprintf(stderr, "Unable to open pack %s\n", pack_path);
+      free_memory(chip8, sdl_flags);
+      exit(-1);
+    }
+    entry = filepath ? pack_lookup(rom_pack, filepath) : NULL;
+  }
+
+  // try to load the file in, unless it's in the pack
+  bool from_pack = entry != NULL;
+  if (from_pack) {
+    pack_load(rom_pack, entry, chip8);
+  } else {
+    int size = filepath ? load_program(chip8, filepath) : -1;
+    if (size == -1) {
+      fprintf(stderr, "Unable to load program - error loading file");
+      help_menu();
+      if (rom_pack) {
+        pack_close(rom_pack);
+      }
+      free_memory(chip8, sdl_flags);
+      exit(-1);
+    }
+    // ROM files can still have a profile in the pack, found by their contents
+    entry = rom_pack ? pack_find(rom_pack, pack_hash(chip8->memory + PROGRAM_START, size)) : NULL;
+  }
+  if (entry != NULL) {
+    pack_configure(entry, &chip8->config);
+  }
+
+  if (detect_program_quirks) {
+    QuirkReport reports[VARIANT_COUNT];
+    int quirks = detect_quirks(chip8, reports);
+    if (quirks == -1) {
+      fprintf(stderr, "Unable to detect the program's quirks\n");
+    } else {
+      print_quirk_reports(stdout, reports, quirks);
+      char options[64];
+      quirk_options(quirks, options, sizeof(options));
+      printf("Running with quirks: %s\n", options);
+#define SET_QUIRK(field, bit) chip8->config.field = (quirks & (bit)) != 0;
+      QUIRK_LIST(SET_QUIRK)
+#undef SET_QUIRK
+    }
   }
 
-  View *view = view_init(DISPLAY_WIDTH, DISPLAY_HEIGHT, 15, "CHIP-8 Interpreter");
+  // both peers of a netplay session have to draw the same random numbers
+  chip8_seed(chip8, netplay_peer ? 0 : time(NULL));
+
+  Frontend frontend = { 0 };
+  frontend.run_ahead.frames = run_ahead_frames > 0 ? run_ahead_frames : 0;
+  if (netplay_peer) {
+    frontend.netplay = netplay_open(netplay_port, netplay_peer, chip8, &shim);
+    if (frontend.netplay == NULL) {
+      fprintf(stderr, "Unable to start netplay on port %d with %s\n", netplay_port, netplay_peer);
+      if (rom_pack) {
+        pack_close(rom_pack);
+      }
+      free_memory(chip8, sdl_flags);
+      exit(-1);
+    }
+  }
+  // a reload would leave the peer running the old program
+  if (watch_program && frontend.netplay) {
+    fprintf(stderr, "Programs can't be reloaded during netplay, running without --watch\n");
+  } else if (watch_program) {
+    // programs in packs don't have a file of their own to watch
+    frontend.reload.watch = from_pack ? NULL : watch_open(filepath);
+    frontend.reload.path = filepath;
+    frontend.reload.keep_previous = keep_previous;
+    if (frontend.reload.watch == NULL) {
+      fprintf(stderr, "Unable to watch %s for changes\n", filepath);
+    }
+  }
+  if (count_events) {
+    frontend.perf.perf = perf_open();
+    frontend.perf.by_class = count_classes && frontend.perf.perf;
+    if (frontend.perf.perf == NULL) {
+      fprintf(stderr, "Hardware counters aren't available (%s), running without them\n",
+          perf_unavailable_reason(errno));
+    }
+  }
+  // metrics are cheap to keep, and the window's overlay can show them at any time
+  frontend.metrics = metrics_init();
+  if (!chip8->config.headless) {
+    frontend.view = view_init(DISPLAY_WIDTH, DISPLAY_HEIGHT,
+        window_scale > 0 ? window_scale : DEFAULT_SCALE, "CHIP-8 Interpreter");
+    view_set_metrics(frontend.view, frontend.metrics);
+    if (entry != NULL) {
+      view_set_key_map(frontend.view, entry->key_map, KEY_COUNT);
+    }
+    if ((persistence > 0 || draw_scanlines)
+        && view_set_phosphor(frontend.view, persistence, draw_scanlines) == -1) {
+      fprintf(stderr, "Unable to set up the phosphor renderer\n");
+    }
+  }
+  MetricsExporter *exporter = NULL;
+  if (metrics_path != NULL) {
+    exporter = metrics_export_start(frontend.metrics, metrics_path, 1000);
+    if (exporter == NULL) {
+      fprintf(stderr, "Unable to start exporting metrics to %s\n", metrics_path);
+    }
+  }
+  if (capture_path != NULL) {
+    // unthrottled programs have no deadline to keep, so they can wait for every frame to be saved
+    frontend.capture = capture_open(capture_path, DISPLAY_WIDTH, DISPLAY_HEIGHT,
+        chip8->config.unthrottled);
+    if (frontend.capture == NULL) {
+      fprintf(stderr, "Unable to open capture file %s\n", capture_path);
+    }
+  }
+  if (stream_address != NULL) {
+    frontend.stream = stream_open(stream_address);
+    if (frontend.stream == NULL) {
+      fprintf(stderr, "Unable to listen for stream clients on %s\n", stream_address);
+    }
+  }
   
-  int result = exec_program(chip8, view);
+  int result = exec_program(chip8, &frontend);
 
   // A quit signal should be a successful result, that just indicates the user
   // closed the program
   result = result == QUIT_SIGNAL ? 0 : result;
  
-  view_destroy(view);
+  if (frontend.capture) {
+    long dropped = capture_close(frontend.capture);
+    if (dropped) {
+      fprintf(stderr, "%ld frames were dropped from the capture\n", dropped);
+    }
+  }
+  if (frontend.stream) {
+    stream_close(frontend.stream);
+  }
+  if (frontend.view) {
+    view_destroy(frontend.view);
+  }
+  if (frontend.reload.watch) {
+    watch_close(frontend.reload.watch);
+  }
+  if (exporter) {
+    metrics_export_stop(exporter);
+  }
+  if (frontend.perf.perf) {
+    perf_close(frontend.perf.perf);
+  }
+  if (frontend.netplay) {
+    const NetplayStats *stats = netplay_stats(frontend.netplay);
+    printf("Netplay: %" PRIu64 " frames, %" PRIu64 " rollbacks re-running %" PRIu64
+        " frames (at most %d at once), %" PRIu64 " frames waiting for the peer\n", stats->frames,
+        stats->rollbacks, stats->resimulated, stats->max_rollback, stats->waits);
+    if (stats->desync_frame != -1) {
+      fprintf(stderr, "Netplay: the peers' states differed after frame %" PRId64 "\n",
+          stats->desync_frame);
+    }
+    netplay_close(frontend.netplay);
+  }
+  metrics_destroy(frontend.metrics);
+  if (rom_pack) {
+    pack_close(rom_pack);
+  }
   free_memory(chip8, sdl_flags);
   return result;
 }
@@ -0,0 +1,161 @@
+#include "metrics.h"
+#include "chip8-timer.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct MetricsExporter {
+  Metrics *metrics;
+  char *path;
+  char *temp_path;
+  int interval_ms;
+  uint64_t start_us;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t stop_signal;
+  bool stopping;
+};
+
+Metrics* metrics_init() {
+  return calloc(1, sizeof(Metrics));
+}
+
+void metrics_destroy(Metrics *metrics) {
+  free(metrics);
+}
+
+void metrics_observe(Histogram *const histogram, uint64_t value_us) {
+  // the bucket is the number of bits needed to represent the value
+  int bucket = value_us ? 64 - __builtin_clzll(value_us) : 0;
+  if (bucket >= HISTOGRAM_BUCKETS) {
+    bucket = HISTOGRAM_BUCKETS - 1;
+  }
+  metrics_add(&histogram->buckets[bucket], 1);
+  metrics_add(&histogram->count, 1);
+  metrics_add(&histogram->sum, value_us);
+}
+
+static void write_counter(FILE *file, const char *name, const char *help, _Atomic uint64_t *value) {
+  fprintf(file, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+      name, help, name, name, (unsigned long)atomic_load_explicit(value, memory_order_relaxed));
+}
+
+static void write_histogram(FILE *file, const char *name, const char *help, Histogram *histogram) {
+  fprintf(file, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+  uint64_t cumulative = 0;
+  for (int bucket = 0; bucket < HISTOGRAM_BUCKETS - 1; bucket++) {
+    cumulative += atomic_load_explicit(&histogram->buckets[bucket], memory_order_relaxed);
+    fprintf(file, "%s_bucket{le=\"%g\"} %lu\n",
+        name, (double)(1ULL << bucket) / 1000000, (unsigned long)cumulative);
+  }
+  // the count is read last so the +Inf bucket is never below any of the others
+  uint64_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+  fprintf(file, "%s_bucket{le=\"+Inf\"} %lu\n", name,
+      (unsigned long)(count > cumulative ? count : cumulative));
+  fprintf(file, "%s_sum %g\n", name,
+      (double)atomic_load_explicit(&histogram->sum, memory_order_relaxed) / 1000000);
+  fprintf(file, "%s_count %lu\n", name, (unsigned long)(count > cumulative ? count : cumulative));
+}
+
+void metrics_write_prometheus(Metrics *const metrics, FILE *file, double elapsed_s) {
+  write_counter(file, "chip8_instructions_total", "Instructions executed",
+      &metrics->instructions);
+  write_counter(file, "chip8_frames_total", "Timer updates (60 Hz frames)", &metrics->frames);
+  write_counter(file, "chip8_presents_total", "Screens drawn to the window", &metrics->presents);
+  write_counter(file, "chip8_audio_callbacks_total", "Audio buffers requested by the device",
+      &metrics->audio_callbacks);
+  write_counter(file, "chip8_audio_underruns_total", "Audio buffers requested too late",
+      &metrics->audio_underruns);
+  write_counter(file, "chip8_run_ahead_frames_total", "Frames run speculatively for run-ahead",
+      &metrics->run_ahead_frames);
+
+  double instructions = atomic_load_explicit(&metrics->instructions, memory_order_relaxed);
+  fprintf(file, "# HELP chip8_instructions_per_second Average instructions executed per second\n");
+  fprintf(file, "# TYPE chip8_instructions_per_second gauge\n");
+  fprintf(file, "chip8_instructions_per_second %g\n", elapsed_s > 0 ? instructions / elapsed_s : 0);
+
+  write_histogram(file, "chip8_frame_interval_seconds", "Time between timer updates",
+      &metrics->frame_interval);
+  write_histogram(file, "chip8_timer_lag_seconds", "Delay of timer updates past 1/60 s",
+      &metrics->timer_lag);
+  write_histogram(file, "chip8_present_seconds", "Time taken to draw a screen to the window",
+      &metrics->present_time);
+  write_histogram(file, "chip8_input_read_latency_seconds",
+      "Time from a key edge to the first instruction checking that key", &metrics->input_read);
+  write_histogram(file, "chip8_input_present_latency_seconds",
+      "Time from a key edge to the first screen presented after it was checked",
+      &metrics->input_present);
+  write_histogram(file, "chip8_run_ahead_seconds",
+      "Time taken to run ahead, present and roll back each frame", &metrics->run_ahead_time);
+}
+
+// Write the metrics to a temporary file and rename it over the real one
+static void export_metrics(MetricsExporter *const exporter) {
+  FILE *file = fopen(exporter->temp_path, "w");
+  if (file == NULL) {
+    return;
+  }
+  double elapsed_s = (double)(current_time_us() - exporter->start_us) / 1000000;
+  metrics_write_prometheus(exporter->metrics, file, elapsed_s);
+  fclose(file);
+  rename(exporter->temp_path, exporter->path);
+}
+
+static void* export_thread(void *data) {
+  MetricsExporter *exporter = data;
+  pthread_mutex_lock(&exporter->lock);
+  while (!exporter->stopping) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += exporter->interval_ms / 1000;
+    deadline.tv_nsec += (long)(exporter->interval_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&exporter->stop_signal, &exporter->lock, &deadline);
+    pthread_mutex_unlock(&exporter->lock);
+    export_metrics(exporter);
+    pthread_mutex_lock(&exporter->lock);
+  }
+  pthread_mutex_unlock(&exporter->lock);
+  return NULL;
+}
+
+MetricsExporter* metrics_export_start(Metrics *const metrics, const char *path, int interval_ms) {
+  MetricsExporter *exporter = calloc(1, sizeof(MetricsExporter));
+  exporter->metrics = metrics;
+  exporter->path = strdup(path);
+  exporter->temp_path = malloc(strlen(path) + 5);
+  sprintf(exporter->temp_path, "%s.tmp", path);
+  exporter->interval_ms = interval_ms;
+  exporter->start_us = current_time_us();
+  pthread_mutex_init(&exporter->lock, NULL);
+  pthread_cond_init(&exporter->stop_signal, NULL);
+  if (pthread_create(&exporter->thread, NULL, export_thread, exporter)) {
+    pthread_mutex_destroy(&exporter->lock);
+    pthread_cond_destroy(&exporter->stop_signal);
+    free(exporter->path);
+    free(exporter->temp_path);
+    free(exporter);
+    return NULL;
+  }
+  return exporter;
+}
+
+void metrics_export_stop(MetricsExporter *exporter) {
+  pthread_mutex_lock(&exporter->lock);
+  exporter->stopping = true;
+  pthread_cond_signal(&exporter->stop_signal);
+  pthread_mutex_unlock(&exporter->lock);
+  // the thread writes the metrics one last time on its way out
+  pthread_join(exporter->thread, NULL);
+
+  pthread_mutex_destroy(&exporter->lock);
+  pthread_cond_destroy(&exporter->stop_signal);
+  free(exporter->path);
+  free(exporter->temp_path);
+  free(exporter);
+}
@@ -0,0 +1,80 @@
+#ifndef METRICS
+#define METRICS
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+
+// Histograms use power of 2 buckets of microseconds: bucket N counts values below 2^N us, the
+// last bucket counts everything else (2^25 us, about 33.5 seconds, and up)
+#define HISTOGRAM_BUCKETS 27
+
+// Counters and histograms are only ever written by one thread each (the emulator thread, or the
+// audio thread for the audio counters), so updating them is a relaxed load and store with no
+// locking or atomic read-modify-write. Other threads can read them at any time.
+typedef struct Histogram {
+  _Atomic uint64_t buckets[HISTOGRAM_BUCKETS];
+  _Atomic uint64_t count;
+  _Atomic uint64_t sum; // in microseconds
+} Histogram;
+
+typedef struct Metrics {
+  _Atomic uint64_t instructions; // instructions executed
+  _Atomic uint64_t frames; // timer updates (60 Hz frames)
+  _Atomic uint64_t presents; // screens drawn to the window
+  _Atomic uint64_t audio_callbacks; // buffers of audio requested by the sound device
+  _Atomic uint64_t audio_underruns; // audio buffers requested late, so the device ran dry
+  _Atomic uint64_t run_ahead_frames; // frames run speculatively to be presented early
+  Histogram frame_interval; // time between timer updates
+  Histogram timer_lag; // how much later than 1/60 s each timer update happened
+  Histogram present_time; // time taken to draw a screen to the window
+  Histogram input_read; // time from a key being pressed or released to the program checking it
+  Histogram input_present; // time from a key being pressed or released to the next screen
+                           // presented after the program checked it and drew something
+  Histogram run_ahead_time; // time taken to run ahead, present and roll back each frame
+} Metrics;
+
+typedef struct MetricsExporter MetricsExporter;
+
+// Create a zeroed set of metrics.
+// NOTE: This function uses memory allocation. It is expected that `metrics_destroy` will be
+// called when the program is finished in order to free that memory.
+Metrics* metrics_init();
+
+// Free the memory used by a set of metrics
+// `metrics`: the metrics to free
+void metrics_destroy(Metrics *metrics);
+
+// Add to a counter. Must only be called from the counter's writing thread.
+// `counter`: the counter to add to
+// `amount`: the amount to add
+static inline void metrics_add(_Atomic uint64_t *counter, uint64_t amount) {
+  atomic_store_explicit(counter,
+      atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// Record a value in a histogram. Must only be called from the histogram's writing thread.
+// `histogram`: the histogram to record the value in
+// `value_us`: the value to record, in microseconds
+void metrics_observe(Histogram *const histogram, uint64_t value_us);
+
+// Write the metrics in the Prometheus text exposition format
+// `metrics`: the metrics to write
+// `file`: the file to write to
+// `elapsed_s`: seconds since the metrics were created, used to calculate rates
+void metrics_write_prometheus(Metrics *const metrics, FILE *file, double elapsed_s);
+
+// Start a background thread which rewrites a file with the current metrics every `interval_ms`
+// milliseconds. The file is replaced atomically, so readers never see a partially written file.
+// Returns NULL if the thread can't be started.
+//
+// `metrics`: the metrics to export
+// `path`: the path of the file to write
+// `interval_ms`: how often to write the file
+MetricsExporter* metrics_export_start(Metrics *const metrics, const char *path, int interval_ms);
+
+// Write the metrics one last time and stop the exporter thread
+// `exporter`: the exporter to stop
+void metrics_export_stop(MetricsExporter *exporter);
+
+#endif
@@ -0,0 +1,422 @@
+#include "netplay.h"
+#include "chip8-timer.h"
+#include "compact.h"
+#include "libchip8.h"
+#include "pack.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// frames of keys, states and hashes kept, which has to cover the frames between the oldest one
+// that can be rolled back to and the newest keys the peer can have sent
+#define HISTORY (4 * NETPLAY_WINDOW)
+#define HEADER_SIZE 35
+#define MAX_PACKET_SIZE (HEADER_SIZE + 2 * NETPLAY_MAX_INPUTS)
+// how often the peers compare how far ahead of each other they are, in frames
+#define SYNC_INTERVAL 8
+// packets the shim can hold back at once, more are dropped like on a congested link
+#define SHIM_QUEUE_SIZE 256
+
+// A packet held back by the shim until it's due to be sent
+typedef struct DelayedPacket {
+  uint64_t send_us;
+  int size;
+  uint8_t data[MAX_PACKET_SIZE];
+} DelayedPacket;
+
+struct Netplay {
+  int fd;
+  struct sockaddr_in peer;
+  uint64_t session; // hash of the starting state, which the peer's has to match
+  CompactImage *image;
+  CompactChip8 *states[HISTORY]; // the state at the start of each frame
+  uint16_t local[HISTORY]; // the local player's keys for each frame
+  uint16_t remote[HISTORY]; // the other player's keys for each frame, up to `remote_frame`
+  uint16_t predicted[HISTORY]; // the other player's keys each frame last ran with
+  uint64_t hashes[HISTORY]; // hash of the state after each frame
+  int64_t frame; // the next frame to run
+  int64_t remote_frame; // last frame with the other player's keys, -1 for none yet
+  int64_t peer_ack; // last frame the peer has the local player's keys for, -1 for none yet
+  int64_t peer_newest; // newest frame the peer has sent keys for, -1 for none yet
+  int64_t rollback_frame; // first frame which ran with a wrong prediction, -1 for none
+  int64_t peer_hash_frame; // last frame the peer sent the hash of, -1 for none yet
+  uint64_t peer_hash;
+  int peer_advantage; // how far the peer is ahead of the last local keys it has
+  int sync_waits; // frames left to wait for the peer to catch up
+  NetplayShim shim;
+  uint32_t shim_random;
+  DelayedPacket *queue; // only allocated with a shim
+  int queued;
+  NetplayStats stats;
+};
+
+static void put_u16(uint8_t *out, uint16_t value) {
+  out[0] = value;
+  out[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+  put_u16(out, value);
+  put_u16(out + 2, value >> 16);
+}
+
+static void put_u64(uint8_t *out, uint64_t value) {
+  put_u32(out, value);
+  put_u32(out + 4, value >> 32);
+}
+
+static uint16_t get_u16(const uint8_t *in) {
+  return in[0] | in[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+  return get_u16(in) | (uint32_t)get_u16(in + 2) << 16;
+}
+
+static uint64_t get_u64(const uint8_t *in) {
+  return get_u32(in) | (uint64_t)get_u32(in + 4) << 32;
+}
+
+// Hash everything which decides how a state runs from here on, memory and random numbers included
+static uint64_t hash_state(const Chip8 *const chip8) {
+  return chip8_hash_state(chip8) ^ pack_hash(chip8->memory, ADDRESS_COUNT)
+    ^ chip8->rng * 0x9e3779b97f4a7c15;
+}
+
+// Hash the starting state along with the quirks and timing, which both peers have to agree on
+static uint64_t hash_session(const Chip8 *const chip8) {
+  const ConfigFlags *config = &chip8->config;
+  int64_t quirks[] = { config->legacy_shift, config->jump_quirk, config->legacy_indexing,
+    config->vip_timing, config->display_wait, config->instruction_frequency };
+  return hash_state(chip8) ^ pack_hash((const uint8_t*)quirks, sizeof(quirks));
+}
+
+// Resolve "host:port" into an IPv4 address, returning 0 if successful
+static int resolve_peer(const char *peer, struct sockaddr_in *const address) {
+  const char *colon = strrchr(peer, ':');
+  if (colon == NULL || colon == peer) {
+    return -1;
+  }
+  char host[256];
+  size_t length = colon - peer;
+  if (length >= sizeof(host)) {
+    return -1;
+  }
+  memcpy(host, peer, length);
+  host[length] = '\0';
+
+  struct addrinfo hints = { 0 };
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  struct addrinfo *result;
+  if (getaddrinfo(host, colon + 1, &hints, &result)) {
+    return -1;
+  }
+  memcpy(address, result->ai_addr, sizeof(struct sockaddr_in));
+  freeaddrinfo(result);
+  return 0;
+}
+
+Netplay* netplay_open(int port, const char *peer, const Chip8 *const chip8,
+    const NetplayShim *const shim) {
+  Netplay *netplay = calloc(1, sizeof(Netplay));
+  if (netplay == NULL) {
+    return NULL;
+  }
+  netplay->fd = -1;
+  if (resolve_peer(peer, &netplay->peer)) {
+    netplay_close(netplay);
+    return NULL;
+  }
+
+  netplay->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in address = { 0 };
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (netplay->fd == -1 || bind(netplay->fd, (struct sockaddr*)&address, sizeof(address))
+      || fcntl(netplay->fd, F_SETFL, fcntl(netplay->fd, F_GETFL) | O_NONBLOCK)) {
+    netplay_close(netplay);
+    return NULL;
+  }
+
+  netplay->image = compact_image_create(&chip8->config, chip8->memory + PROGRAM_START,
+      ADDRESS_COUNT - PROGRAM_START);
+  if (netplay->image == NULL) {
+    netplay_close(netplay);
+    return NULL;
+  }
+  for (int slot = 0; slot < HISTORY; slot++) {
+    netplay->states[slot] = compact_create(netplay->image);
+    if (netplay->states[slot] == NULL) {
+      netplay_close(netplay);
+      return NULL;
+    }
+  }
+  if (shim && (shim->delay_ms || shim->jitter_ms || shim->loss_percent)) {
+    netplay->shim = *shim;
+    netplay->shim_random = current_time_us() ^ getpid();
+    netplay->queue = malloc(SHIM_QUEUE_SIZE * sizeof(DelayedPacket));
+    if (netplay->queue == NULL) {
+      netplay_close(netplay);
+      return NULL;
+    }
+  }
+
+  netplay->session = hash_session(chip8);
+  netplay->remote_frame = -1;
+  netplay->peer_ack = -1;
+  netplay->peer_newest = -1;
+  netplay->rollback_frame = -1;
+  netplay->peer_hash_frame = -1;
+  netplay->stats.desync_frame = -1;
+  return netplay;
+}
+
+// Take in the other player's keys from a packet, noting the first frame that ran with a wrong
+// prediction of them
+static void read_packet(Netplay *const netplay, const uint8_t *packet, ssize_t size) {
+  if (size < HEADER_SIZE || get_u32(packet) != NETPLAY_MAGIC) {
+    return;
+  }
+  if (get_u64(packet + 4) != netplay->session) {
+    netplay->stats.peer_mismatch = true;
+    return;
+  }
+  int64_t start = get_u32(packet + 12);
+  int count = get_u16(packet + 16);
+  if (count > NETPLAY_MAX_INPUTS || size < HEADER_SIZE + 2 * count) {
+    return;
+  }
+  int64_t ack = (int32_t)get_u32(packet + 18);
+  if (ack > netplay->peer_ack && ack < netplay->frame) {
+    netplay->peer_ack = ack;
+  }
+  int64_t hash_frame = (int32_t)get_u32(packet + 22);
+  if (hash_frame > netplay->peer_hash_frame) {
+    netplay->peer_hash_frame = hash_frame;
+    netplay->peer_hash = get_u64(packet + 26);
+  }
+  // packets can arrive out of order, so only the newest one says how far ahead the peer is
+  if (start + count - 1 > netplay->peer_newest) {
+    netplay->peer_newest = start + count - 1;
+    netplay->peer_advantage = (int8_t)packet[34];
+  }
+
+  // the peer sends every set of keys that hasn't been acknowledged, so the keys carry on from
+  // the last ones received unless the packet is older than them
+  for (int i = 0; i < count; i++) {
+    int64_t frame = start + i;
+    if (frame <= netplay->remote_frame) {
+      continue;
+    }
+    if (frame != netplay->remote_frame + 1 || frame >= netplay->frame + HISTORY - NETPLAY_WINDOW) {
+      break;
+    }
+    int slot = frame % HISTORY;
+    netplay->remote[slot] = get_u16(packet + HEADER_SIZE + 2 * i);
+    netplay->remote_frame = frame;
+    if (frame < netplay->frame && netplay->remote[slot] != netplay->predicted[slot]
+        && (netplay->rollback_frame == -1 || frame < netplay->rollback_frame)) {
+      netplay->rollback_frame = frame;
+    }
+  }
+}
+
+static void receive_packets(Netplay *const netplay) {
+  uint8_t packet[MAX_PACKET_SIZE];
+  while (true) {
+    struct sockaddr_in from;
+    socklen_t from_size = sizeof(from);
+    ssize_t size = recvfrom(netplay->fd, packet, sizeof(packet), 0, (struct sockaddr*)&from,
+        &from_size);
+    if (size < 0) {
+      break;
+    }
+    if (from.sin_port == netplay->peer.sin_port
+        && from.sin_addr.s_addr == netplay->peer.sin_addr.s_addr) {
+      read_packet(netplay, packet, size);
+    }
+  }
+}
+
+static uint32_t shim_random(Netplay *const netplay) {
+  netplay->shim_random = netplay->shim_random * 1664525u + 1013904223u;
+  return netplay->shim_random >> 8;
+}
+
+// Send a packet, through the shim if there is one. A packet which can't be sent is as good as
+// lost, which the next packet makes up for.
+static void send_packet(Netplay *const netplay, const uint8_t *packet, int size) {
+  const NetplayShim *shim = &netplay->shim;
+  if (netplay->queue == NULL) {
+    sendto(netplay->fd, packet, size, 0, (struct sockaddr*)&netplay->peer, sizeof(netplay->peer));
+    return;
+  }
+  if ((int)(shim_random(netplay) % 100) < shim->loss_percent
+      || netplay->queued == SHIM_QUEUE_SIZE) {
+    return;
+  }
+  DelayedPacket *delayed = &netplay->queue[netplay->queued++];
+  uint64_t delay_us = shim->delay_ms * 1000ull;
+  if (shim->jitter_ms) {
+    delay_us += shim_random(netplay) % (shim->jitter_ms * 1000ull + 1);
+  }
+  delayed->send_us = current_time_us() + delay_us;
+  delayed->size = size;
+  memcpy(delayed->data, packet, size);
+}
+
+// Send the packets the shim has held back for long enough
+static void flush_shim(Netplay *const netplay) {
+  uint64_t now = current_time_us();
+  for (int i = 0; i < netplay->queued; i++) {
+    DelayedPacket *delayed = &netplay->queue[i];
+    if (delayed->send_us <= now) {
+      sendto(netplay->fd, delayed->data, delayed->size, 0, (struct sockaddr*)&netplay->peer,
+          sizeof(netplay->peer));
+      *delayed = netplay->queue[--netplay->queued];
+      i--;
+    }
+  }
+}
+
+// Send the peer every set of local keys it hasn't acknowledged, along with the latest hash
+static void send_keys(Netplay *const netplay) {
+  uint8_t packet[MAX_PACKET_SIZE];
+  int64_t start = netplay->peer_ack + 1;
+  if (start < netplay->frame - NETPLAY_MAX_INPUTS) {
+    start = netplay->frame - NETPLAY_MAX_INPUTS;
+  }
+  int count = netplay->frame - start;
+  int64_t hash_frame = netplay->remote_frame < netplay->frame - 1
+    ? netplay->remote_frame : netplay->frame - 1;
+  int64_t advantage = netplay->frame - (netplay->remote_frame + 1);
+
+  put_u32(packet, NETPLAY_MAGIC);
+  put_u64(packet + 4, netplay->session);
+  put_u32(packet + 12, start);
+  put_u16(packet + 16, count);
+  put_u32(packet + 18, netplay->remote_frame);
+  put_u32(packet + 22, hash_frame);
+  put_u64(packet + 26, hash_frame >= 0 ? netplay->hashes[hash_frame % HISTORY] : 0);
+  packet[34] = advantage > INT8_MAX ? INT8_MAX : advantage < INT8_MIN ? INT8_MIN : advantage;
+  for (int i = 0; i < count; i++) {
+    put_u16(packet + HEADER_SIZE + 2 * i, netplay->local[(start + i) % HISTORY]);
+  }
+  send_packet(netplay, packet, HEADER_SIZE + 2 * count);
+}
+
+// Save the state at the start of a frame and run it with the keys known (or predicted) for it,
+// returning -1 if the state couldn't be saved
+static int run_frame(Netplay *const netplay, Chip8 *const chip8, int64_t frame) {
+  int slot = frame % HISTORY;
+  if (compact_write(netplay->states[slot], chip8)) {
+    return -1;
+  }
+  uint16_t remote = 0;
+  if (frame <= netplay->remote_frame) {
+    remote = netplay->remote[slot];
+  } else if (netplay->remote_frame >= 0) {
+    remote = netplay->remote[netplay->remote_frame % HISTORY];
+  }
+  netplay->predicted[slot] = remote;
+
+  uint16_t held = netplay->local[slot] | remote;
+  uint8_t keys[KEY_COUNT];
+  for (int key = 0; key < KEY_COUNT; key++) {
+    keys[key] = (held >> key) & 1;
+  }
+  chip8_run_frame(chip8, keys);
+  netplay->hashes[slot] = hash_state(chip8);
+  return 0;
+}
+
+// Go back to the first frame which ran with a wrong prediction and run every frame since again
+static int roll_back(Netplay *const netplay, Chip8 *const chip8) {
+  int64_t first = netplay->rollback_frame;
+  netplay->rollback_frame = -1;
+  compact_read(netplay->states[first % HISTORY], chip8);
+  for (int64_t frame = first; frame < netplay->frame; frame++) {
+    if (run_frame(netplay, chip8, frame)) {
+      return -1;
+    }
+  }
+  int depth = netplay->frame - first;
+  netplay->stats.rollbacks++;
+  netplay->stats.resimulated += depth;
+  if (depth > netplay->stats.max_rollback) {
+    netplay->stats.max_rollback = depth;
+  }
+  return 0;
+}
+
+// Compare the peer's latest hash with the local one once both are final, i.e. both players'
+// keys are known for that frame and it doesn't need to be run again
+static void check_desync(Netplay *const netplay) {
+  int64_t frame = netplay->peer_hash_frame;
+  if (netplay->stats.desync_frame == -1 && frame >= 0 && frame <= netplay->remote_frame
+      && frame < netplay->frame && frame >= netplay->frame - HISTORY
+      && netplay->hashes[frame % HISTORY] != netplay->peer_hash) {
+    netplay->stats.desync_frame = frame;
+  }
+}
+
+int netplay_frame(Netplay *const netplay, Chip8 *const chip8, uint16_t keys) {
+  if (netplay->queue) {
+    flush_shim(netplay);
+  }
+  receive_packets(netplay);
+  if (netplay->rollback_frame != -1 && roll_back(netplay, chip8)) {
+    return -1;
+  }
+  check_desync(netplay);
+
+  // wait when this peer is too far ahead to roll back any further, or further ahead of the other
+  // player than the other player is of it, which would leave one side doing all of the rollbacks
+  int64_t advantage = netplay->frame - (netplay->remote_frame + 1);
+  if (advantage >= NETPLAY_WINDOW || netplay->sync_waits > 0) {
+    netplay->sync_waits -= netplay->sync_waits > 0;
+    netplay->stats.waits++;
+    send_keys(netplay);
+    return NETPLAY_WAITING;
+  }
+
+  netplay->local[netplay->frame % HISTORY] = keys;
+  if (run_frame(netplay, chip8, netplay->frame)) {
+    return -1;
+  }
+  netplay->frame++;
+  netplay->stats.frames++;
+  if (netplay->frame % SYNC_INTERVAL == 0) {
+    // waiting a frame shrinks the gap between the two advantages by 2
+    netplay->sync_waits = (advantage - netplay->peer_advantage) / 2;
+  }
+  send_keys(netplay);
+  return NETPLAY_RAN;
+}
+
+const NetplayStats* netplay_stats(const Netplay *const netplay) {
+  return &netplay->stats;
+}
+
+void netplay_close(Netplay *netplay) {
+  if (netplay->fd != -1) {
+    close(netplay->fd);
+  }
+  for (int slot = 0; slot < HISTORY; slot++) {
+    if (netplay->states[slot]) {
+      compact_destroy(netplay->states[slot]);
+    }
+  }
+  if (netplay->image) {
+    compact_image_release(netplay->image);
+  }
+  free(netplay->queue);
+  free(netplay);
+}
@@ -0,0 +1,96 @@
+#ifndef NETPLAY
+#define NETPLAY
+
+#include "chip8.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Two players running the same program on their own machines, linked over UDP with rollback.
+//
+// Both peers run the program a 60 Hz frame at a time (see `chip8_run_frame`), with the keys held
+// down by either player. Running a frame only needs the local player's keys: the other player's
+// keys are predicted to be the last ones received from them, and the frame runs straight away. The
+// state at the start of each frame is kept for the last NETPLAY_WINDOW frames, so when the other
+// player's real keys turn out to differ from the prediction, the peer rolls back to the state
+// before the first frame that was wrong and runs every frame since again, all before presenting
+// the next one. A peer which gets NETPLAY_WINDOW frames ahead of the last keys it has from the
+// other waits for them, and a peer which runs ahead of the other more than the other runs ahead
+// of it waits a frame every so often to let the other catch up.
+//
+// This only works because running a frame is deterministic: the same state and keys always give
+// the same next state, random numbers included (see `chip8_seed`). Both peers have to start from
+// the same program, quirks and seed, and the peers check this by hashing their starting state.
+// Once both players' keys for a frame are known, each peer sends the other the hash of its state
+// after that frame, and a mismatch is reported as a desync.
+//
+// Every packet carries all of the local keys the other peer hasn't acknowledged yet, so a lost
+// packet is covered by the next one and nothing has to be resent.
+//
+// Packet, all integers little-endian:
+//   - 4 bytes: NETPLAY_MAGIC
+//   - 8 bytes: hash of the starting state (see above)
+//   - 4 bytes: frame of the first set of keys in the packet
+//   - 2 bytes: number of sets of keys in the packet (at most NETPLAY_MAX_INPUTS)
+//   - 4 bytes: last frame the sender has the receiver's keys for, or -1 for none yet
+//   - 4 bytes: last frame the sender has hashed (both players' keys known), or -1 for none yet
+//   - 8 bytes: hash of the sender's state after that frame
+//   - 1 byte: how many frames the sender is ahead of the last keys it has from the receiver
+//   - 2 bytes for each set of keys: bitmask of the keys held down (bit N = key N)
+#define NETPLAY_MAGIC 0x504e3843 // "C8NP"
+#define NETPLAY_WINDOW 16
+#define NETPLAY_MAX_INPUTS 64
+
+// netplay_frame results
+#define NETPLAY_RAN 0
+#define NETPLAY_WAITING 1
+
+// Makes a connection worse on purpose, to try rollback out on a single machine. Applies to the
+// packets a peer sends.
+typedef struct NetplayShim {
+  int delay_ms; // added to every packet
+  int jitter_ms; // up to this much more added at random to each packet, which can reorder them
+  int loss_percent; // chance of dropping each packet
+} NetplayShim;
+
+typedef struct NetplayStats {
+  uint64_t frames; // frames run, not counting frames run again
+  uint64_t rollbacks; // times a prediction was wrong
+  uint64_t resimulated; // frames run again after rolling back
+  int max_rollback; // most frames run again after a single rollback
+  uint64_t waits; // times a frame was held back waiting for the other player
+  int64_t desync_frame; // first frame the peers' states differed after, or -1 if they never did
+  bool peer_mismatch; // whether packets came from a peer running a different program or quirks
+} NetplayStats;
+
+typedef struct Netplay Netplay;
+
+// Open a netplay session with a peer, returning NULL if the socket can't be opened, the peer's
+// address can't be resolved or memory can't be allocated.
+// NOTE: This function uses memory allocation. It is expected that `netplay_close` will be called
+// when the session is over in order to free that memory.
+//
+// `port`: the local UDP port to receive the peer's packets on
+// `peer`: the peer's address, as "host:port"
+// `chip8`: the starting state, which the peer has to start from too
+// `shim`: the delay, jitter and loss to add to sent packets, or NULL for none
+Netplay* netplay_open(int port, const char *peer, const Chip8 *const chip8,
+    const NetplayShim *const shim);
+
+// Exchange packets with the peer and run the next frame, rolling back first if any predictions
+// were wrong. Returns NETPLAY_RAN if a frame ran, NETPLAY_WAITING if the frame was held back for
+// the other player (the state can still have changed if it rolled back) or -1 if a state couldn't
+// be saved. This never blocks, so it's meant to be called once per 60 Hz frame.
+// `netplay`: the session
+// `chip8`: the state to run, which has to be left alone between calls
+// `keys`: bitmask of the keys the local player is holding down (bit N = key N)
+int netplay_frame(Netplay *const netplay, Chip8 *const chip8, uint16_t keys);
+
+// Get statistics about the rollbacks and waits so far
+// `netplay`: the session
+const NetplayStats* netplay_stats(const Netplay *const netplay);
+
+// Close a session's socket and free its memory
+// `netplay`: the session to close
+void netplay_close(Netplay *netplay);
+
+#endif
@@ -0,0 +1,281 @@
+#include "pack.h"
+#include "quirks.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Builds packs of ROMs (see pack.h) from a manifest, and lists what's in them.
+//
+// Manifests list one ROM per line, with blank lines and lines starting with # ignored:
+//
+// [rom-filepath] [quirks] [ips] [keys]
+//
+// where everything after the path is optional (or - for the default):
+// `quirks` is a comma separated list of old-shift, jump-quirk, old-index, vip and display-wait,
+// like in golden files,
+// `ips` is the number of instructions to run per second,
+// and `keys` is 16 hexadecimal digits, one per CHIP-8 key from 0 to F, giving the key in the
+// default layout which presses it (0123456789ABCDEF for the default layout itself).
+// ROM paths are relative to the manifest. ROMs with the same contents are only stored once, with
+// the profile of the first one listed.
+
+#define MAX_PATH 512
+#define MAX_ROM_SIZE (ADDRESS_COUNT - PROGRAM_START)
+
+typedef struct PackedRom {
+  PackEntry entry;
+  uint8_t rom[MAX_ROM_SIZE];
+  int line; // where the ROM was listed in the manifest, so duplicates keep the first profile
+} PackedRom;
+
+void help_menu() {
+  printf("Usage: chip8-pack [manifest-filepath] [output-filepath]\n");
+  printf("       chip8-pack --list [pack-filepath]\n");
+  printf("Options:\t\tDescription\n");
+  printf("--list\t\tPrint the ROMs in a pack and their profiles\n");
+}
+
+// Set the profile of a ROM from a comma separated list of quirks, returning 0 if they are valid
+static int parse_quirks(PackEntry *const entry, char *const quirks) {
+  if (strcmp(quirks, "-") == 0) {
+    return 0;
+  }
+  for (char *quirk = strtok(quirks, ","); quirk != NULL; quirk = strtok(NULL, ",")) {
+    if (strcmp(quirk, "old-shift") == 0) {
+      entry->quirks |= QUIRK_LEGACY_SHIFT;
+    } else if (strcmp(quirk, "jump-quirk") == 0) {
+      entry->quirks |= QUIRK_JUMP;
+    } else if (strcmp(quirk, "old-index") == 0) {
+      entry->quirks |= QUIRK_LEGACY_INDEXING;
+    } else if (strcmp(quirk, "vip") == 0) {
+      entry->timing |= PACK_VIP_TIMING;
+    } else if (strcmp(quirk, "display-wait") == 0) {
+      entry->timing |= PACK_DISPLAY_WAIT;
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Set the key map of a ROM from its hexadecimal digits, returning 0 if it is valid
+static int parse_keys(PackEntry *const entry, const char *const keys) {
+  if (strcmp(keys, "-") == 0) {
+    return 0;
+  }
+  if (strlen(keys) != KEY_COUNT || strspn(keys, "0123456789abcdefABCDEF") != KEY_COUNT) {
+    return -1;
+  }
+  for (int key = 0; key < KEY_COUNT; key++) {
+    char digit[2] = { keys[key], 0 };
+    entry->key_map[key] = strtol(digit, NULL, 16);
+  }
+  return 0;
+}
+
+// Read a ROM and its profile from a line of a manifest, returning 0 if successful
+// `dir`: the directory of the manifest, which the ROM's path is relative to
+static int read_rom(const char *const line, const char *const dir, PackedRom *const packed) {
+  char path[MAX_PATH];
+  char quirks[64] = "-";
+  char ips[32] = "-";
+  char keys[32] = "-";
+  if (sscanf(line, "%511s %63s %31s %31s", path, quirks, ips, keys) < 1) {
+    return -1;
+  }
+  PackEntry *entry = &packed->entry;
+  memset(entry, 0, sizeof(PackEntry));
+  for (int key = 0; key < KEY_COUNT; key++) {
+    entry->key_map[key] = key;
+  }
+  long frequency = strcmp(ips, "-") == 0 ? 0 : atol(ips);
+  if (parse_quirks(entry, quirks) || parse_keys(entry, keys) || frequency < 0
+      || frequency > UINT16_MAX) {
+    return -1;
+  }
+  entry->instruction_frequency = frequency;
+
+  const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+  strncpy(entry->name, name, PACK_NAME_SIZE - 1);
+  char full_path[2 * MAX_PATH];
+  snprintf(full_path, sizeof(full_path), "%s%s", path[0] == '/' ? "" : dir, path);
+  FILE *file = fopen(full_path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Unable to open ROM %s\n", full_path);
+    return -1;
+  }
+  // read one byte more than fits, to tell whether the ROM is too big
+  uint8_t rom[MAX_ROM_SIZE + 1];
+  size_t size = fread(rom, 1, sizeof(rom), file);
+  fclose(file);
+  if (size > MAX_ROM_SIZE) {
+    fprintf(stderr, "ROM %s is too big to fit in memory\n", full_path);
+    return -1;
+  }
+  memcpy(packed->rom, rom, size);
+  entry->size = size;
+  entry->hash = pack_hash(packed->rom, size);
+  return 0;
+}
+
+static int compare_roms(const void *a, const void *b) {
+  const PackedRom *rom_a = a;
+  const PackedRom *rom_b = b;
+  if (rom_a->entry.hash != rom_b->entry.hash) {
+    return rom_a->entry.hash < rom_b->entry.hash ? -1 : 1;
+  }
+  return rom_a->line - rom_b->line;
+}
+
+// Read every ROM listed in a manifest, returning the number read or -1 on an error
+// `roms`: out parameter for the ROMs, which must be freed by the caller
+static int read_manifest(const char *path, PackedRom **roms) {
+  *roms = NULL;
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+
+  char dir[MAX_PATH] = "";
+  const char *slash = strrchr(path, '/');
+  if (slash != NULL && slash - path + 1 < MAX_PATH) {
+    memcpy(dir, path, slash - path + 1);
+    dir[slash - path + 1] = 0;
+  }
+
+  char line[MAX_PATH + 128];
+  int count = 0;
+  int capacity = 0;
+  for (int line_number = 1; fgets(line, sizeof(line), file) != NULL; line_number++) {
+    if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      PackedRom *grown = realloc(*roms, capacity * sizeof(PackedRom));
+      if (grown == NULL) {
+        fclose(file);
+        return -1;
+      }
+      *roms = grown;
+    }
+    if (read_rom(line, dir, &(*roms)[count])) {
+      fprintf(stderr, "%s:%d: invalid ROM\n", path, line_number);
+      fclose(file);
+      return -1;
+    }
+    (*roms)[count++].line = line_number;
+  }
+  fclose(file);
+  return count;
+}
+
+// Write the ROMs into a pack, storing ROMs with the same contents only once. Returns the number
+// of ROMs stored, or -1 if the pack couldn't be written.
+// `roms`: the ROMs, sorted by `compare_roms`
+static int write_pack(const char *path, PackedRom *const roms, int count) {
+  int unique = 0;
+  for (int i = 0; i < count; i++) {
+    if (unique > 0 && roms[unique - 1].entry.hash == roms[i].entry.hash) {
+      const PackedRom *kept = &roms[unique - 1];
+      if (kept->entry.size != roms[i].entry.size
+          || memcmp(kept->rom, roms[i].rom, kept->entry.size) != 0) {
+        fprintf(stderr, "%s and %s have the same hash, but different contents\n",
+            kept->entry.name, roms[i].entry.name);
+        return -1;
+      }
+      printf("%s is the same ROM as %s, only the first is stored\n", roms[i].entry.name,
+          kept->entry.name);
+      continue;
+    }
+    if (unique != i) {
+      roms[unique] = roms[i];
+    }
+    unique++;
+  }
+
+  size_t offset = sizeof(PackHeader) + unique * sizeof(PackEntry);
+  for (int i = 0; i < unique; i++) {
+    offset = (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+    roms[i].entry.offset = offset;
+    offset += roms[i].entry.size;
+  }
+  if (offset > UINT32_MAX) {
+    fprintf(stderr, "Too many ROMs to fit in a pack\n");
+    return -1;
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    return -1;
+  }
+  PackHeader header = { .version = PACK_VERSION, .count = unique, .size = offset };
+  memcpy(header.magic, PACK_MAGIC, PACK_MAGIC_SIZE);
+  fwrite(&header, sizeof(header), 1, file);
+  for (int i = 0; i < unique; i++) {
+    fwrite(&roms[i].entry, sizeof(PackEntry), 1, file);
+  }
+  static const uint8_t padding[PACK_ALIGN] = { 0 };
+  size_t written = sizeof(PackHeader) + unique * sizeof(PackEntry);
+  for (int i = 0; i < unique; i++) {
+    fwrite(padding, 1, roms[i].entry.offset - written, file);
+    fwrite(roms[i].rom, 1, roms[i].entry.size, file);
+    written = roms[i].entry.offset + roms[i].entry.size;
+  }
+  int error = ferror(file);
+  return fclose(file) || error ? -1 : unique;
+}
+
+// Print every ROM in a pack with its profile, returning 0 if the pack could be opened
+static int list_pack(const char *path) {
+  Pack *pack = pack_open(path);
+  if (pack == NULL) {
+    return -1;
+  }
+  printf("%-16s %5s %6s %6s %5s %-16s %s\n", "hash", "size", "quirks", "timing", "ips", "keys",
+      "name");
+  for (uint32_t i = 0; i < pack_count(pack); i++) {
+    const PackEntry *entry = pack_entry(pack, i);
+    char keys[KEY_COUNT + 1];
+    for (int key = 0; key < KEY_COUNT; key++) {
+      keys[key] = "0123456789ABCDEF"[entry->key_map[key]];
+    }
+    keys[KEY_COUNT] = 0;
+    printf("%016" PRIx64 " %5u %6u %6u %5u %s %s\n", entry->hash, entry->size, entry->quirks,
+        entry->timing, entry->instruction_frequency, keys, entry->name);
+  }
+  pack_close(pack);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc == 3 && strncmp(argv[1], "--list", 7) == 0) {
+    if (list_pack(argv[2])) {
+      fprintf(stderr, "Unable to open pack %s\n", argv[2]);
+      return -1;
+    }
+    return 0;
+  }
+  if (argc != 3) {
+    help_menu();
+    return -1;
+  }
+
+  PackedRom *roms;
+  int count = read_manifest(argv[1], &roms);
+  if (count < 0) {
+    fprintf(stderr, "Unable to read manifest %s\n", argv[1]);
+    free(roms);
+    return -1;
+  }
+  qsort(roms, count, sizeof(PackedRom), compare_roms);
+  int unique = write_pack(argv[2], roms, count);
+  free(roms);
+  if (unique < 0) {
+    fprintf(stderr, "Unable to write pack %s\n", argv[2]);
+    return -1;
+  }
+  printf("Packed %d ROMs into %s\n", unique, argv[2]);
+  return 0;
+}
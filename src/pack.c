@@ -0,0 +1,144 @@
+#include "pack.h"
+#include "quirks.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// FNV-1a, the same hash `chip8_hash_state` uses
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define HASH_DIGITS 16
+
+struct Pack {
+  const uint8_t *data; // the whole mapped file
+  size_t size;
+  const PackEntry *entries;
+  uint32_t count;
+};
+
+// Check that a mapped file is a pack which every entry can be read from safely
+static int validate_pack(const uint8_t *const data, size_t size) {
+  const PackHeader *header = (const PackHeader*)data;
+  // a pack written on a little-endian machine has a different version on a big-endian one, so
+  // those are rejected here too
+  if (size < sizeof(PackHeader) || memcmp(header->magic, PACK_MAGIC, PACK_MAGIC_SIZE) != 0
+      || header->version != PACK_VERSION || header->size != size
+      || header->count > (size - sizeof(PackHeader)) / sizeof(PackEntry)) {
+    return -1;
+  }
+  const PackEntry *entries = (const PackEntry*)(data + sizeof(PackHeader));
+  for (uint32_t i = 0; i < header->count; i++) {
+    const PackEntry *entry = &entries[i];
+    if (entry->size > ADDRESS_COUNT - PROGRAM_START || entry->offset > size
+        || size - entry->offset < entry->size || entry->quirks >= VARIANT_COUNT
+        || (i > 0 && entries[i - 1].hash >= entry->hash)
+        || memchr(entry->name, 0, PACK_NAME_SIZE) == NULL) {
+      return -1;
+    }
+    for (int key = 0; key < KEY_COUNT; key++) {
+      if (entry->key_map[key] >= KEY_COUNT) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+Pack* pack_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == -1 || info.st_size < (off_t)sizeof(PackHeader)) {
+    close(fd);
+    return NULL;
+  }
+  // the mapping stays valid after the file is closed
+  void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+
+  Pack *pack = malloc(sizeof(Pack));
+  if (pack == NULL || validate_pack(data, info.st_size) == -1) {
+    free(pack);
+    munmap(data, info.st_size);
+    return NULL;
+  }
+  pack->data = data;
+  pack->size = info.st_size;
+  pack->entries = (const PackEntry*)(pack->data + sizeof(PackHeader));
+  pack->count = ((const PackHeader*)data)->count;
+  return pack;
+}
+
+uint32_t pack_count(const Pack *const pack) {
+  return pack->count;
+}
+
+const PackEntry* pack_entry(const Pack *const pack, uint32_t index) {
+  return &pack->entries[index];
+}
+
+const PackEntry* pack_find(const Pack *const pack, uint64_t hash) {
+  uint32_t low = 0;
+  uint32_t high = pack->count;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (pack->entries[middle].hash < hash) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low < pack->count && pack->entries[low].hash == hash ? &pack->entries[low] : NULL;
+}
+
+const PackEntry* pack_lookup(const Pack *const pack, const char *key) {
+  if (strlen(key) == HASH_DIGITS && strspn(key, "0123456789abcdefABCDEF") == HASH_DIGITS) {
+    const PackEntry *entry = pack_find(pack, strtoull(key, NULL, 16));
+    if (entry != NULL) {
+      return entry;
+    }
+  }
+  // names aren't indexed, since looking one up happens once per run
+  for (uint32_t i = 0; i < pack->count; i++) {
+    if (strncmp(pack->entries[i].name, key, PACK_NAME_SIZE) == 0) {
+      return &pack->entries[i];
+    }
+  }
+  return NULL;
+}
+
+void pack_load(const Pack *const pack, const PackEntry *const entry, Chip8 *const chip8) {
+  memcpy(chip8->memory + PROGRAM_START, pack->data + entry->offset, entry->size);
+}
+
+void pack_configure(const PackEntry *const entry, ConfigFlags *const config) {
+#define ENABLE_QUIRK(field, bit) config->field |= (entry->quirks & (bit)) != 0;
+  QUIRK_LIST(ENABLE_QUIRK)
+#undef ENABLE_QUIRK
+  config->vip_timing |= (entry->timing & PACK_VIP_TIMING) != 0;
+  config->display_wait |= (entry->timing & PACK_DISPLAY_WAIT) != 0;
+  if (config->instruction_frequency <= 0) {
+    config->instruction_frequency = entry->instruction_frequency;
+  }
+}
+
+uint64_t pack_hash(const uint8_t *const rom, size_t size) {
+  uint64_t hash = FNV_OFFSET;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ rom[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+void pack_close(Pack *pack) {
+  munmap((void*)pack->data, pack->size);
+  free(pack);
+}
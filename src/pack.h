@@ -0,0 +1,103 @@
+#ifndef PACK
+#define PACK
+
+#include "chip8.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Packs hold a whole corpus of ROMs in a single file, each stored once and indexed by the hash of
+// its contents, along with the profile it should run with. Packs are built by chip8-pack (see
+// pack-build.c) and memory mapped to read them, so opening one only reads its index and loading
+// a ROM is a single copy out of the mapping.
+//
+// header: a PackHeader
+// index: `count` PackEntry records, sorted by hash
+// ROMs: the contents of every ROM, each starting on a PACK_ALIGN byte boundary
+//
+// Every number is stored in little-endian byte order, and the records have no padding so they
+// can be used straight from the mapping.
+#define PACK_MAGIC "C8PACK"
+#define PACK_MAGIC_SIZE 6
+#define PACK_VERSION 1
+#define PACK_ALIGN 64
+#define PACK_NAME_SIZE 30 // including the terminating 0
+
+// Bits of `PackEntry.timing`
+#define PACK_VIP_TIMING 0x1 // see `ConfigFlags.vip_timing`
+#define PACK_DISPLAY_WAIT 0x2 // see `ConfigFlags.display_wait`
+
+typedef struct PackHeader {
+  char magic[PACK_MAGIC_SIZE];
+  uint16_t version;
+  uint32_t count; // the number of entries in the index
+  uint32_t size; // the size of the whole pack in bytes
+} PackHeader;
+
+typedef struct PackEntry {
+  uint64_t hash; // see `pack_hash`
+  uint32_t offset; // where the ROM starts, from the start of the pack
+  uint16_t size; // the size of the ROM in bytes
+  uint16_t instruction_frequency; // instructions per second, 0 for the default
+  uint8_t quirks; // the quirk mask the ROM needs (see quirks.h)
+  uint8_t timing; // PACK_ bits for the timing the ROM needs
+  // the key (in the default layout, see key-bindings.h) which presses each CHIP-8 key, so
+  // `key_map[i] == i` for ROMs which use the usual keys
+  uint8_t key_map[KEY_COUNT];
+  char name[PACK_NAME_SIZE]; // the file name the ROM was packed from, for listing and lookups
+} PackEntry;
+
+_Static_assert(sizeof(PackHeader) == 16, "pack headers are stored without padding");
+_Static_assert(sizeof(PackEntry) == 64, "pack entries are stored without padding");
+
+typedef struct Pack Pack;
+
+// Open a pack and map it into memory, returning NULL if it can't be opened or isn't a valid
+// pack. Every entry is checked to lie within the file when it's opened, so entries never have to
+// be checked again.
+// NOTE: It is expected that `pack_close` will be called when the pack is no longer needed, in
+// order to unmap it and free its memory.
+// `path`: the path of the pack
+Pack* pack_open(const char *path);
+
+// Get the number of ROMs in a pack
+// `pack`: the pack to count the ROMs of
+uint32_t pack_count(const Pack *const pack);
+
+// Get an entry of a pack's index, in order of hash. The entry stays valid until the pack is closed.
+// `pack`: the pack to get the entry from
+// `index`: the index of the entry, less than `pack_count`
+const PackEntry* pack_entry(const Pack *const pack, uint32_t index);
+
+// Find the entry of a ROM by the hash of its contents, returning NULL if it isn't in the pack
+// `pack`: the pack to search
+// `hash`: the hash of the ROM (see `pack_hash`)
+const PackEntry* pack_find(const Pack *const pack, uint64_t hash);
+
+// Find the entry of a ROM by its name, or by its hash written as 16 hexadecimal digits, returning
+// NULL if it isn't in the pack
+// `pack`: the pack to search
+// `key`: the name or hash of the ROM
+const PackEntry* pack_lookup(const Pack *const pack, const char *key);
+
+// Copy a ROM out of a pack into a CHIP-8's memory at PROGRAM_START
+// `pack`: the pack holding the ROM
+// `entry`: the ROM's entry, from the same pack
+// `chip8`: the CHIP-8 system to load the ROM into
+void pack_load(const Pack *const pack, const PackEntry *const entry, Chip8 *const chip8);
+
+// Enable the quirks and timing a ROM needs on top of the ones already set in a config, and use
+// its instruction frequency unless the config already has one
+// `entry`: the ROM's entry
+// `config`: the config to update
+void pack_configure(const PackEntry *const entry, ConfigFlags *const config);
+
+// Compute the 64-bit FNV-1a hash which identifies a ROM's contents in packs
+// `rom`: the contents of the ROM
+// `size`: the size of the ROM in bytes
+uint64_t pack_hash(const uint8_t *const rom, size_t size);
+
+// Unmap a pack and free its memory, after which its entries can't be used
+// `pack`: the pack to close
+void pack_close(Pack *pack);
+
+#endif
@@ -0,0 +1,236 @@
+#include "perf.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// how many pairs of reads to take the cheapest of when measuring the cost of reading
+#define CALIBRATION_READS 64
+
+typedef struct CounterEvent {
+  uint32_t type;
+  uint64_t config;
+  const char *name;
+} CounterEvent;
+
+static const CounterEvent COUNTER_EVENTS[PERF_COUNTER_COUNT] = {
+  [PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+  [PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+  [PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-misses" },
+  [PERF_L1D_MISSES] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+    | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    "L1-dcache-load-misses" },
+};
+
+static const char *const CLASS_NAMES[PERF_CLASS_COUNT] = {
+  "0NNN clear/return", "1NNN jump", "2NNN call", "3XNN skip if equal",
+  "4XNN skip if not equal", "5XY0 skip if registers equal", "6XNN set", "7XNN add",
+  "8XYN arithmetic", "9XY0 skip if registers differ", "ANNN set I", "BNNN jump with offset",
+  "CXNN random", "DXYN draw", "EXNN skip on key", "FXNN timers/keys/memory",
+};
+
+// The layout of a read of the whole group (PERF_FORMAT_GROUP with the enabled and running times)
+typedef struct GroupRead {
+  uint64_t count;
+  uint64_t time_enabled;
+  uint64_t time_running;
+  uint64_t values[PERF_COUNTER_COUNT];
+} GroupRead;
+
+struct Perf {
+  int leader; // file descriptor of the group's first counter, which the others follow
+  int fds[PERF_COUNTER_COUNT]; // -1 for counters which couldn't be opened
+  int slots[PERF_COUNTER_COUNT]; // index of each counter's value in a read of the group
+  PerfSample overhead; // the events counted by a single read of the group
+};
+
+static int open_counter(const CounterEvent *const event, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event->type;
+  attr.config = event->config;
+  attr.disabled = group == -1; // the rest of the group starts and stops with the leader
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+    | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // calling thread, any CPU
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+Perf* perf_open(void) {
+  Perf *perf = malloc(sizeof(Perf));
+  if (perf == NULL) {
+    return NULL;
+  }
+  perf->leader = -1;
+  int members = 0;
+  int first_error = 0;
+  for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+    perf->fds[counter] = open_counter(&COUNTER_EVENTS[counter], perf->leader);
+    perf->slots[counter] = perf->fds[counter] == -1 ? -1 : members++;
+    if (perf->fds[counter] == -1 && !first_error) {
+      first_error = errno;
+    }
+    if (perf->fds[counter] != -1 && perf->leader == -1) {
+      perf->leader = perf->fds[counter];
+    }
+  }
+  if (perf->leader == -1) {
+    free(perf);
+    errno = first_error;
+    return NULL;
+  }
+  memset(&perf->overhead, 0, sizeof(perf->overhead));
+  return perf;
+}
+
+const char* perf_unavailable_reason(int error) {
+  switch (error) {
+    case EACCES:
+    case EPERM:
+      return "not permitted, see /proc/sys/kernel/perf_event_paranoid";
+    case ENOENT:
+    case ENODEV:
+    case EOPNOTSUPP:
+      return "the CPU doesn't expose them, which is common in virtual machines";
+    case ENOSYS:
+      return "the kernel doesn't support perf_event_open";
+  }
+  return strerror(error);
+}
+
+bool perf_available(const Perf *const perf, int counter) {
+  return perf->fds[counter] != -1;
+}
+
+const char* perf_counter_name(int counter) {
+  return COUNTER_EVENTS[counter].name;
+}
+
+// Read the whole group, returning 0 if successful
+static int read_group(Perf *const perf, GroupRead *const group) {
+  ssize_t length = read(perf->leader, group, sizeof(GroupRead));
+  return length < (ssize_t)(3 * sizeof(uint64_t)) ? -1 : 0;
+}
+
+void perf_read(Perf *const perf, PerfSample *const sample) {
+  GroupRead group;
+  if (read_group(perf, &group)) {
+    memset(group.values, 0, sizeof(group.values));
+  }
+  for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+    int slot = perf->slots[counter];
+    sample->counts[counter] = slot == -1 ? 0 : group.values[slot];
+  }
+}
+
+void perf_start(Perf *const perf) {
+  ioctl(perf->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(perf->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+  // reading the counters counts events of its own, which shouldn't be blamed on instructions
+  for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+    perf->overhead.counts[counter] = UINT64_MAX;
+  }
+  for (int i = 0; i < CALIBRATION_READS; i++) {
+    PerfSample before, after;
+    perf_read(perf, &before);
+    perf_read(perf, &after);
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+      uint64_t events = after.counts[counter] - before.counts[counter];
+      if (events < perf->overhead.counts[counter]) {
+        perf->overhead.counts[counter] = events;
+      }
+    }
+  }
+  ioctl(perf->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+}
+
+void perf_stop(Perf *const perf, PerfSample *const total) {
+  ioctl(perf->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  GroupRead group;
+  memset(total, 0, sizeof(PerfSample));
+  if (read_group(perf, &group) || group.time_running == 0) {
+    return;
+  }
+  double scale = (double)group.time_enabled / group.time_running;
+  for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+    int slot = perf->slots[counter];
+    total->counts[counter] = slot == -1 ? 0 : (uint64_t)(group.values[slot] * scale);
+  }
+}
+
+void perf_attribute(const Perf *const perf, PerfClasses *const classes, uint16_t instruction,
+    const PerfSample *const before, const PerfSample *const after) {
+  int class = instruction >> 12;
+  classes->instructions[class]++;
+  for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+    uint64_t events = after->counts[counter] - before->counts[counter];
+    uint64_t overhead = perf->overhead.counts[counter];
+    classes->events[class].counts[counter] += events > overhead ? events - overhead : 0;
+  }
+}
+
+void perf_print(const Perf *const perf, FILE *file, const PerfSample *const total,
+    uint64_t instructions) {
+  const uint64_t *counts = total->counts;
+  for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+    fprintf(file, "%s", counter ? ", " : "");
+    if (!perf_available(perf, counter)) {
+      fprintf(file, "%s n/a", perf_counter_name(counter));
+      continue;
+    }
+    fprintf(file, "%" PRIu64 " %s", counts[counter], perf_counter_name(counter));
+    if (counter == PERF_INSTRUCTIONS && perf_available(perf, PERF_CYCLES) && counts[PERF_CYCLES]) {
+      fprintf(file, " (%.2f per cycle)", (double)counts[counter] / counts[PERF_CYCLES]);
+    } else if (counter != PERF_CYCLES && counter != PERF_INSTRUCTIONS
+        && perf_available(perf, PERF_INSTRUCTIONS) && counts[PERF_INSTRUCTIONS]) {
+      fprintf(file, " (%.3f per 1000 instructions)",
+          1000.0 * counts[counter] / counts[PERF_INSTRUCTIONS]);
+    }
+  }
+  if (instructions && perf_available(perf, PERF_CYCLES)) {
+    fprintf(file, ", %.1f cycles per CHIP-8 instruction",
+        (double)counts[PERF_CYCLES] / instructions);
+  }
+  fprintf(file, "\n");
+}
+
+void perf_print_classes(const Perf *const perf, FILE *file, const PerfClasses *const classes) {
+  fprintf(file, "%-32s %12s", "class", "executed");
+  for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+    if (perf_available(perf, counter)) {
+      fprintf(file, " %22s", perf_counter_name(counter));
+    }
+  }
+  fprintf(file, "\n");
+  // events are averaged over each class's instructions, so classes can be compared directly
+  for (int class = 0; class < PERF_CLASS_COUNT; class++) {
+    uint64_t executed = classes->instructions[class];
+    if (executed == 0) {
+      continue;
+    }
+    fprintf(file, "%-32s %12" PRIu64, CLASS_NAMES[class], executed);
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+      if (perf_available(perf, counter)) {
+        fprintf(file, " %22.3f", (double)classes->events[class].counts[counter] / executed);
+      }
+    }
+    fprintf(file, "\n");
+  }
+}
+
+void perf_close(Perf *perf) {
+  for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+    if (perf->fds[counter] != -1) {
+      close(perf->fds[counter]);
+    }
+  }
+  free(perf);
+}
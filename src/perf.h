@@ -0,0 +1,105 @@
+#ifndef PERF
+#define PERF
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Hardware performance counters for the interpreter's run loop, read with perf_event_open.
+//
+// Only events in the calling thread's user space code are counted, so the time spent in the kernel
+// (sleeping, drawing through the graphics driver) and in other threads (audio, capture, streaming)
+// isn't. The counters are opened as a group which is always scheduled together, so a whole group
+// can be read with one system call, which is cheap enough to do around every instruction.
+//
+// Counters are often unavailable: perf_event_paranoid can forbid them, and virtual machines and
+// containers often don't expose the CPU's counters at all. Anything which uses them should carry on
+// without them (see `perf_unavailable_reason`), and any single counter the CPU doesn't have is
+// left out of the group and reported as unavailable.
+
+// Counters, in the order they appear in a PerfSample
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1 // instructions of the host CPU, not the CHIP-8
+#define PERF_BRANCH_MISSES 2
+#define PERF_L1D_MISSES 3 // L1 data cache read misses
+#define PERF_COUNTER_COUNT 4
+
+// CHIP-8 instructions are classed by their first nibble (see the OP_ constants in control.h)
+#define PERF_CLASS_COUNT 16
+
+typedef struct PerfSample {
+  uint64_t counts[PERF_COUNTER_COUNT]; // 0 for counters which aren't available
+} PerfSample;
+
+// Events attributed to each class of CHIP-8 instruction
+typedef struct PerfClasses {
+  uint64_t instructions[PERF_CLASS_COUNT]; // CHIP-8 instructions executed in each class
+  PerfSample events[PERF_CLASS_COUNT];
+} PerfClasses;
+
+typedef struct Perf Perf;
+
+// Open the counters for the calling thread, stopped. Returns NULL with errno set if none of them
+// can be opened.
+// NOTE: This function uses memory allocation. It is expected that `perf_close` will be called
+// when the counters are no longer needed in order to free that memory.
+Perf* perf_open(void);
+
+// Describe why counters couldn't be opened
+// `error`: the errno left by `perf_open`
+const char* perf_unavailable_reason(int error);
+
+// Check whether a counter could be opened
+// `perf`: the counters
+// `counter`: one of the PERF_ counters
+bool perf_available(const Perf *const perf, int counter);
+
+// Get the name of a counter, as used by the perf tool
+// `counter`: one of the PERF_ counters
+const char* perf_counter_name(int counter);
+
+// Reset the counters to 0 and start counting
+// `perf`: the counters to start
+void perf_start(Perf *const perf);
+
+// Read the counters without stopping them, for attributing events to instructions. The values
+// aren't scaled for any time the group wasn't scheduled on the CPU.
+// `perf`: the counters to read
+// `sample`: out parameter for the values of the counters
+void perf_read(Perf *const perf, PerfSample *const sample);
+
+// Stop counting and read the totals since `perf_start`, scaled up for any time the group wasn't
+// scheduled on the CPU (when more counters are in use than the CPU has)
+// `perf`: the counters to stop
+// `total`: out parameter for the totals
+void perf_stop(Perf *const perf, PerfSample *const total);
+
+// Add the events between two reads of the counters to an instruction's class, less the cost of
+// reading the counters itself (measured when they were started)
+// `perf`: the counters which were read
+// `classes`: the classes to add the events to
+// `instruction`: the CHIP-8 instruction executed between the reads
+// `before`: the counters read before executing the instruction
+// `after`: the counters read after executing the instruction
+void perf_attribute(const Perf *const perf, PerfClasses *const classes, uint16_t instruction,
+    const PerfSample *const before, const PerfSample *const after);
+
+// Print totals on a single line, along with the rates which can be derived from them
+// `perf`: the counters the totals were read from
+// `file`: the file to print to
+// `total`: the totals from `perf_stop`
+// `instructions`: the number of CHIP-8 instructions executed, or 0 if unknown
+void perf_print(const Perf *const perf, FILE *file, const PerfSample *const total,
+    uint64_t instructions);
+
+// Print a table of the average events per instruction in each class which was executed
+// `perf`: the counters the classes were attributed from
+// `file`: the file to print to
+// `classes`: the classes to print
+void perf_print_classes(const Perf *const perf, FILE *file, const PerfClasses *const classes);
+
+// Close the counters and free their memory
+// `perf`: the counters to close
+void perf_close(Perf *perf);
+
+#endif
@@ -0,0 +1,145 @@
+#include "phosphor.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A row of image pixels is filled one vector at a time. GCC splits the vectors up into whatever
+// the target supports, so this is one AVX store or two SSE stores.
+#define VECTOR_PIXELS 8
+typedef uint32_t Pixels __attribute__((vector_size(VECTOR_PIXELS * sizeof(uint32_t))));
+
+struct Phosphor {
+  int width;
+  int height;
+  uint16_t persistence; // out of 256
+  bool scanlines;
+  uint8_t *brightness; // one byte per CHIP-8 pixel, from 0 to PHOSPHOR_ON
+  uint32_t colors[PHOSPHOR_ON + 1]; // the ARGB color of each brightness
+  uint32_t scanline_colors[PHOSPHOR_ON + 1]; // the same colors, darkened for the scanline gaps
+  int image_width;
+  int image_height;
+  int *columns; // where each CHIP-8 column starts in the image, plus the image width at the end
+  int *rows; // where each CHIP-8 row starts in the image, plus the image height at the end
+  uint32_t *row; // one row of the image, padded for the vector stores running past the end
+  uint32_t *scanline_row; // the same row, using the scanline colors
+};
+
+// Get an opaque gray ARGB color
+static uint32_t gray(uint8_t level) {
+  return 0xFF000000u | (uint32_t)level << 16 | (uint32_t)level << 8 | level;
+}
+
+Phosphor* phosphor_init(int width, int height, float persistence, bool scanlines) {
+  Phosphor *phosphor = calloc(1, sizeof(Phosphor));
+  if (phosphor == NULL) {
+    return NULL;
+  }
+  phosphor->width = width;
+  phosphor->height = height;
+  persistence = persistence < 0 ? 0 : persistence;
+  persistence = persistence > 255.0f / 256 ? 255.0f / 256 : persistence;
+  phosphor->persistence = (uint16_t)(persistence * 256 + 0.5f);
+  phosphor->scanlines = scanlines;
+  phosphor->brightness = calloc(width * height, 1);
+  phosphor->columns = calloc(width + 1, sizeof(int));
+  phosphor->rows = calloc(height + 1, sizeof(int));
+  if (phosphor->brightness == NULL || phosphor->columns == NULL || phosphor->rows == NULL) {
+    phosphor_destroy(phosphor);
+    return NULL;
+  }
+  for (int level = 0; level <= PHOSPHOR_ON; level++) {
+    phosphor->colors[level] = gray(level);
+    phosphor->scanline_colors[level] = gray(level / 2);
+  }
+  return phosphor;
+}
+
+bool phosphor_persistent(const Phosphor *const phosphor) {
+  return phosphor->persistence != 0;
+}
+
+void phosphor_update(Phosphor *const phosphor, const uint8_t *const screen) {
+  uint8_t *brightness = phosphor->brightness;
+  uint16_t persistence = phosphor->persistence;
+  for (int i = 0; i < phosphor->width * phosphor->height; i++) {
+    brightness[i] = screen[i] ? PHOSPHOR_ON : brightness[i] * persistence >> 8;
+  }
+}
+
+int phosphor_resize(Phosphor *const phosphor, int image_width, int image_height) {
+  if (image_width == phosphor->image_width && image_height == phosphor->image_height) {
+    return 0;
+  }
+  size_t row_size = (image_width + VECTOR_PIXELS) * sizeof(uint32_t);
+  uint32_t *row = malloc(row_size);
+  uint32_t *scanline_row = malloc(row_size);
+  if (row == NULL || scanline_row == NULL) {
+    free(row);
+    free(scanline_row);
+    return -1;
+  }
+  free(phosphor->row);
+  free(phosphor->scanline_row);
+  phosphor->row = row;
+  phosphor->scanline_row = scanline_row;
+  phosphor->image_width = image_width;
+  phosphor->image_height = image_height;
+
+  for (int col = 0; col <= phosphor->width; col++) {
+    phosphor->columns[col] = col * image_width / phosphor->width;
+  }
+  for (int r = 0; r <= phosphor->height; r++) {
+    phosphor->rows[r] = r * image_height / phosphor->height;
+  }
+  return 0;
+}
+
+// Fill a row of the image with the colors of a row of CHIP-8 pixels
+// `row`: the image row to fill, with room for VECTOR_PIXELS pixels past the end
+// `brightness`: the brightness of each CHIP-8 pixel in the row
+// `colors`: the color of each brightness
+static void fill_row(const Phosphor *const phosphor, uint32_t *const row,
+    const uint8_t *const brightness, const uint32_t *const colors) {
+  for (int col = 0; col < phosphor->width; col++) {
+    Pixels color = (Pixels){ 0 } + colors[brightness[col]];
+    // The last store usually runs past the end of this column, but the next column is filled
+    // right after and overwrites it. The row's padding covers the last column.
+    for (int x = phosphor->columns[col]; x < phosphor->columns[col + 1]; x += VECTOR_PIXELS) {
+      memcpy(row + x, &color, sizeof(color));
+    }
+  }
+}
+
+void phosphor_render(const Phosphor *const phosphor, uint32_t *const pixels, int pitch) {
+  size_t row_bytes = phosphor->image_width * sizeof(uint32_t);
+  for (int r = 0; r < phosphor->height; r++) {
+    const uint8_t *brightness = phosphor->brightness + r * phosphor->width;
+    int top = phosphor->rows[r];
+    int bottom = phosphor->rows[r + 1];
+    // the bottom third of each row is a gap between scanlines, once rows are big enough to see it
+    int gap = phosphor->scanlines && bottom - top >= 3 ? (bottom - top) / 3 : 0;
+
+    // every image row from the same CHIP-8 row is the same, so only one is filled in and copied
+    fill_row(phosphor, phosphor->row, brightness, phosphor->colors);
+    for (int y = top; y < bottom - gap; y++) {
+      memcpy((uint8_t*)pixels + (size_t)y * pitch, phosphor->row, row_bytes);
+    }
+    if (gap) {
+      fill_row(phosphor, phosphor->scanline_row, brightness, phosphor->scanline_colors);
+      for (int y = bottom - gap; y < bottom; y++) {
+        memcpy((uint8_t*)pixels + (size_t)y * pitch, phosphor->scanline_row, row_bytes);
+      }
+    }
+  }
+}
+
+void phosphor_destroy(Phosphor *phosphor) {
+  if (phosphor == NULL) {
+    return;
+  }
+  free(phosphor->brightness);
+  free(phosphor->columns);
+  free(phosphor->rows);
+  free(phosphor->row);
+  free(phosphor->scanline_row);
+  free(phosphor);
+}
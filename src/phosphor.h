@@ -0,0 +1,58 @@
+#ifndef PHOSPHOR
+#define PHOSPHOR
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A phosphor renderer turns CHIP-8 screens into ARGB8888 images of any size. Instead of showing
+// each pixel as only on or off, it keeps a brightness for every pixel which fades out over a few
+// frames after the pixel turns off, like the phosphor of a CRT. Sprites which the program erases
+// and redraws every frame (the usual way to move them) then stay visible instead of flickering.
+//
+// Images are scaled up with nearest neighbour sampling: every CHIP-8 pixel becomes a block of
+// identical image pixels, which are written as whole vectors at a time. When the image isn't a
+// whole multiple of the screen size, the blocks differ in size by at most one pixel.
+#define PHOSPHOR_ON 255 // brightness of a pixel which is on
+
+typedef struct Phosphor Phosphor;
+
+// Create a phosphor renderer with every pixel off, returning NULL if it can't be allocated.
+// NOTE: This function uses memory allocation. It is expected that `phosphor_destroy` will be
+// called when the renderer is no longer needed in order to free that memory.
+//
+// `width`: the width of the CHIP-8 screen
+// `height`: the height of the CHIP-8 screen
+// `persistence`: the fraction of its brightness a pixel keeps each frame after turning off, from
+//                0 (turns off immediately) up to but not including 1
+// `scanlines`: whether to darken the bottom of each row of CHIP-8 pixels, like the gaps between
+//              the scanlines of a CRT
+Phosphor* phosphor_init(int width, int height, float persistence, bool scanlines);
+
+// Check whether pixels fade out over multiple frames, in which case `phosphor_update` should be
+// called every frame even when the screen doesn't change
+// `phosphor`: the renderer to check
+bool phosphor_persistent(const Phosphor *const phosphor);
+
+// Advance the brightness of every pixel by one frame
+// `phosphor`: the renderer to update
+// `screen`: the CHIP-8 screen of this frame, one byte per pixel which is non-zero when it's on
+void phosphor_update(Phosphor *const phosphor, const uint8_t *const screen);
+
+// Set the size of the images `phosphor_render` creates, returning -1 if the memory for it
+// can't be allocated (leaving the previous size in place)
+// `phosphor`: the renderer to resize
+// `image_width`: the width of the image in pixels, at least the width of the CHIP-8 screen
+// `image_height`: the height of the image in pixels, at least the height of the CHIP-8 screen
+int phosphor_resize(Phosphor *const phosphor, int image_width, int image_height);
+
+// Render the current brightness of every pixel into an image
+// `phosphor`: the renderer to render with
+// `pixels`: the image to write to, in ARGB8888 format at the size set by `phosphor_resize`
+// `pitch`: the distance between the start of each row of the image, in bytes
+void phosphor_render(const Phosphor *const phosphor, uint32_t *const pixels, int pitch);
+
+// Free the memory used by a phosphor renderer
+// `phosphor`: the renderer to free
+void phosphor_destroy(Phosphor *phosphor);
+
+#endif
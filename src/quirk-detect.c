@@ -0,0 +1,197 @@
+#include "quirk-detect.h"
+#include "control.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Scripted input: each key in turn is held down for SCRIPT_HOLD frames and then released for
+// SCRIPT_GAP frames, so programs waiting for a key press or release always get one
+#define SCRIPT_HOLD 6
+#define SCRIPT_GAP 10
+// runs which fault rank below every run which doesn't, however badly that one scored
+#define FAULT_SCORE (-3.0 * DETECT_FRAMES)
+// how much running code outside the program counts against a run, per frame
+#define STRAY_WEIGHT 2
+
+// the command line option for each quirk
+static const struct {
+  unsigned bit;
+  const char *option;
+} QUIRK_OPTIONS[QUIRK_COUNT] = {
+  { QUIRK_LEGACY_SHIFT, "--old-shift" },
+  { QUIRK_JUMP, "--jump-quirk" },
+  { QUIRK_LEGACY_INDEXING, "--old-index" },
+};
+
+typedef struct DetectRun {
+  pthread_t thread;
+  Chip8 chip8;
+  uint16_t program_end; // the address after the last non-zero byte of the program
+  QuirkReport *report;
+} DetectRun;
+
+// Get the keys held down during a frame of the scripted input
+// `frame`: the index of the frame
+static void scripted_keys(long frame, uint8_t *const keys) {
+  long step = frame / (SCRIPT_HOLD + SCRIPT_GAP);
+  memset(keys, 0, KEY_COUNT);
+  if (frame % (SCRIPT_HOLD + SCRIPT_GAP) < SCRIPT_HOLD) {
+    keys[step % KEY_COUNT] = 1;
+  }
+}
+
+// Get the quirks which would change what an instruction does with the CHIP-8's current registers.
+// Shifts only differ when VX and VY do, and BNNN only when VX and V0 do.
+// `chip8`: the CHIP-8 about to run the instruction
+// `instruction`: the instruction about to run
+static unsigned affected_quirks(const Chip8 *const chip8, uint16_t instruction) {
+  uint8_t x = (instruction & OP_X) >> 8;
+  uint8_t y = (instruction & OP_Y) >> 4;
+  switch (instruction >> 12) {
+    case OP_ALU:
+      if (((instruction & OP_N) == ALU_SRL || (instruction & OP_N) == ALU_SLL)
+          && chip8->V[x] != chip8->V[y]) {
+        return QUIRK_LEGACY_SHIFT;
+      }
+      break;
+    case OP_JO:
+      return chip8->V[x] != chip8->V[0] ? QUIRK_JUMP : 0;
+    case OP_IO:
+      if ((instruction & OP_NN) == IO_SMEM || (instruction & OP_NN) == IO_LMEM) {
+        return QUIRK_LEGACY_INDEXING;
+      }
+      break;
+  }
+  return 0;
+}
+
+// Run a program with one combination of quirks and fill in its report, see `detect_quirks`
+static void* run_variant(void *arg) {
+  DetectRun *run = (DetectRun*)arg;
+  Chip8 *chip8 = &run->chip8;
+  QuirkReport *report = run->report;
+  uint8_t screen[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+  memcpy(screen, chip8->screen, sizeof(screen));
+
+  for (long frame = 0; frame < DETECT_FRAMES && chip8->pc < ADDRESS_COUNT && !chip8->fault;
+      frame++) {
+    scripted_keys(frame, chip8->key);
+    bool stray = false;
+    // the same as `exec_frame`, watching each instruction as it runs
+    while (chip8->frame_cycles < frame_budget(chip8) && chip8->pc < ADDRESS_COUNT
+        && !chip8->fault) {
+      stray |= chip8->pc < PROGRAM_START || chip8->pc >= run->program_end;
+      uint16_t instruction = fetch_instruction(chip8);
+      if (report->divergence < 0 && (affected_quirks(chip8, instruction) & report->quirks)) {
+        report->divergence = frame;
+      }
+      chip8->exec_variant(chip8, instruction);
+      account_instruction(chip8, instruction);
+    }
+    chip8_decrement_timers(chip8);
+
+    report->frames = frame + 1;
+    report->stray_frames += stray;
+    if (memcmp(screen, chip8->screen, sizeof(screen)) != 0) {
+      memcpy(screen, chip8->screen, sizeof(screen));
+      report->screen_changes++;
+    }
+  }
+
+  // a program counter which left memory without a fault (e.g. through BNNN with the wrong jump
+  // quirk) rules the run out all the same
+  report->fault = !chip8->fault && chip8->pc >= ADDRESS_COUNT ? FAULT_BAD_PC : chip8->fault;
+  report->score = report->fault ? FAULT_SCORE + report->frames
+    : (double)report->screen_changes - STRAY_WEIGHT * report->stray_frames;
+  return NULL;
+}
+
+// Pick the most plausible combination of quirks out of the reports, see quirk-detect.h
+static int pick_quirks(const QuirkReport reports[VARIANT_COUNT]) {
+  double best = reports[0].score;
+  bool diverged = false;
+  for (int quirks = 0; quirks < VARIANT_COUNT; quirks++) {
+    best = reports[quirks].score > best ? reports[quirks].score : best;
+    diverged |= reports[quirks].divergence >= 0;
+  }
+  if (!diverged) {
+    return 0;
+  }
+
+  double threshold = best - DETECT_TOLERANCE * (best < 0 ? -best : best);
+  int picked = -1;
+  for (int quirks = 0; quirks < VARIANT_COUNT; quirks++) {
+    if (reports[quirks].score >= threshold && (picked == -1
+        || __builtin_popcount(quirks) < __builtin_popcount(picked))) {
+      picked = quirks;
+    }
+  }
+  return picked;
+}
+
+int detect_quirks(const Chip8 *const chip8, QuirkReport reports[VARIANT_COUNT]) {
+  DetectRun *runs = calloc(VARIANT_COUNT, sizeof(DetectRun));
+  if (runs == NULL) {
+    return -1;
+  }
+  uint16_t program_end = ADDRESS_COUNT;
+  while (program_end > PROGRAM_START && chip8->memory[program_end - 1] == 0) {
+    program_end--;
+  }
+
+  int started = 0;
+  for (; started < VARIANT_COUNT; started++) {
+    DetectRun *run = &runs[started];
+    chip8_save_state(chip8, &run->chip8);
+#define SET_QUIRK(field, bit) run->chip8.config.field = (started & (bit)) != 0;
+    QUIRK_LIST(SET_QUIRK)
+#undef SET_QUIRK
+    run->chip8.exec_variant = select_instruction_handler(&run->chip8.config);
+    run->program_end = program_end;
+    run->report = &reports[started];
+    memset(run->report, 0, sizeof(QuirkReport));
+    run->report->quirks = started;
+    run->report->divergence = -1;
+    if (pthread_create(&run->thread, NULL, run_variant, run) != 0) {
+      break;
+    }
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(runs[i].thread, NULL);
+  }
+  free(runs);
+  return started == VARIANT_COUNT ? pick_quirks(reports) : -1;
+}
+
+void quirk_options(unsigned quirks, char *const options, size_t size) {
+  options[0] = 0;
+  size_t length = 0;
+  for (int i = 0; i < QUIRK_COUNT && length < size; i++) {
+    if (quirks & QUIRK_OPTIONS[i].bit) {
+      length += snprintf(options + length, size - length, "%s%s",
+          length ? " " : "", QUIRK_OPTIONS[i].option);
+    }
+  }
+  if (length == 0) {
+    snprintf(options, size, "none");
+  }
+}
+
+void print_quirk_reports(FILE *out, const QuirkReport reports[VARIANT_COUNT], int picked) {
+  fprintf(out, "%-38s %-22s %8s %8s %8s %8s\n",
+      "quirks", "fault", "diverges", "stray", "changes", "score");
+  for (int quirks = 0; quirks < VARIANT_COUNT; quirks++) {
+    const QuirkReport *report = &reports[quirks];
+    char options[64];
+    quirk_options(quirks, options, sizeof(options));
+    char fault[32];
+    if (report->fault) {
+      snprintf(fault, sizeof(fault), "%s", chip8_fault_message(report->fault));
+    } else {
+      snprintf(fault, sizeof(fault), "-");
+    }
+    fprintf(out, "%-38s %-22.22s %8ld %8ld %8ld %8.0f%s\n", options, fault, report->divergence,
+        report->stray_frames, report->screen_changes, report->score,
+        quirks == picked ? " <- picked" : "");
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef QUIRK_DETECT
+#define QUIRK_DETECT
+
+#include "chip8.h"
+#include "quirks.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Quirk detection runs a program headlessly under every combination of quirks at once (one thread
+// each) with scripted key presses, and picks the combination the program most plausibly expects.
+//
+// Each run is scored on signs that the program is working:
+// - faults (stack overflows or underflows, running off the end of memory) rule a run out, with
+//   runs which fault later ranked above ones which fault sooner
+// - running code outside the loaded program (usually data being executed after a bad jump, shift
+//   or index) counts against it, once per frame it happens in
+// - changes to the screen count for it, up to once per frame
+// Scores within DETECT_TOLERANCE of the best count as a tie, and ties go to the run with the
+// fewest quirks. Programs which never run an instruction that the quirks change always get no
+// quirks. Every run starts with the same random number generator as the program it was copied
+// from, but runs which take different paths use its numbers differently, which the tolerance also
+// covers.
+#define DETECT_FRAMES 3600 // one minute of 60 Hz frames
+#define DETECT_TOLERANCE 0.05 // fraction of the best score
+
+typedef struct QuirkReport {
+  unsigned quirks; // the quirk mask the program ran with
+  // the program's fault, FAULT_BAD_PC if it ran off the end of memory, or FAULT_NONE
+  uint8_t fault;
+  long frames; // frames run, less than DETECT_FRAMES if the program faulted or ended
+  long divergence; // first frame where these quirks changed what an instruction did, or -1
+  long stray_frames; // frames which ran code outside the loaded program
+  long screen_changes; // frames which changed the screen
+  double score;
+} QuirkReport;
+
+// Detect the quirks a program needs, returning the quirk mask of the most plausible combination
+// (see quirks.h), or -1 if the threads couldn't be started.
+// `chip8`: a CHIP-8 with the program loaded, which is copied for each run and left unchanged.
+//          Its timing config is kept, and its quirks are replaced.
+// `reports`: out parameter for a report of each run, indexed by quirk mask
+int detect_quirks(const Chip8 *const chip8, QuirkReport reports[VARIANT_COUNT]);
+
+// Print the reports of every run as a table, marking the one picked
+// `out`: the stream to print to
+// `reports`: the reports from `detect_quirks`
+// `picked`: the quirk mask which was picked
+void print_quirk_reports(FILE *out, const QuirkReport reports[VARIANT_COUNT], int picked);
+
+// Get the command line options which enable the quirks in a quirk mask, e.g. "--old-shift"
+// `quirks`: the quirk mask
+// `options`: out parameter for the options, separated by spaces (or "none")
+// `size`: the size of `options` in bytes
+void quirk_options(unsigned quirks, char *const options, size_t size);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef QUIRKS
+#define QUIRKS
+
+#include "chip8.h"
+
+// Bits used to represent each enabled quirk in a quirk mask
+#define QUIRK_LEGACY_SHIFT 0x1
+#define QUIRK_JUMP 0x2
+#define QUIRK_LEGACY_INDEXING 0x4
+
+// Every quirk that changes how instructions are executed, as X(ConfigFlags field, mask bit).
+//
+// To add a new quirk: add a field to ConfigFlags, a bit above and an entry here, bump
+// QUIRK_COUNT and add one more level to FOR_EACH_VARIANT. The instruction implementations in
+// control.c can then check `quirks & QUIRK_...` without slowing down the other variants.
+#define QUIRK_LIST(X) \
+  X(legacy_shift, QUIRK_LEGACY_SHIFT) \
+  X(jump_quirk, QUIRK_JUMP) \
+  X(legacy_indexing, QUIRK_LEGACY_INDEXING)
+
+#define QUIRK_COUNT 3
+// number of distinct quirk combinations, each of which gets its own interpreter
+#define VARIANT_COUNT (1 << QUIRK_COUNT)
+
+// Expand X(id, mask) once for every combination of quirks. Each level doubles the list by
+// appending a 0 or 1 to the id and setting its bit in the mask, so the ids read as the
+// mask in binary (e.g. v101 is QUIRK_LEGACY_INDEXING | QUIRK_LEGACY_SHIFT)
+#define VARIANTS_0(X, id, mask) X(id, mask)
+#define VARIANTS_1(X, id, mask) \
+  VARIANTS_0(X, id##0, mask) VARIANTS_0(X, id##1, (mask) | QUIRK_LEGACY_SHIFT)
+#define VARIANTS_2(X, id, mask) \
+  VARIANTS_1(X, id##0, mask) VARIANTS_1(X, id##1, (mask) | QUIRK_JUMP)
+#define VARIANTS_3(X, id, mask) \
+  VARIANTS_2(X, id##0, mask) VARIANTS_2(X, id##1, (mask) | QUIRK_LEGACY_INDEXING)
+#define FOR_EACH_VARIANT(X) VARIANTS_3(X, v, 0)
+
+// Get the quirk mask corresponding to the quirks enabled in a set of config flags
+// `config`: the config flags to read the quirks from
+unsigned quirk_mask(const ConfigFlags *const config);
+
+// Get the interpreter specialized for the quirks enabled in a set of config flags
+// `config`: the config flags to read the quirks from
+InstructionHandler select_instruction_handler(const ConfigFlags *const config);
+
+#endif
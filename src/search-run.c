@@ -0,0 +1,204 @@
+#include "chip8.h"
+#include "libchip8.h"
+#include "search.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Searches for the key inputs which get a program the highest score, or which crash it (see
+// search.h), and prints them.
+//
+// Scores are read from memory with --score [address], where most games keep them, and the address
+// can be found by watching memory while playing. --score-bytes [n] reads a score over several
+// bytes (most significant first), and --bcd reads each byte as a decimal digit, the way FX33
+// stores them. --crash searches for inputs which make the program fault instead.
+//
+// The search holds each input down for --frames [n] frames per step (10 by default), for
+// --depth [n] steps (30), keeping the best --width [n] states after each one (64). Inputs are no
+// key or any single key from --keys [list] (all of them by default), where `list` is a comma
+// separated list of hexadecimal CHIP-8 keys, and 4+6 holds down both 4 and 6.
+
+#define DEFAULT_DEPTH 30
+#define DEFAULT_WIDTH 64
+#define DEFAULT_FRAMES 10
+#define MAX_INPUTS (KEY_COUNT + 1)
+
+void help_menu() {
+  printf("Usage: chip8-search [...options] [rom-filepath]\n");
+  printf("Options:\t\tDescription\n");
+  printf("--score [address]\tRead the score to maximize from this address in memory\n");
+  printf("--score-bytes [n]\tRead the score from n bytes (1 to 8), most significant first (default 1)\n");
+  printf("--bcd\t\tRead each byte of the score as a decimal digit\n");
+  printf("--crash\t\tSearch for inputs which make the program fault instead of for a score\n");
+  printf("--depth [n]\tSearch n steps of input (default 30)\n");
+  printf("--width [n]\tKeep the best n states after each step (default 64)\n");
+  printf("--frames [n]\tHold each input down for n frames (default 10)\n");
+  printf("--threads [n]\tRun branches on n threads (default one per CPU)\n");
+  printf("--keys [list]\tOnly try these keys, e.g. 4,6,5 or 4+5,6+5 (default all of them)\n");
+  printf("--quirks [list]\tRun with these quirks, e.g. old-shift,vip (see golden.c)\n");
+}
+
+// Set the quirks of a CHIP-8 from a comma separated list, returning 0 if they are all valid
+static int parse_quirks(ConfigFlags *const config, char *const quirks) {
+  for (char *quirk = strtok(quirks, ","); quirk != NULL; quirk = strtok(NULL, ",")) {
+    if (strcmp(quirk, "old-shift") == 0) {
+      config->legacy_shift = 1;
+    } else if (strcmp(quirk, "jump-quirk") == 0) {
+      config->jump_quirk = 1;
+    } else if (strcmp(quirk, "old-index") == 0) {
+      config->legacy_indexing = 1;
+    } else if (strcmp(quirk, "vip") == 0) {
+      config->vip_timing = 1;
+    } else if (strcmp(quirk, "display-wait") == 0) {
+      config->display_wait = 1;
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Read the candidate inputs from a comma separated list of keys, always starting with no key.
+// Returns the number of inputs, or -1 if the list is invalid.
+static int parse_inputs(char *const list, uint16_t inputs[MAX_INPUTS]) {
+  int count = 0;
+  inputs[count++] = 0;
+  for (char *input = strtok(list, ","); input != NULL; input = strtok(NULL, ",")) {
+    if (count == MAX_INPUTS) {
+      return -1;
+    }
+    uint16_t keys = 0;
+    for (char *key = input; *key; key++) {
+      char digit[2] = { *key, 0 };
+      if (*key == '+') {
+        continue;
+      } else if (!strspn(digit, "0123456789abcdefABCDEF")) {
+        return -1;
+      }
+      keys |= 1 << strtol(digit, NULL, 16);
+    }
+    inputs[count++] = keys;
+  }
+  return count;
+}
+
+// Print an input as the keys held down, e.g. 4+6, or - for none
+static void print_input(uint16_t input) {
+  if (input == 0) {
+    printf("-");
+  }
+  for (int key = 0, first = 1; key < KEY_COUNT; key++) {
+    if (input & (1 << key)) {
+      printf("%s%X", first ? "" : "+", key);
+      first = 0;
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  char *rom_path = NULL;
+  SearchConfig config = {
+    .depth = DEFAULT_DEPTH,
+    .width = DEFAULT_WIDTH,
+    .frames = DEFAULT_FRAMES,
+    .threads = sysconf(_SC_NPROCESSORS_ONLN),
+    .evaluate = search_memory_score,
+  };
+  MemoryScore score = { .size = 1 };
+  bool has_score = false;
+  bool crash = false;
+  uint16_t inputs[MAX_INPUTS];
+  char all_keys[] = "0,1,2,3,4,5,6,7,8,9,A,B,C,D,E,F";
+  char *keys = all_keys;
+  ConfigFlags flags = { 0 };
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--score", 8) == 0 && i + 1 < argc) {
+      score.address = strtol(argv[++i], NULL, 0) & ADDRESS_MASK;
+      has_score = true;
+    } else if (strncmp(argv[i], "--score-bytes", 14) == 0 && i + 1 < argc) {
+      score.size = atoi(argv[++i]);
+      if (score.size < 1 || score.size > MAX_SCORE_BYTES) {
+        fprintf(stderr, "The score has to be from 1 to %d bytes\n", MAX_SCORE_BYTES);
+        return -1;
+      }
+    } else if (strncmp(argv[i], "--bcd", 6) == 0) {
+      score.bcd = true;
+    } else if (strncmp(argv[i], "--crash", 8) == 0) {
+      crash = true;
+    } else if (strncmp(argv[i], "--depth", 8) == 0 && i + 1 < argc) {
+      config.depth = atoi(argv[++i]);
+    } else if (strncmp(argv[i], "--width", 8) == 0 && i + 1 < argc) {
+      config.width = atoi(argv[++i]);
+    } else if (strncmp(argv[i], "--frames", 9) == 0 && i + 1 < argc) {
+      config.frames = atoi(argv[++i]);
+    } else if (strncmp(argv[i], "--threads", 10) == 0 && i + 1 < argc) {
+      config.threads = atoi(argv[++i]);
+    } else if (strncmp(argv[i], "--keys", 7) == 0 && i + 1 < argc) {
+      keys = argv[++i];
+    } else if (strncmp(argv[i], "--quirks", 9) == 0 && i + 1 < argc) {
+      if (parse_quirks(&flags, argv[++i])) {
+        fprintf(stderr, "Unknown quirk in %s\n", argv[i]);
+        return -1;
+      }
+    } else {
+      rom_path = argv[i];
+    }
+  }
+  if (rom_path == NULL || has_score == crash) {
+    help_menu();
+    return -1;
+  }
+  config.input_count = parse_inputs(keys, inputs);
+  if (config.input_count < 0) {
+    fprintf(stderr, "Invalid list of keys %s\n", keys);
+    return -1;
+  }
+  config.inputs = inputs;
+  if (crash) {
+    config.evaluate = search_fault_score;
+  } else {
+    config.context = &score;
+  }
+
+  Chip8 *chip8 = chip8_create();
+  chip8_configure(chip8, &flags);
+  if (load_program(chip8, rom_path) < 0) {
+    fprintf(stderr, "Unable to load program %s\n", rom_path);
+    chip8_destroy(chip8);
+    return -1;
+  }
+  Search *search = search_create(&config);
+  if (search == NULL) {
+    fprintf(stderr, "Unable to start the search\n");
+    chip8_destroy(chip8);
+    return -1;
+  }
+
+  uint16_t *path = malloc(config.depth * sizeof(uint16_t));
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  SearchResult result;
+  search_run(search, chip8, &result, path);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  printf("Ran %llu branches in %.2f s (%.1f million states per minute)\n",
+      (unsigned long long)result.branches, seconds, result.branches / seconds * 60 / 1e6);
+  printf("Best score %.0f after %d steps of %d frames", result.score, result.steps, config.frames);
+  if (result.fault) {
+    printf(", where the program stopped with a %s", chip8_fault_message(result.fault));
+  }
+  printf("\nInputs:");
+  for (int step = 0; step < result.steps; step++) {
+    printf(" ");
+    print_input(path[step]);
+  }
+  printf("\n");
+
+  free(path);
+  search_destroy(search);
+  chip8_destroy(chip8);
+  return 0;
+}
@@ -0,0 +1,276 @@
+#include "search.h"
+#include "libchip8.h"
+#include "pack.h"
+#include "quirks.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A branch of the current step, which the threads run and score
+typedef struct Branch {
+  int parent; // index of the state it was cloned from in the beam
+  uint16_t input;
+  double score;
+  uint64_t hash; // of its whole state, to leave out branches which end up in the same state
+  bool ended; // whether the program faulted or ran off the end of memory
+} Branch;
+
+// A branch's place in the order of the branches, from the best to the worst
+typedef struct Ranking {
+  double score;
+  int index; // in `Search.branches`
+} Ranking;
+
+// A state kept in the beam at some step, for tracing the path back to the root
+typedef struct Step {
+  int parent; // index in the previous step's beam, or -1 at the first step
+  uint16_t input;
+} Step;
+
+struct Search {
+  SearchConfig config;
+  Chip8 *beam; // `width` states, the ones being expanded
+  int beam_size;
+  Chip8 *states; // `width * input_count` states, one for each branch
+  Branch *branches;
+  int branch_count;
+  Ranking *order; // the branches, sorted by score
+  Step *steps; // `depth * width` entries, the beam at each step
+
+  pthread_t *threads;
+  int thread_count; // threads which were started
+  pthread_mutex_t lock;
+  pthread_cond_t start; // signalled when a step's branches are ready to run, or to quit
+  pthread_cond_t done; // signalled when the last thread finishes running a step's branches
+  uint64_t generation; // incremented every time the threads are started
+  int running; // threads which haven't finished the current step yet
+  bool quit;
+  int next; // index of the next branch for a thread to take, taken atomically
+};
+
+// Clone, run and score a single branch
+static void run_branch(Search *const search, int index) {
+  const SearchConfig *config = &search->config;
+  Branch *branch = &search->branches[index];
+  Chip8 *chip8 = &search->states[index];
+  branch->parent = index / config->input_count;
+  branch->input = config->inputs[index % config->input_count];
+  chip8_save_state(&search->beam[branch->parent], chip8);
+
+  uint8_t keys[KEY_COUNT];
+  for (int key = 0; key < KEY_COUNT; key++) {
+    keys[key] = (branch->input >> key) & 1;
+  }
+  for (int frame = 0; frame < config->frames && chip8->pc < ADDRESS_COUNT; frame++) {
+    if (chip8_run_frame(chip8, keys)) {
+      break;
+    }
+  }
+  branch->ended = chip8->fault || chip8->pc >= ADDRESS_COUNT;
+  branch->score = config->evaluate(chip8, config->context);
+  // memory isn't part of `chip8_hash_state`, but states which only differ in memory still differ
+  branch->hash = chip8_hash_state(chip8) ^ pack_hash(chip8->memory, ADDRESS_COUNT);
+}
+
+static void run_branches(Search *const search) {
+  int index;
+  while ((index = __atomic_fetch_add(&search->next, 1, __ATOMIC_RELAXED)) < search->branch_count) {
+    run_branch(search, index);
+  }
+}
+
+static void* search_thread(void *arg) {
+  Search *search = arg;
+  uint64_t generation = 0;
+  pthread_mutex_lock(&search->lock);
+  while (true) {
+    while (search->generation == generation && !search->quit) {
+      pthread_cond_wait(&search->start, &search->lock);
+    }
+    if (search->quit) {
+      break;
+    }
+    generation = search->generation;
+    pthread_mutex_unlock(&search->lock);
+
+    run_branches(search);
+
+    pthread_mutex_lock(&search->lock);
+    if (--search->running == 0) {
+      pthread_cond_signal(&search->done);
+    }
+  }
+  pthread_mutex_unlock(&search->lock);
+  return NULL;
+}
+
+// Run every branch of the beam on the threads, returning once they've all been scored
+static void run_step(Search *const search) {
+  search->branch_count = search->beam_size * search->config.input_count;
+  search->next = 0;
+  pthread_mutex_lock(&search->lock);
+  search->running = search->thread_count;
+  search->generation++;
+  pthread_cond_broadcast(&search->start);
+  while (search->running > 0) {
+    pthread_cond_wait(&search->done, &search->lock);
+  }
+  pthread_mutex_unlock(&search->lock);
+}
+
+static void stop_threads(Search *const search) {
+  pthread_mutex_lock(&search->lock);
+  search->quit = true;
+  pthread_cond_broadcast(&search->start);
+  pthread_mutex_unlock(&search->lock);
+  for (int i = 0; i < search->thread_count; i++) {
+    pthread_join(search->threads[i], NULL);
+  }
+}
+
+Search* search_create(const SearchConfig *const config) {
+  if (config->depth < 1 || config->width < 1 || config->frames < 1 || config->threads < 1
+      || config->input_count < 1 || config->evaluate == NULL) {
+    return NULL;
+  }
+  Search *search = calloc(1, sizeof(Search));
+  if (search == NULL) {
+    return NULL;
+  }
+  search->config = *config;
+  pthread_mutex_init(&search->lock, NULL);
+  pthread_cond_init(&search->start, NULL);
+  pthread_cond_init(&search->done, NULL);
+  size_t branches = (size_t)config->width * config->input_count;
+  search->beam = malloc(config->width * sizeof(Chip8));
+  search->states = malloc(branches * sizeof(Chip8));
+  search->branches = malloc(branches * sizeof(Branch));
+  search->order = malloc(branches * sizeof(Ranking));
+  search->steps = malloc((size_t)config->depth * config->width * sizeof(Step));
+  search->threads = malloc(config->threads * sizeof(pthread_t));
+  if (search->beam == NULL || search->states == NULL || search->branches == NULL
+      || search->order == NULL || search->steps == NULL || search->threads == NULL) {
+    search_destroy(search);
+    return NULL;
+  }
+
+  for (; search->thread_count < config->threads; search->thread_count++) {
+    if (pthread_create(&search->threads[search->thread_count], NULL, search_thread, search)) {
+      search_destroy(search);
+      return NULL;
+    }
+  }
+  return search;
+}
+
+// Order branches from the highest score to the lowest, and then in the order they were expanded
+static int compare_branches(const void *a, const void *b) {
+  const Ranking *first = a;
+  const Ranking *second = b;
+  if (first->score != second->score) {
+    return first->score < second->score ? 1 : -1;
+  }
+  return first->index - second->index;
+}
+
+// Check whether a branch ended up in the same state as one of the branches already kept
+static bool is_duplicate(const Search *const search, const Branch *const branch, int kept) {
+  for (int i = 0; i < kept; i++) {
+    if (search->branches[search->order[i].index].hash == branch->hash) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void search_run(Search *const search, const Chip8 *const root, SearchResult *const result,
+    uint16_t *const path) {
+  const SearchConfig *config = &search->config;
+  chip8_save_state(root, &search->beam[0]);
+  search->beam[0].exec_variant = select_instruction_handler(&root->config);
+  search->beam_size = 1;
+
+  memset(result, 0, sizeof(SearchResult));
+  result->score = -INFINITY;
+  int best_step = -1; // step the best branch was found at, -1 for none
+  int best_parent = 0;
+  uint16_t best_input = 0;
+
+  for (int step = 0; step < config->depth && search->beam_size > 0; step++) {
+    run_step(search);
+    result->branches += search->branch_count;
+
+    for (int i = 0; i < search->branch_count; i++) {
+      search->order[i] = (Ranking){ search->branches[i].score, i };
+    }
+    qsort(search->order, search->branch_count, sizeof(Ranking), compare_branches);
+    const Branch *best = &search->branches[search->order[0].index];
+    if (best->score > result->score) {
+      result->score = best->score;
+      result->fault = search->states[search->order[0].index].fault;
+      best_step = step;
+      best_parent = best->parent;
+      best_input = best->input;
+    }
+
+    // keep the best distinct branches which can still go on running, reordering them in place
+    int kept = 0;
+    for (int i = 0; i < search->branch_count && kept < config->width; i++) {
+      const Branch *branch = &search->branches[search->order[i].index];
+      if (!branch->ended && !is_duplicate(search, branch, kept)) {
+        search->order[kept++] = search->order[i];
+      }
+    }
+    Step *steps = &search->steps[step * config->width];
+    for (int i = 0; i < kept; i++) {
+      const Branch *branch = &search->branches[search->order[i].index];
+      steps[i].parent = step ? branch->parent : -1;
+      steps[i].input = branch->input;
+      chip8_save_state(&search->states[search->order[i].index], &search->beam[i]);
+    }
+    search->beam_size = kept;
+  }
+
+  // follow the best branch's parents back to the root
+  result->steps = best_step + 1;
+  if (best_step >= 0) {
+    path[best_step] = best_input;
+    int parent = best_step ? best_parent : -1;
+    for (int step = best_step - 1; step >= 0; step--) {
+      const Step *kept = &search->steps[step * config->width + parent];
+      path[step] = kept->input;
+      parent = kept->parent;
+    }
+  }
+}
+
+void search_destroy(Search *search) {
+  if (search->thread_count) {
+    stop_threads(search);
+  }
+  pthread_mutex_destroy(&search->lock);
+  pthread_cond_destroy(&search->start);
+  pthread_cond_destroy(&search->done);
+  free(search->beam);
+  free(search->states);
+  free(search->branches);
+  free(search->order);
+  free(search->steps);
+  free(search->threads);
+  free(search);
+}
+
+double search_memory_score(const Chip8 *const chip8, void *context) {
+  const MemoryScore *score = context;
+  double value = 0;
+  for (int i = 0; i < score->size; i++) {
+    value = value * (score->bcd ? 10 : 256) + chip8->memory[(score->address + i) & ADDRESS_MASK];
+  }
+  return value;
+}
+
+double search_fault_score(const Chip8 *const chip8, void *context) {
+  (void)context;
+  return chip8->fault != FAULT_NONE;
+}
@@ -0,0 +1,91 @@
+#ifndef SEARCH
+#define SEARCH
+
+#include "chip8.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Beam search over key inputs, for automated agents that explore a program's states, e.g. to find
+// inputs that crash it or that get the highest score.
+//
+// Every step, each state kept from the previous step (the beam) is cloned once for every
+// candidate input, and each clone (a branch) runs headlessly for a fixed number of frames holding
+// that input down. Branches are run on a pool of threads, and scored by an evaluator. The best
+// `width` branches, leaving out any which ended up in the same state as a better one, become the
+// beam for the next step. Branches where the program faulted or ended can still be the best found,
+// but aren't explored any further.
+//
+// All of the states are allocated up front when the search is created and reused every step, so
+// running a search doesn't allocate any memory, and cloning a branch is a single copy of its
+// parent (see `chip8_save_state`).
+//
+// Each branch carries on its parent's random number generator (see `chip8_seed`), so searches are
+// repeatable, and playing the inputs found back from the same starting state gets the same result.
+
+// Score a state, higher is better. Called from the search's threads, so it must be thread safe.
+// `chip8`: the state of a branch after running its frames
+// `context`: the evaluator's context from the SearchConfig
+typedef double (*SearchEvaluator)(const Chip8 *const chip8, void *context);
+
+typedef struct SearchConfig {
+  int depth; // number of steps to search
+  int width; // number of states kept after each step
+  int frames; // frames each input is held down for
+  int threads; // threads to run branches on
+  const uint16_t *inputs; // candidate inputs, as bitmasks of keys held down (bit N = key N)
+  int input_count;
+  SearchEvaluator evaluate;
+  void *context; // passed to `evaluate`
+} SearchConfig;
+
+typedef struct SearchResult {
+  double score; // score of the best state found
+  int steps; // number of inputs leading to the best state
+  uint8_t fault; // fault of the best state, or FAULT_NONE
+  uint64_t branches; // number of branches run over the whole search
+} SearchResult;
+
+// Evaluator context for reading a score from memory, which is where most games keep it
+#define MAX_SCORE_BYTES 8
+typedef struct MemoryScore {
+  uint16_t address; // address of the score's first byte
+  int size; // number of bytes in the score, from 1 to MAX_SCORE_BYTES
+  bool bcd; // whether each byte is a decimal digit (as stored by FX33) instead of a binary byte
+} MemoryScore;
+
+typedef struct Search Search;
+
+// Create a search, allocating every state it will need and starting its threads. Returns NULL
+// if the config is invalid, the memory can't be allocated or the threads can't be started.
+// NOTE: This function uses memory allocation. It is expected that `search_destroy` will be called
+// when the search is no longer needed in order to free that memory.
+// `config`: the search's parameters, copied (apart from the inputs and context, which have to stay
+// valid until the search is destroyed)
+Search* search_create(const SearchConfig *const config);
+
+// Search for the inputs which lead to the best scoring state from a starting state
+// `search`: the search to run
+// `root`: the starting state, which is left unchanged
+// `result`: out parameter for the best state found and statistics about the search
+// `path`: out parameter for the inputs leading to the best state, which needs room for the
+// config's `depth` inputs (only the first `result->steps` are set)
+void search_run(Search *const search, const Chip8 *const root, SearchResult *const result,
+    uint16_t *const path);
+
+// Stop a search's threads and free its memory
+// `search`: the search to free
+void search_destroy(Search *search);
+
+// Evaluator which reads a score from memory (see MemoryScore)
+// `chip8`: the state to score
+// `context`: a MemoryScore
+double search_memory_score(const Chip8 *const chip8, void *context);
+
+// Evaluator which scores states where the program faulted as 1 and any others as 0, for finding
+// inputs which crash a program. The states which tie are kept in the order their branches were
+// expanded, so the beam keeps the distinct states reached with the earliest inputs.
+// `chip8`: the state to score
+// `context`: unused
+double search_fault_score(const Chip8 *const chip8, void *context);
+
+#endif
@@ -0,0 +1,228 @@
+#include "stream.h"
+#include "chip8.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define ROW_BYTES (DISPLAY_WIDTH / 8)
+// largest message: the header plus a byte mask and every byte of every row
+#define MAX_MESSAGE_SIZE (5 + DISPLAY_HEIGHT * (1 + ROW_BYTES))
+
+typedef struct Client {
+  int fd; // -1 when the slot is free
+  uint16_t keys; // bitmask of the keys this client is holding down
+  bool sent_screen; // whether the client has been sent the full screen yet
+} Client;
+
+struct Stream {
+  int listen_fd;
+  char unix_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+  Client clients[STREAM_MAX_CLIENTS];
+  uint16_t keys; // union of the keys held by every client
+  uint8_t published[DISPLAY_HEIGHT][ROW_BYTES]; // packed screen most recently sent out
+};
+
+static int set_nonblocking(int fd) {
+  return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+Stream* stream_open(const char *address) {
+  Stream *stream = calloc(1, sizeof(Stream));
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    stream->clients[i].fd = -1;
+  }
+
+  int result = -1;
+  if (strncmp(address, "unix:", 5) == 0 && strlen(address + 5) < sizeof(stream->unix_path)) {
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, address + 5);
+    strcpy(stream->unix_path, address + 5);
+    // remove the socket left behind by a previous run
+    unlink(addr.sun_path);
+    stream->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    result = bind(stream->listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+  } else if (strncmp(address, "tcp:", 4) == 0) {
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(address + 4));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    stream->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(stream->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    result = bind(stream->listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+  } else {
+    stream->listen_fd = -1;
+  }
+
+  if (stream->listen_fd < 0 || result < 0 || listen(stream->listen_fd, STREAM_MAX_CLIENTS) < 0
+      || set_nonblocking(stream->listen_fd) < 0) {
+    if (stream->listen_fd >= 0) {
+      close(stream->listen_fd);
+    }
+    free(stream);
+    return NULL;
+  }
+  return stream;
+}
+
+static void disconnect(Stream *const stream, Client *client) {
+  close(client->fd);
+  client->fd = -1;
+  client->keys = 0;
+}
+
+// Accept every client waiting to connect, as long as there is room for them
+static void accept_clients(Stream *const stream) {
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    Client *client = &stream->clients[i];
+    if (client->fd != -1) {
+      continue;
+    }
+    int fd = accept(stream->listen_fd, NULL, NULL);
+    if (fd < 0) {
+      return;
+    }
+    set_nonblocking(fd);
+    client->fd = fd;
+    client->keys = 0;
+    client->sent_screen = false;
+  }
+}
+
+// Read every key event a client has sent, disconnecting it if the connection was closed
+static void read_keys(Stream *const stream, Client *client) {
+  uint8_t events[64];
+  while (1) {
+    // events are 2 bytes, so only read whole events to avoid having to buffer half of one
+    ssize_t count = recv(client->fd, events, sizeof(events), MSG_DONTWAIT | MSG_PEEK);
+    if (count == 0 || (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      disconnect(stream, client);
+      return;
+    }
+    if (count < 2) {
+      return;
+    }
+    count = recv(client->fd, events, count & ~1, MSG_DONTWAIT);
+    for (int i = 0; i + 1 < count; i += 2) {
+      uint16_t key = 1 << (events[i] & 0xF);
+      client->keys = events[i + 1] ? client->keys | key : client->keys & ~key;
+    }
+  }
+}
+
+// Build a frame message from the XOR of two packed screens, returning its size
+// (or 0 if nothing changed)
+static int build_message(uint8_t *message, uint8_t current[DISPLAY_HEIGHT][ROW_BYTES],
+    uint8_t previous[DISPLAY_HEIGHT][ROW_BYTES]) {
+  uint32_t rows = 0;
+  int size = 5;
+  for (int row = 0; row < DISPLAY_HEIGHT; row++) {
+    uint8_t byte_mask = 0;
+    int mask_pos = size++;
+    for (int byte = 0; byte < ROW_BYTES; byte++) {
+      uint8_t delta = current[row][byte] ^ previous[row][byte];
+      if (delta) {
+        byte_mask |= 1 << byte;
+        message[size++] = delta;
+      }
+    }
+    if (byte_mask) {
+      rows |= (uint32_t)1 << row;
+      message[mask_pos] = byte_mask;
+    } else {
+      size--; // nothing changed in the row, so drop its byte mask
+    }
+  }
+  if (!rows) {
+    return 0;
+  }
+  message[0] = STREAM_MSG_FRAME;
+  for (int i = 0; i < 4; i++) {
+    message[1 + i] = rows >> (8 * i);
+  }
+  return size;
+}
+
+// Send a whole message to a client, disconnecting it if it can't keep up
+static void send_message(Stream *const stream, Client *client, uint8_t *message, int size) {
+  if (send(client->fd, message, size, MSG_DONTWAIT | MSG_NOSIGNAL) != size) {
+    disconnect(stream, client);
+  }
+}
+
+void stream_publish(Stream *const stream, const uint8_t *const screen) {
+  accept_clients(stream);
+
+  uint8_t packed[DISPLAY_HEIGHT][ROW_BYTES];
+  for (int row = 0; row < DISPLAY_HEIGHT; row++) {
+    for (int byte = 0; byte < ROW_BYTES; byte++) {
+      const uint8_t *pixels = screen + row * DISPLAY_WIDTH + byte * 8;
+      uint8_t bits = 0;
+      for (int bit = 0; bit < 8; bit++) {
+        bits = bits << 1 | (pixels[bit] != 0);
+      }
+      packed[row][byte] = bits;
+    }
+  }
+
+  uint8_t delta[MAX_MESSAGE_SIZE];
+  uint8_t full[MAX_MESSAGE_SIZE];
+  uint8_t blank[DISPLAY_HEIGHT][ROW_BYTES] = { 0 };
+  int delta_size = build_message(delta, packed, stream->published);
+  int full_size = -1; // only built if a new client needs it
+
+  stream->keys = 0;
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    Client *client = &stream->clients[i];
+    if (client->fd == -1) {
+      continue;
+    }
+    read_keys(stream, client);
+    if (client->fd == -1) {
+      continue;
+    }
+    if (!client->sent_screen) {
+      if (full_size == -1) {
+        full_size = build_message(full, packed, blank);
+      }
+      if (full_size) {
+        send_message(stream, client, full, full_size);
+      }
+      client->sent_screen = true;
+    } else if (delta_size) {
+      send_message(stream, client, delta, delta_size);
+    }
+    if (client->fd != -1) {
+      stream->keys |= client->keys;
+    }
+  }
+
+  memcpy(stream->published, packed, sizeof(packed));
+}
+
+void stream_merge_input(Stream *const stream, uint8_t *const keys) {
+  for (int key = 0; key < KEY_COUNT; key++) {
+    keys[key] |= (stream->keys >> key) & 1;
+  }
+}
+
+void stream_close(Stream *stream) {
+  for (int i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    if (stream->clients[i].fd != -1) {
+      close(stream->clients[i].fd);
+    }
+  }
+  close(stream->listen_fd);
+  if (stream->unix_path[0]) {
+    unlink(stream->unix_path);
+  }
+  free(stream);
+}
@@ -0,0 +1,52 @@
+#ifndef STREAM
+#define STREAM
+
+#include <stdint.h>
+
+// A stream server publishes the screen of a running CHIP-8 to any connected clients once per
+// 60 Hz frame, and lets clients press keys on the CHIP-8.
+//
+// Server -> client, one message per frame in which the screen changed:
+//   - 1 byte: STREAM_MSG_FRAME
+//   - 4 bytes: little-endian bitmask of the rows which changed (bit N = row N)
+//   - for each changed row, from top to bottom:
+//     - 1 byte: bitmask of the bytes in the row which changed (bit N = pixels 8N to 8N + 7)
+//     - 1 byte for each changed byte, holding the changed pixels XOR'd with their previous value
+//       (most significant bit = leftmost pixel)
+// The first message after connecting is XOR'd against a blank screen, so it holds the whole
+// screen. Clients which fall behind are disconnected, and can reconnect to get a full screen.
+//
+// Client -> server, 2 bytes per key event:
+//   - 1 byte: the CHIP-8 key (0x0 - 0xF)
+//   - 1 byte: 1 if the key was pressed, 0 if it was released
+#define STREAM_MSG_FRAME 'F'
+#define STREAM_MAX_CLIENTS 8
+
+typedef struct Stream Stream;
+
+// Start a stream server listening on the given address, returning NULL if the socket could
+// not be created. The address is either "unix:[path]" for a Unix domain socket or "tcp:[port]"
+// for a TCP socket listening on the loopback interface.
+// NOTE: This function uses memory allocation. It is expected that `stream_close` will be called
+// when the program is finished in order to free that memory.
+//
+// `address`: the address to listen on
+Stream* stream_open(const char *address);
+
+// Accept new clients, read key events from connected clients and send every client the rows
+// of the screen which changed since the last call. This never blocks.
+//
+// `stream`: the stream server
+// `screen`: the screen of the CHIP-8, with 1 byte per pixel
+void stream_publish(Stream *const stream, const uint8_t *const screen);
+
+// Combine the keys held down by the stream's clients into an array of key states
+// `stream`: the stream server
+// `keys`: the key states to update, a key held by any client is set to 1
+void stream_merge_input(Stream *const stream, uint8_t *const keys);
+
+// Disconnect all clients and close the stream server
+// `stream`: the stream server to close
+void stream_close(Stream *stream);
+
+#endif
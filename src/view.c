@@ -4,26 +4,74 @@
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL_video.h>
+#include <ctype.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include "view.h"
+#include "chip8-timer.h"
 #include "key-bindings.h"
+#include "metrics.h"
+#include "phosphor.h"
+
+#define OVERLAY_SIZE 256
+#define GLYPH_WIDTH 3
+#define GLYPH_HEIGHT 5
+#define GLYPH_SCALE 2 // size of each pixel of the overlay font, in window pixels
+#define BINDING_COUNT (int)(sizeof(BINDINGS) / sizeof(BINDINGS[0]))
+
+// 3x5 font for the overlay, each glyph is written out row by row
+static const char *const GLYPH_CHARS = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:/-%";
+static const char *const GLYPHS[] = {
+  "111101101101111", "010110010010111", "111001111100111", "111001111001111", // 0-3
+  "101101111001001", "111100111001111", "111100111101111", "111001001001001", // 4-7
+  "111101111101111", "111101111001111", "010101111101101", "110101110101110", // 8, 9, A, B
+  "011100100100011", "110101101101110", "111100110100111", "111100110100100", // C-F
+  "011100101101011", "101101111101101", "111010010010111", "001001001101010", // G-J
+  "101101110101101", "100100100100111", "101111111101101", "110101101101101", // K-N
+  "010101101101010", "110101110100100", "010101101110011", "110101110101101", // O-R
+  "011100010001110", "111010010010010", "101101101101111", "101101101101010", // S-V
+  "101101111111101", "101101010101101", "101101010010010", "111001010100111", // W-Z
+  "000000000000010", "000010000010000", "001001010100100", "000000111000000", // . : / -
+  "101001010100101", // %
+};
 
 struct View {
   struct SDL_Window* window;
   struct SDL_Renderer* renderer;
-  int tile_size;
   int tiles_width;
   int tiles_height;
+  Phosphor *phosphor; // turns the screen into the image drawn in the window
+  SDL_Texture *texture; // the image, at the size it's drawn
+  SDL_Rect image; // where the image is drawn, as big as fits in the window
+  bool resized; // whether the image needs a new size before drawing it
   SDL_AudioSpec sound;
   int sample_count;
   bool playing_sound;
+  Metrics *metrics;
+  uint64_t last_callback_us; // only used by the audio thread
+  bool show_overlay;
+  char overlay[OVERLAY_SIZE];
+  unsigned char key_map[BINDING_COUNT]; // the binding which presses each CHIP-8 key
 };
 
 void audio_callback(void *user_data, Uint8 *raw_buffer, int bytes) {
   Sint16 *buffer = (Sint16*)raw_buffer;
   int length = bytes / 2; // 2 bytes per sample for AUDIO_S16SYS
-  int *sample_count = (int*)user_data; 
+  struct View *view = (struct View*)user_data;
+  int *sample_count = &view->sample_count;
+
+  if (view->metrics) {
+    // if the device asks for more audio well after the previous buffer should have run out,
+    // there was a gap in the sound
+    uint64_t now = current_time_us();
+    uint64_t buffer_us = (uint64_t)length * 1000000 / SAMPLE_RATE;
+    if (view->last_callback_us && now - view->last_callback_us > buffer_us * 3 / 2) {
+      metrics_add(&view->metrics->audio_underruns, 1);
+    }
+    view->last_callback_us = now;
+    metrics_add(&view->metrics->audio_callbacks, 1);
+  }
 
   for(int i = 0; i < length; i++, (*sample_count)++) {
     double time = (double)*sample_count / (double)SAMPLE_RATE;
@@ -31,24 +79,31 @@ void audio_callback(void *user_data, Uint8 *raw_buffer, int bytes) {
   }
 }
 
-View* view_init(int tiles_horiz, int tiles_vert, int tile_size, const char *title) {
+View* view_init(int tiles_horiz, int tiles_vert, double scale, const char *title) {
   struct View *view = malloc(sizeof(struct View));
 
   // calculate dimensions using the count and size of tiles, which are way smaller
-  int width = tiles_horiz * tile_size;
-  int height = tiles_vert * tile_size;
+  int width = (int)(tiles_horiz * scale + 0.5);
+  int height = (int)(tiles_vert * scale + 0.5);
 
   view->window = SDL_CreateWindow(
     title,
     SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
     width, height,
-    SDL_WINDOW_SHOWN
+    SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
   );
   view->renderer = SDL_CreateRenderer(view->window, -1, 0);
-  view->tile_size = tile_size;
   view->tiles_width = tiles_horiz;
   view->tiles_height = tiles_vert;
+  view->phosphor = phosphor_init(tiles_horiz, tiles_vert, 0, false);
+  view->texture = NULL;
+  view->resized = true;
   view->playing_sound = false;
+  view->metrics = NULL;
+  view->last_callback_us = 0;
+  view->show_overlay = false;
+  view->overlay[0] = 0;
+  view_set_key_map(view, NULL, 0);
   
   // setup the data for SDL audio to play
   int sample_count = 0;
@@ -57,7 +112,7 @@ View* view_init(int tiles_horiz, int tiles_vert, int tile_size, const char *titl
   view->sound.channels = 1;
   view->sound.samples = 2048;
   view->sound.callback = audio_callback;
-  view->sound.userdata = &view->sample_count;
+  view->sound.userdata = view;
   SDL_OpenAudio(&view->sound, NULL);
 
   return view;
@@ -70,27 +125,37 @@ int view_set_sound(View *const view, bool enable) {
   if (!view->playing_sound && enable) {
     // Set the sound information for the beeping noise
     view->sample_count = 0;
+    // the gap while the sound was paused isn't an underrun
+    view->last_callback_us = 0;
     SDL_PauseAudio(0);
   }
   view->playing_sound = enable;
   return 0;
 }
 
-int view_get_input(unsigned char* const keys, const int key_count) {
+int view_get_input(View *const view, unsigned char* const keys, const int key_count) {
   SDL_PumpEvents();
   const Uint8* keyboard_state = SDL_GetKeyboardState(NULL);
   
   SDL_Event event;
-  SDL_PollEvent(&event);
-  if (event.type == SDL_QUIT) {
-    return 1; 
+  while (SDL_PollEvent(&event)) {
+    if (event.type == SDL_QUIT) {
+      return 1; 
+    }
+    if (event.type == SDL_KEYDOWN && !event.key.repeat
+        && event.key.keysym.scancode == OVERLAY_HOTKEY) {
+      view->show_overlay = !view->show_overlay;
+    }
+    if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+      view->resized = true;
+    }
   }
 
   // Loop through keys and update them based on the state of
   // the keys on the keyboard
   // see key-bindings.h for CHIP-8 keybindings
-  for (int i = 0; i < key_count; i++) {
-    keys[i] = keyboard_state[BINDINGS[i]];
+  for (int i = 0; i < key_count && i < BINDING_COUNT; i++) {
+    keys[i] = keyboard_state[BINDINGS[view->key_map[i]]];
   }
 
   bool quit = QUIT_SIGNAL;
@@ -104,42 +169,150 @@ int view_get_input(unsigned char* const keys, const int key_count) {
   return quit;
 }
 
+// Draw the overlay text in the top left corner of the window, on a dark background
+static void draw_overlay(View *const view) {
+  const int advance = (GLYPH_WIDTH + 1) * GLYPH_SCALE;
+  const int line_height = (GLYPH_HEIGHT + 2) * GLYPH_SCALE;
+  int columns = 0;
+  int lines = 1;
+  int line_length = 0;
+  for (const char *c = view->overlay; *c; c++) {
+    line_length = *c == '\n' ? 0 : line_length + 1;
+    lines += *c == '\n';
+    columns = line_length > columns ? line_length : columns;
+  }
+
+  SDL_SetRenderDrawColor(view->renderer, 0, 0, 80, 255);
+  SDL_Rect background = { 0, 0, columns * advance + GLYPH_SCALE, lines * line_height };
+  SDL_RenderFillRect(view->renderer, &background);
+
+  SDL_SetRenderDrawColor(view->renderer, 255, 255, 0, 255);
+  int x = GLYPH_SCALE;
+  int y = GLYPH_SCALE;
+  for (const char *c = view->overlay; *c; c++) {
+    if (*c == '\n') {
+      x = GLYPH_SCALE;
+      y += line_height;
+      continue;
+    }
+    const char *glyph_char = strchr(GLYPH_CHARS, toupper(*c));
+    if (*c != ' ' && glyph_char != NULL) {
+      const char *glyph = GLYPHS[glyph_char - GLYPH_CHARS];
+      for (int i = 0; i < GLYPH_WIDTH * GLYPH_HEIGHT; i++) {
+        if (glyph[i] == '1') {
+          SDL_Rect pixel = {
+            x + i % GLYPH_WIDTH * GLYPH_SCALE, y + i / GLYPH_WIDTH * GLYPH_SCALE,
+            GLYPH_SCALE, GLYPH_SCALE
+          };
+          SDL_RenderFillRect(view->renderer, &pixel);
+        }
+      }
+    }
+    x += advance;
+  }
+}
+
+// Fit the image to the window, keeping the CHIP-8 screen's aspect ratio, and make a texture for
+// it at that size. Returns -1 if the texture couldn't be created.
+static int resize_image(View *const view) {
+  int window_width, window_height;
+  SDL_GetRendererOutputSize(view->renderer, &window_width, &window_height);
+  double scale_x = (double)window_width / view->tiles_width;
+  double scale_y = (double)window_height / view->tiles_height;
+  double scale = scale_x < scale_y ? scale_x : scale_y;
+  // smaller than one pixel per tile (like a minimized window) isn't worth drawing
+  int width = (int)(view->tiles_width * scale);
+  int height = (int)(view->tiles_height * scale);
+  if (width < view->tiles_width || height < view->tiles_height) {
+    return -1;
+  }
+
+  if (view->texture) {
+    SDL_DestroyTexture(view->texture);
+  }
+  view->texture = SDL_CreateTexture(view->renderer, SDL_PIXELFORMAT_ARGB8888,
+      SDL_TEXTUREACCESS_STREAMING, width, height);
+  if (view->texture == NULL || phosphor_resize(view->phosphor, width, height) == -1) {
+    return -1;
+  }
+  view->image.x = (window_width - width) / 2;
+  view->image.y = (window_height - height) / 2;
+  view->image.w = width;
+  view->image.h = height;
+  view->resized = false;
+  return 0;
+}
+
 int view_draw(View *const view, unsigned char *const screen) {
-  // set color to black and clear the screen
+  if (view->phosphor == NULL) {
+    return -1;
+  }
+  // pixels keep fading while the window is too small to draw them
+  phosphor_update(view->phosphor, screen);
+  if (view->resized && resize_image(view) == -1) {
+    return -1;
+  }
+
+  void *pixels;
+  int pitch;
+  if (SDL_LockTexture(view->texture, NULL, &pixels, &pitch) != 0) {
+    return -1;
+  }
+  phosphor_render(view->phosphor, pixels, pitch);
+  SDL_UnlockTexture(view->texture);
+
+  // set color to black and clear the borders around the image
   SDL_SetRenderDrawColor(view->renderer, 0, 0, 0, 255);
   SDL_RenderClear(view->renderer);
-  // set color to white for drawing the pixels
-
-  for (int row = 0; row < view->tiles_height; row++) {
-    for (int col = 0; col < view->tiles_width; col++) {
-      // if the pixel in the screen is on, render a white square in the correct location
-      if (screen[row * view->tiles_width + col]) {
-        SDL_SetRenderDrawColor(view->renderer, 255, 255, 255, 255);
-        SDL_Rect rect;
-        rect.x = col * view->tile_size;
-        rect.y = row * view->tile_size;
-        rect.w = view->tile_size;
-        rect.h = view->tile_size;
-        SDL_RenderFillRect(view->renderer, &rect);
-      }
-      else {
-        // I added a kind of dot here to create a grid-effect, not strictly necessary but
-        // it helped me confirm my rendering logic is correct
-        SDL_SetRenderDrawColor(view->renderer, 50, 50, 50, 255);
-        SDL_Rect rect;
-        rect.x = col * view->tile_size;
-        rect.y = row * view->tile_size;
-        rect.w = (int)view->tile_size * 0.1;
-        rect.h = (int)view->tile_size * 0.1;
-        SDL_RenderFillRect(view->renderer, &rect);
-      }
-    }
+  SDL_RenderCopy(view->renderer, view->texture, NULL, &view->image);
+  if (view->show_overlay) {
+    draw_overlay(view);
   }
   SDL_RenderPresent(view->renderer);
   return 0;
 }
 
+int view_set_phosphor(View *const view, float persistence, bool scanlines) {
+  Phosphor *phosphor = phosphor_init(view->tiles_width, view->tiles_height, persistence,
+      scanlines);
+  if (phosphor == NULL) {
+    return -1;
+  }
+  phosphor_destroy(view->phosphor);
+  view->phosphor = phosphor;
+  view->resized = true;
+  return 0;
+}
+
+bool view_fades(View *const view) {
+  return view->phosphor && phosphor_persistent(view->phosphor);
+}
+
+void view_set_key_map(View *const view, const unsigned char *const key_map, const int key_count) {
+  for (int i = 0; i < BINDING_COUNT; i++) {
+    bool mapped = key_map && i < key_count && key_map[i] < BINDING_COUNT;
+    view->key_map[i] = mapped ? key_map[i] : i;
+  }
+}
+
+void view_set_metrics(View *const view, Metrics *const metrics) {
+  view->metrics = metrics;
+}
+
+void view_set_overlay(View *const view, const char *const text) {
+  strncpy(view->overlay, text, OVERLAY_SIZE - 1);
+  view->overlay[OVERLAY_SIZE - 1] = 0;
+}
+
+bool view_overlay_visible(View *const view) {
+  return view->show_overlay;
+}
+
 void view_destroy(View *view) {
+  if (view->texture) {
+    SDL_DestroyTexture(view->texture);
+  }
+  phosphor_destroy(view->phosphor);
   SDL_DestroyRenderer(view->renderer);
   SDL_DestroyWindow(view->window);
   SDL_CloseAudio();
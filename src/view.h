@@ -4,8 +4,10 @@
 #define SAMPLE_RATE 44100
 #define AMPLITUDE 1000 // volume of the beeping
 #define QUIT_SIGNAL 200 // the return code I'm using to convey that the user quit the program
+#define DEFAULT_SCALE 15 // how many window pixels wide each CHIP-8 pixel starts out as
 
 typedef struct View View;
+struct Metrics;
 
 // Initialize a View renderer, returning it upon completion.
 // NOTE: This function uses memory allocation. It is expected that `view_destroy` will be called
@@ -13,16 +15,31 @@ typedef struct View View;
 //
 // `tiles_horiz`: the width of the CHIP-8 screen
 // `tiles_vert`: the height of the CHIP-8 screen
-// `tile_size`: the scaling factor between the CHIP-8 screen and the computer screen
+// `scale`: the scaling factor between the CHIP-8 screen and the window's starting size. The
+//          window can be resized afterwards, and the screen is scaled to fit it.
 // `title`: a title for the window being created
-View* view_init(int tiles_horiz, int tiles_vert, int tile_size, const char *title);
+View* view_init(int tiles_horiz, int tiles_vert, double scale, const char *title);
 
 // Render a CHIP-8's screen to a GUI window.
+// When pixels fade out (see `view_set_phosphor`), each call advances the fading by one frame.
 // `view`: the struct storing internal view information
 // `screen`: a 2D grid representing the state (on or off) of each pixel
 //           in the CHIP-8.
 int view_draw(View *const view, unsigned char *const screen);
 
+// Set how the screen is rendered, returning -1 if the renderer can't be allocated (see
+// phosphor.h). Every pixel starts out off again.
+// `view`: the struct storing internal view information
+// `persistence`: the fraction of its brightness a pixel keeps each frame after turning off,
+//                0 for pixels to turn off immediately
+// `scanlines`: whether to darken the gaps between rows of pixels, like a CRT
+int view_set_phosphor(View *const view, float persistence, bool scanlines);
+
+// Check whether pixels fade out over several frames, in which case the view should be drawn
+// every frame instead of only when the screen changes
+// `view`: the struct storing internal view information
+bool view_fades(View *const view);
+
 // Enable or disable the beeping noise that can be played by a CHIP-8 system
 // 
 // NOTE: If enable is 1 and the view is already beeping, nothing will happen. Conversely,
@@ -39,9 +56,34 @@ int view_set_sound(View *const view, bool enable);
 // The function will return 0 if it is successful, and QUIT_SIGNAL if the user enters
 // the key combination for closing the program.
 // 
+// This also handles the view's own hotkeys, like toggling the metrics overlay.
+//
+// `view`: the struct storing internal view information
 // `keys`: an array indicating whether each key is currently being pressed
 // `key_count`: the number of elements in `keys`.
-int view_get_input(unsigned char* const keys, const int key_count);
+int view_get_input(View *const view, unsigned char* const keys, const int key_count);
+
+// Set which keys press which CHIP-8 keys, for programs which expect a different layout
+// `view`: the struct storing internal view information
+// `key_map`: the key in the default layout (see key-bindings.h) which presses each CHIP-8 key,
+//            or NULL for the default layout
+// `key_count`: the number of elements in `key_map`
+void view_set_key_map(View *const view, const unsigned char *const key_map, const int key_count);
+
+// Set the metrics the view records audio underruns into
+// `view`: the struct storing internal view information
+// `metrics`: the metrics to record into, or NULL to stop recording
+void view_set_metrics(View *const view, struct Metrics *const metrics);
+
+// Set the text of the overlay drawn over the screen while it is toggled on (see OVERLAY_HOTKEY).
+// Lines are separated by '\n', and only letters, numbers and . : / - % can be displayed.
+// `view`: the struct storing internal view information
+// `text`: the text to display
+void view_set_overlay(View *const view, const char *const text);
+
+// Check whether the overlay is currently toggled on
+// `view`: the struct storing internal view information
+bool view_overlay_visible(View *const view);
 
 // Deconstruct the view struct, freeing the resources used by the view and cleaning up
 // and GUI library resources.
@@ -0,0 +1,76 @@
+#include "watch.h"
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// a finished write to the file, or another file being renamed to its name
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+// enough for several events at once, each of which can have a name up to NAME_MAX long
+#define EVENT_BUFFER_SIZE (8 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+struct Watch {
+  int fd;
+  char name[NAME_MAX + 1]; // the file's name within the watched directory
+};
+
+Watch* watch_open(const char *path) {
+  const char *slash = strrchr(path, '/');
+  const char *name = slash ? slash + 1 : path;
+  if (strlen(name) == 0 || strlen(name) > NAME_MAX) {
+    return NULL;
+  }
+  char dir[PATH_MAX];
+  if (slash == NULL) {
+    strcpy(dir, ".");
+  } else if (slash == path) {
+    strcpy(dir, "/");
+  } else if (slash - path < PATH_MAX) {
+    memcpy(dir, path, slash - path);
+    dir[slash - path] = 0;
+  } else {
+    return NULL;
+  }
+
+  Watch *watch = malloc(sizeof(Watch));
+  if (watch == NULL) {
+    return NULL;
+  }
+  watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch->fd == -1 || inotify_add_watch(watch->fd, dir, WATCH_EVENTS) == -1) {
+    if (watch->fd != -1) {
+      close(watch->fd);
+    }
+    free(watch);
+    return NULL;
+  }
+  strcpy(watch->name, name);
+  return watch;
+}
+
+bool watch_changed(Watch *const watch, int timeout_ms) {
+  struct pollfd readable = { .fd = watch->fd, .events = POLLIN };
+  if (poll(&readable, 1, timeout_ms) <= 0) {
+    return false;
+  }
+
+  // read every waiting event, since other files in the directory also have them
+  bool changed = false;
+  char buffer[EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t length;
+  while ((length = read(watch->fd, buffer, sizeof(buffer))) > 0) {
+    for (char *next = buffer; next < buffer + length;) {
+      const struct inotify_event *event = (const struct inotify_event*)next;
+      changed |= event->len && strcmp(event->name, watch->name) == 0;
+      next += sizeof(struct inotify_event) + event->len;
+    }
+  }
+  return changed;
+}
+
+void watch_close(Watch *watch) {
+  close(watch->fd);
+  free(watch);
+}
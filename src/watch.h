@@ -0,0 +1,30 @@
+#ifndef WATCH
+#define WATCH
+
+#include <stdbool.h>
+
+// Watches a file for changes with inotify, for reloading a program while it's being developed.
+//
+// The file's directory is watched rather than the file itself, so saving with editors and
+// assemblers which write a new file and rename it over the old one is still noticed. Only
+// finished writes count, so a file being written is never read halfway through.
+
+typedef struct Watch Watch;
+
+// Start watching a file, returning NULL if it can't be watched (e.g. its directory doesn't exist).
+// NOTE: This function uses memory allocation. It is expected that `watch_close` will be called
+// when the file no longer needs to be watched in order to free that memory.
+// `path`: the path of the file to watch
+Watch* watch_open(const char *path);
+
+// Check whether the file has changed since the last check, waiting up to `timeout_ms`
+// milliseconds for it to change. Several changes between checks count as one.
+// `watch`: the watched file
+// `timeout_ms`: how long to wait for a change, 0 to return immediately
+bool watch_changed(Watch *const watch, int timeout_ms);
+
+// Stop watching a file and free its memory
+// `watch`: the watch to close
+void watch_close(Watch *watch);
+
+#endif
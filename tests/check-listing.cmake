@@ -0,0 +1,15 @@
+# Checks that a bundled ROM matches the commented hex listing it's built from, run as
+# cmake -DLISTING=[listing-filepath] -DROM=[rom-filepath] -P check-listing.cmake
+file(STRINGS ${LISTING} lines)
+set(listed "")
+foreach(line IN LISTS lines)
+  string(REGEX REPLACE "#.*" "" line "${line}")
+  string(REGEX REPLACE "[ \t]" "" line "${line}")
+  string(APPEND listed "${line}")
+endforeach()
+string(TOLOWER "${listed}" listed)
+file(READ ${ROM} rom HEX)
+if (NOT listed STREQUAL rom)
+  message(FATAL_ERROR "${ROM} doesn't match ${LISTING}, rebuild it with the command at the top "
+    "of the listing")
+endif()
@@ -0,0 +1,127 @@
+#include "compact.h"
+#include "control.h"
+#include "libchip8.h"
+#include "quirks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks that compact instances end up in exactly the same state as a Chip8 running `exec_frame`
+// when their state is replaced with `compact_write` between frames, including on a runner which
+// still holds their old pages and after other instances' pages have been freed, and when they
+// move between runners.
+
+// A300 F065 A300 F055 1200: reads the byte at 0x300 into V0 and writes it back, forever
+static const uint8_t COPY_LOOP[] = { 0xA3, 0x00, 0xF0, 0x65, 0xA3, 0x00, 0xF0, 0x55, 0x12, 0x00 };
+// A300 F065 7001 A300 F055 1200: increments the byte at 0x300, forever
+static const uint8_t COUNT_LOOP[] = {
+  0xA3, 0x00, 0xF0, 0x65, 0x70, 0x01, 0xA3, 0x00, 0xF0, 0x55, 0x12, 0x00,
+};
+
+static int failures = 0;
+
+// Compare an instance with the Chip8 it should match, printing what differs
+static void check(const CompactChip8 *const compact, const Chip8 *const expected,
+    const char *what) {
+  Chip8 actual;
+  compact_read(compact, &actual);
+  if (memcmp(actual.memory, expected->memory, ADDRESS_COUNT) != 0
+      || chip8_hash_state(&actual) != chip8_hash_state(expected) || actual.rng != expected->rng) {
+    printf("FAIL  %s: V0=%02X mem[0x300]=%02X, expected V0=%02X mem[0x300]=%02X\n", what,
+        actual.V[0], actual.memory[0x300], expected->V[0], expected->memory[0x300]);
+    failures++;
+  }
+}
+
+// Replace the byte at 0x300 of an instance and of the Chip8 it should match
+static void poke(CompactChip8 *const compact, Chip8 *const expected, uint8_t value) {
+  Chip8 state;
+  compact_read(compact, &state);
+  state.memory[0x300] = value;
+  expected->memory[0x300] = value;
+  if (compact_write(compact, &state)) {
+    printf("FAIL  unable to write an instance\n");
+    failures++;
+  }
+}
+
+int main(void) {
+  Chip8 *expected = chip8_create();
+  chip8_load(expected, COPY_LOOP, sizeof(COPY_LOOP));
+  expected->exec_variant = select_instruction_handler(&expected->config);
+  Chip8 *start = chip8_clone(expected);
+  CompactImage *image = compact_image_create(&expected->config, COPY_LOOP, sizeof(COPY_LOOP));
+  CompactRunner *runner = compact_runner_create();
+
+  // write -> run -> read, on a runner which already holds the page being written
+  CompactChip8 *compact = compact_create(image);
+  compact_run_frame(runner, compact, NULL);
+  exec_frame(expected);
+  poke(compact, expected, 0x42);
+  compact_run_frame(runner, compact, NULL);
+  exec_frame(expected);
+  check(compact, expected, "write to a page the runner holds");
+  poke(compact, expected, 0x17);
+  compact_run_frame(runner, compact, NULL);
+  exec_frame(expected);
+  check(compact, expected, "second write to the same page");
+
+  // a new instance given the destroyed one's page back, with different contents
+  compact_destroy(compact);
+  compact = compact_create(image);
+  chip8_load_state(expected, start);
+  poke(compact, expected, 0x99);
+  for (int frame = 0; frame < 3; frame++) {
+    compact_run_frame(runner, compact, NULL);
+    exec_frame(expected);
+  }
+  check(compact, expected, "write to a new instance after another was destroyed");
+
+  // several instances taking turns on the same runner, each written between frames
+  enum { INSTANCES = 8 };
+  CompactChip8 *instances[INSTANCES];
+  Chip8 *states[INSTANCES];
+  for (int i = 0; i < INSTANCES; i++) {
+    instances[i] = compact_create(image);
+    states[i] = chip8_clone(start);
+  }
+  for (int round = 0; round < 16; round++) {
+    for (int i = 0; i < INSTANCES; i++) {
+      if ((round + i) % 3 == 0) {
+        poke(instances[i], states[i], round * INSTANCES + i);
+      }
+      compact_run_frame(runner, instances[i], NULL);
+      exec_frame(states[i]);
+    }
+  }
+  for (int i = 0; i < INSTANCES; i++) {
+    check(instances[i], states[i], "instances written while taking turns on a runner");
+    compact_destroy(instances[i]);
+    chip8_destroy(states[i]);
+  }
+
+  compact_destroy(compact);
+  compact_runner_destroy(runner);
+  compact_image_release(image);
+  chip8_destroy(start);
+
+  // an instance which writes its own pages, taking turns between two runners which both hold them
+  chip8_reset(expected);
+  chip8_load(expected, COUNT_LOOP, sizeof(COUNT_LOOP));
+  expected->exec_variant = select_instruction_handler(&expected->config);
+  image = compact_image_create(&expected->config, COUNT_LOOP, sizeof(COUNT_LOOP));
+  compact = compact_create(image);
+  CompactRunner *runners[2] = { compact_runner_create(), compact_runner_create() };
+  for (int frame = 0; frame < 6; frame++) {
+    compact_run_frame(runners[frame % 3 == 1], compact, NULL);
+    exec_frame(expected);
+  }
+  check(compact, expected, "an instance moving between runners");
+  compact_destroy(compact);
+  compact_runner_destroy(runners[0]);
+  compact_runner_destroy(runners[1]);
+  compact_image_release(image);
+  chip8_destroy(expected);
+  printf("%s\n", failures ? "compact instances differ from exec_frame" : "ok");
+  return failures ? 1 : 0;
+}
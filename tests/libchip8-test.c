@@ -0,0 +1,63 @@
+#include "compact.h"
+#include "libchip8.h"
+#include <stdio.h>
+
+// Checks that the embedding loop documented in libchip8.h ends when a program runs off the end of
+// memory or faults, for both `chip8_run_frame` and `compact_run_frame`.
+
+// 1FFE: jumps to the last instruction in memory, which is 0000 (does nothing), so the program
+// counter ends up past the end of memory without a fault
+static const uint8_t RUN_OFF_END[] = { 0x1F, 0xFE };
+// 00EE: returns with an empty stack
+static const uint8_t UNDERFLOW[] = { 0x00, 0xEE };
+
+// more than enough for either program to stop
+#define MAX_FRAMES 10
+
+static int failures = 0;
+
+// Run a program with `chip8_run_frame` until it stops, checking what it returned
+static void check_frames(const uint8_t *const program, size_t size, int expected,
+    const char *what) {
+  Chip8 *chip8 = chip8_create();
+  chip8_load(chip8, program, size);
+  int result = FAULT_NONE;
+  for (int frame = 0; frame < MAX_FRAMES && !result; frame++) {
+    result = chip8_run_frame(chip8, NULL);
+  }
+  if (result != expected) {
+    printf("FAIL  chip8_run_frame, %s: returned %d, expected %d\n", what, result, expected);
+    failures++;
+  }
+  chip8_destroy(chip8);
+}
+
+// Run a program with `compact_run_frame` until it stops, checking what it returned
+static void check_compact(const uint8_t *const program, size_t size, int expected,
+    const char *what) {
+  Chip8 *chip8 = chip8_create();
+  CompactImage *image = compact_image_create(&chip8->config, program, size);
+  CompactChip8 *compact = compact_create(image);
+  CompactRunner *runner = compact_runner_create();
+  int result = FAULT_NONE;
+  for (int frame = 0; frame < MAX_FRAMES && !result; frame++) {
+    result = compact_run_frame(runner, compact, NULL);
+  }
+  if (result != expected) {
+    printf("FAIL  compact_run_frame, %s: returned %d, expected %d\n", what, result, expected);
+    failures++;
+  }
+  compact_runner_destroy(runner);
+  compact_destroy(compact);
+  compact_image_release(image);
+  chip8_destroy(chip8);
+}
+
+int main(void) {
+  check_frames(RUN_OFF_END, sizeof(RUN_OFF_END), CHIP8_ENDED, "running off the end of memory");
+  check_frames(UNDERFLOW, sizeof(UNDERFLOW), FAULT_STACK_UNDERFLOW, "stack underflow");
+  check_compact(RUN_OFF_END, sizeof(RUN_OFF_END), CHIP8_ENDED, "running off the end of memory");
+  check_compact(UNDERFLOW, sizeof(UNDERFLOW), FAULT_STACK_UNDERFLOW, "stack underflow");
+  printf("%s\n", failures ? "frames didn't stop as documented" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+#include "chip8.h"
+#include "control.h"
+#include "lockstep.h"
+#include "quirks.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks that every lane of a lockstep engine ends up in exactly the same state as a Chip8
+// running `exec_frame`, with each lane given its own seed, starting registers and keys so the
+// lanes branch apart. Every program runs with each combination of quirks, on the AVX2 path (when
+// the CPU has it) and on the generic one.
+//
+// Usage: lockstep-test [rom-filepath]...
+// The ROMs run along with a self-modifying program and RANDOM_PROGRAMS programs of random bytes.
+
+// C1FF 6072 A20C F155 6205 6300 6207 1200: writes 72 (add to V2) and a random number over the
+// 6207 at 0x20C, so every lane runs different code from the same addresses
+static const uint8_t SELF_MODIFY[] = {
+  0xC1, 0xFF, 0x60, 0x72, 0xA2, 0x0C, 0xF1, 0x55, 0x62, 0x05, 0x63, 0x00, 0x62, 0x07, 0x12, 0x00,
+};
+
+#define RANDOM_PROGRAMS 16
+#define RANDOM_PROGRAM_SIZE 256
+#define FRAMES 120
+// frames between comparisons, which cost far more than running the frames
+#define CHECK_INTERVAL 10
+
+static int failures = 0;
+
+// xorshift32, so the lanes' starting states are the same every run
+static uint32_t random_state = 0x2545F491;
+static uint32_t next_random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+// Compare a lane with the Chip8 it should match, printing what differs. Returns 1 if they differ.
+static int check_lane(const Lockstep *const lockstep, int lane, const Chip8 *const expected,
+    const char *what, unsigned quirks, int generic, int frame) {
+  Chip8 actual;
+  lockstep_read_lane(lockstep, lane, &actual);
+  if (memcmp(actual.memory, expected->memory, ADDRESS_COUNT) != 0
+      || chip8_hash_state(&actual) != chip8_hash_state(expected) || actual.rng != expected->rng
+      || actual.fault != expected->fault) {
+    printf("FAIL  %s [quirks %u, %s] lane %d @ frame %d: pc=%03X V0=%02X, expected pc=%03X "
+        "V0=%02X\n", what, quirks, generic ? "generic" : "avx2", lane, frame, actual.pc,
+        actual.V[0], expected->pc, expected->V[0]);
+    failures++;
+    return 1;
+  }
+  return 0;
+}
+
+// Run a program on a lockstep engine and on a Chip8 per lane, comparing them every
+// CHECK_INTERVAL frames
+static void compare(const uint8_t *const program, size_t size, const char *what, unsigned quirks,
+    int generic) {
+  ConfigFlags config = { 0 };
+  config.legacy_shift = (quirks & QUIRK_LEGACY_SHIFT) != 0;
+  config.jump_quirk = (quirks & QUIRK_JUMP) != 0;
+  config.legacy_indexing = (quirks & QUIRK_LEGACY_INDEXING) != 0;
+  Lockstep *lockstep = lockstep_create(&config, program, size);
+  if (lockstep == NULL) {
+    printf("FAIL  %s: unable to create a lockstep engine\n", what);
+    failures++;
+    return;
+  }
+  if (generic) {
+    lockstep_use_generic(lockstep);
+  }
+
+  Chip8 *expected[LOCKSTEP_LANES];
+  for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+    Chip8 *chip8 = chip8_init();
+    chip8->config = config;
+    chip8->exec_variant = select_instruction_handler(&config);
+    memcpy(chip8->memory + PROGRAM_START, program, size);
+    chip8_seed(chip8, next_random());
+    for (int r = 0; r < REGISTER_COUNT; r++) {
+      chip8->V[r] = next_random();
+    }
+    uint16_t keys = next_random();
+    for (int key = 0; key < KEY_COUNT; key++) {
+      chip8->key[key] = (keys >> key) & 1;
+    }
+    lockstep_write_lane(lockstep, lane, chip8);
+    lockstep_set_keys(lockstep, lane, keys);
+    expected[lane] = chip8;
+  }
+
+  int differ = 0;
+  for (int frame = 1; frame <= FRAMES && !differ; frame++) {
+    lockstep_run_frame(lockstep);
+    for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+      exec_frame(expected[lane]);
+    }
+    for (int lane = 0; frame % CHECK_INTERVAL == 0 && lane < LOCKSTEP_LANES && !differ; lane++) {
+      differ = check_lane(lockstep, lane, expected[lane], what, quirks, generic, frame);
+    }
+  }
+  for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+    chip8_destroy(expected[lane]);
+  }
+  lockstep_destroy(lockstep);
+}
+
+// Run a program with every combination of quirks, on both paths
+static void compare_all(const uint8_t *const program, size_t size, const char *what) {
+  for (unsigned quirks = 0; quirks < VARIANT_COUNT; quirks++) {
+    compare(program, size, what, quirks, 0);
+    compare(program, size, what, quirks, 1);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  for (int i = 1; i < argc; i++) {
+    Chip8 *chip8 = chip8_init();
+    int size = load_program(chip8, argv[i]);
+    if (size < 0) {
+      printf("ERROR unable to load %s\n", argv[i]);
+      failures++;
+    } else {
+      compare_all(chip8->memory + PROGRAM_START, size, argv[i]);
+    }
+    chip8_destroy(chip8);
+  }
+  compare_all(SELF_MODIFY, sizeof(SELF_MODIFY), "self-modifying program");
+  for (int i = 0; i < RANDOM_PROGRAMS; i++) {
+    uint8_t program[RANDOM_PROGRAM_SIZE];
+    for (int byte = 0; byte < RANDOM_PROGRAM_SIZE; byte++) {
+      program[byte] = next_random();
+    }
+    char what[32];
+    snprintf(what, sizeof(what), "random program %d", i);
+    compare_all(program, sizeof(program), what);
+  }
+  printf("%s\n", failures ? "lanes differ from exec_frame" : "ok");
+  return failures ? 1 : 0;
+}